@@ -1,12 +1,31 @@
 #pragma once
 
+#include "cktensor/alloc_stats.h"
 #include "cktensor/allocator.h"
+#include "cktensor/arena.h"
+#include "cktensor/broadcast.h"
+#include "cktensor/cpu.h"
 #include "cktensor/functions.h"
 #include "cktensor/gemm.h"
+#include "cktensor/gemm_blocked.h"
+#include "cktensor/gemm_int8.h"
+#include "cktensor/gemm_simd.h"
+#include "cktensor/gemm_small.h"
+#include "cktensor/gemm_strassen.h"
+#include "cktensor/gemm_tuning.h"
+#include "cktensor/half.h"
+#include "cktensor/mapped_tensor.h"
+#include "cktensor/mask.h"
+#include "cktensor/matmul.h"
 #include "cktensor/ops.h"
+#include "cktensor/ops_simd.h"
+#include "cktensor/packed_matrix.h"
+#include "cktensor/page_resource.h"
 #include "cktensor/parallel.h"
+#include "cktensor/quantized.h"
 #include "cktensor/tensor.h"
 #include "cktensor/tensor_iterator.h"
 #include "cktensor/tensor_view.h"
+#include "cktensor/thread_pool.h"
 #include "cktensor/traits.h"
 #include "cktensor/util.h"
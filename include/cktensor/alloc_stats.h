@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <ostream>
+
+
+// The counters are updated on every tensor allocation. Define CKTENSOR_DISABLE_ALLOC_STATS to compile them out.
+// The live, peak and total bytes are the bytes requested by the tensors. The memory behind them is larger: the
+// block cache rounds the blocks up to their size class, keeps the freed blocks for reuse and also serves the
+// scratch buffers of the kernels, and the page resources round up to whole pages. That memory is counted by the
+// reserved and cached bytes.
+
+namespace ck {
+
+struct AllocStats {
+    // Bucket i counts the allocations of [2^i, 2^(i+1)) bytes
+    static constexpr std::size_t num_buckets = 48;
+
+    std::size_t live_bytes{0};
+    std::size_t peak_bytes{0};
+    std::size_t live_allocations{0};
+    std::size_t total_allocations{0};
+    std::size_t total_bytes{0};
+    std::array<std::size_t, num_buckets> histogram{};
+
+    // Bytes held from the system by the block cache and the page resources, including the cached blocks
+    std::size_t reserved_bytes{0};
+    std::size_t peak_reserved_bytes{0};
+    // Bytes of the free blocks kept by the block cache, in all the thread caches and the global cache
+    std::size_t cached_bytes{0};
+};
+
+namespace impl {
+
+struct AllocCounters {
+    std::atomic<std::size_t> live_bytes{0};
+    std::atomic<std::size_t> peak_bytes{0};
+    std::atomic<std::size_t> live_allocations{0};
+    std::atomic<std::size_t> total_allocations{0};
+    std::atomic<std::size_t> total_bytes{0};
+    std::array<std::atomic<std::size_t>, AllocStats::num_buckets> histogram{};
+    std::atomic<std::size_t> reserved_bytes{0};
+    std::atomic<std::size_t> peak_reserved_bytes{0};
+    std::atomic<std::size_t> cached_bytes{0};
+};
+
+inline AllocCounters& alloc_counters() {
+    // Never destroyed, so that the tensors with static storage duration can be counted until the very end
+    static auto* counters = new AllocCounters;
+    return *counters;
+}
+
+constexpr std::size_t histogram_bucket(std::size_t bytes) {
+    const std::size_t bucket = bytes == 0 ? 0 : std::bit_width(bytes) - 1;
+    return bucket < AllocStats::num_buckets ? bucket : AllocStats::num_buckets - 1;
+}
+
+inline void update_peak(std::atomic<std::size_t>& peak_counter, std::size_t value) noexcept {
+    std::size_t peak = peak_counter.load(std::memory_order_relaxed);
+    while (value > peak && !peak_counter.compare_exchange_weak(peak, value, std::memory_order_relaxed)) {}
+}
+
+inline void record_allocation(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    auto& counters = alloc_counters();
+    const std::size_t live = counters.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    update_peak(counters.peak_bytes, live);
+
+    counters.live_allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.total_allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.histogram[histogram_bucket(bytes)].fetch_add(1, std::memory_order_relaxed);
+#else
+    (void) bytes;
+#endif
+}
+
+inline void record_deallocation(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    auto& counters = alloc_counters();
+    counters.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    counters.live_allocations.fetch_sub(1, std::memory_order_relaxed);
+#else
+    (void) bytes;
+#endif
+}
+
+// Memory taken from or given back to the system
+inline void record_reserve(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    auto& counters = alloc_counters();
+    const std::size_t reserved = counters.reserved_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    update_peak(counters.peak_reserved_bytes, reserved);
+#else
+    (void) bytes;
+#endif
+}
+
+inline void record_release(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    alloc_counters().reserved_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+#else
+    (void) bytes;
+#endif
+}
+
+// Blocks put into or taken out of the block cache
+inline void record_cached(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    alloc_counters().cached_bytes.fetch_add(bytes, std::memory_order_relaxed);
+#else
+    (void) bytes;
+#endif
+}
+
+inline void record_uncached(std::size_t bytes) noexcept {
+#ifndef CKTENSOR_DISABLE_ALLOC_STATS
+    alloc_counters().cached_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+#else
+    (void) bytes;
+#endif
+}
+
+}
+
+// A snapshot of the tensor allocations so far. The counters are not updated atomically as a whole, so the
+// snapshot can be slightly inconsistent while other threads are allocating.
+inline AllocStats alloc_stats() {
+    const auto& counters = impl::alloc_counters();
+
+    AllocStats stats;
+    stats.live_bytes = counters.live_bytes.load(std::memory_order_relaxed);
+    stats.peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed);
+    stats.live_allocations = counters.live_allocations.load(std::memory_order_relaxed);
+    stats.total_allocations = counters.total_allocations.load(std::memory_order_relaxed);
+    stats.total_bytes = counters.total_bytes.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < AllocStats::num_buckets; i++)
+        stats.histogram[i] = counters.histogram[i].load(std::memory_order_relaxed);
+    stats.reserved_bytes = counters.reserved_bytes.load(std::memory_order_relaxed);
+    stats.peak_reserved_bytes = counters.peak_reserved_bytes.load(std::memory_order_relaxed);
+    stats.cached_bytes = counters.cached_bytes.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+// Starts a new measurement window for the peaks, e.g. per request
+inline void reset_peak_bytes() {
+    auto& counters = impl::alloc_counters();
+    counters.peak_bytes.store(counters.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    counters.peak_reserved_bytes.store(counters.reserved_bytes.load(std::memory_order_relaxed),
+                                       std::memory_order_relaxed);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const AllocStats& stats) {
+    os << "CKTensor allocations:\n"
+       << "  live bytes:        " << stats.live_bytes << '\n'
+       << "  peak bytes:        " << stats.peak_bytes << '\n'
+       << "  live allocations:  " << stats.live_allocations << '\n'
+       << "  total allocations: " << stats.total_allocations << '\n'
+       << "  total bytes:       " << stats.total_bytes << '\n'
+       << "  reserved bytes:    " << stats.reserved_bytes << '\n'
+       << "  peak reserved:     " << stats.peak_reserved_bytes << '\n'
+       << "  cached bytes:      " << stats.cached_bytes << '\n'
+       << "  size histogram:\n";
+
+    for (std::size_t i = 0; i < AllocStats::num_buckets; i++) {
+        if (stats.histogram[i] != 0)
+            os << "    [2^" << i << ", 2^" << i + 1 << "): " << stats.histogram[i] << '\n';
+    }
+    return os;
+}
+
+// Prints the statistics to stderr when the program exits. Setting the CKTENSOR_ALLOC_STATS environment variable
+// to a non-zero value does the same without any code change.
+inline void dump_alloc_stats_at_exit() {
+    static const bool registered = [] {
+        std::atexit([] { std::cerr << alloc_stats(); });
+        return true;
+    }();
+    (void) registered;
+}
+
+namespace impl {
+inline const bool alloc_stats_env_registered = [] {
+    const char* env = std::getenv("CKTENSOR_ALLOC_STATS");
+    if (env != nullptr && env[0] != '\0' && env[0] != '0') {
+        dump_alloc_stats_at_exit();
+        return true;
+    }
+    return false;
+}();
+}
+
+}
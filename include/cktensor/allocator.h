@@ -1,47 +1,465 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <cstddef>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "alloc_stats.h"
 
 #ifdef CKTENSOR_USE_MKL
 #include "mkl.h"
 #endif
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace ck {
 
 constexpr size_t default_alignment = 64;
 
-// TODO: Cache memory blocks
+namespace impl {
+
+inline void* aligned_allocate(std::size_t bytes, std::size_t alignment) {
 #ifdef CKTENSOR_USE_MKL
+    void* p = mkl_malloc(bytes, static_cast<int>(alignment));
+    if (p == nullptr)
+        throw std::bad_alloc{};
+    return p;
+#else
+    return ::operator new(bytes, std::align_val_t(alignment));
+#endif
+}
 
-template <typename T, size_t Alignment=default_alignment>
-class TensorAllocator : public std::allocator<T> {
+inline void aligned_deallocate(void* p, std::size_t alignment) noexcept {
+#ifdef CKTENSOR_USE_MKL
+    (void) alignment;
+    mkl_free(p);
+#else
+    ::operator delete(p, std::align_val_t(alignment));
+#endif
+}
+
+inline std::size_t page_size() {
+#if defined(__unix__) || defined(__APPLE__)
+    static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+// Blocks are grouped into four size classes per power of two, starting from 64 bytes.
+// So, a block wastes at most 25% of its size.
+constexpr std::size_t min_block_bits = 6;
+constexpr std::size_t max_block_bits = 40;
+constexpr std::size_t num_size_classes = (max_block_bits - min_block_bits) * 4 + 1;
+
+constexpr std::size_t size_class(std::size_t bytes) {
+    if (bytes <= (std::size_t{1} << min_block_bits))
+        return 0;
+
+    const std::size_t p = std::bit_width(bytes - 1) - 1;
+    const std::size_t step = std::size_t{1} << (p - 2);
+    const std::size_t q = (bytes - (std::size_t{1} << p) + step - 1) / step;
+    return (p - min_block_bits) * 4 + q;
+}
+
+constexpr std::size_t class_size(std::size_t index) {
+    const std::size_t p = min_block_bits + index / 4;
+    const std::size_t q = index % 4;
+    return (std::size_t{1} << p) + q * (std::size_t{1} << (p - 2));
+}
+
+}
+
+// A size-class caching allocator for the tensor buffers.
+// Freed blocks are kept in per-thread free lists first. When a thread cache is full, blocks go to a global
+// free list which is shared between the threads. Blocks that do not fit into the global cache are
+// released to the system.
+class BlockCache {
 public:
-    using size_type = size_t;
-    using difference_type = ptrdiff_t;
-    using pointer = T*;
-    using const_pointer = const T*;
-    using reference = T&;
-    using const_reference = const T&;
-    using value_type = T;
+    static constexpr std::size_t alignment = default_alignment;
 
-    template<typename U>
-    struct rebind {
-        using other = TensorAllocator<U, Alignment> ;
+    static BlockCache& instance() {
+        // Never destroyed, so that the tensors with static storage duration can still release their memory
+        static BlockCache* cache = new BlockCache;
+        return *cache;
+    }
+
+    void* allocate(std::size_t bytes) {
+        if (bytes == 0)
+            return nullptr;
+
+        const std::size_t index = impl::size_class(bytes);
+        if (index >= impl::num_size_classes)
+            return reserve(bytes);
+
+        if (ThreadCache* tc = thread_cache()) {
+            auto& list = tc->lists[index];
+            if (!list.empty()) {
+                void* p = list.back();
+                list.pop_back();
+                tc->cached_bytes -= impl::class_size(index);
+                impl::record_uncached(impl::class_size(index));
+                return p;
+            }
+        }
+
+        {
+            std::lock_guard lock{mutex_};
+            auto& list = lists_[index];
+            if (!list.empty()) {
+                void* p = list.back();
+                list.pop_back();
+                cached_bytes_ -= impl::class_size(index);
+                impl::record_uncached(impl::class_size(index));
+                return p;
+            }
+        }
+
+        try {
+            return reserve(impl::class_size(index));
+        }
+        catch (const std::bad_alloc&) {
+            // The cached blocks might be the reason, give them back and retry once.
+            empty_cache();
+            return reserve(impl::class_size(index));
+        }
+    }
+
+    void deallocate(void* p, std::size_t bytes) noexcept {
+        if (p == nullptr)
+            return;
+
+        const std::size_t index = impl::size_class(bytes);
+        if (index >= impl::num_size_classes) {
+            release(p, bytes);
+            return;
+        }
+
+        const std::size_t size = impl::class_size(index);
+
+        ThreadCache* tc = thread_cache();
+        if (tc && tc->cached_bytes + size <= thread_limit()) {
+            if (push(tc->lists[index], p)) {
+                tc->cached_bytes += size;
+                impl::record_cached(size);
+                return;
+            }
+        }
+
+        release_to_global(p, index);
+    }
+
+    // Releases the blocks cached by the calling thread and the global cache to the system.
+    // The blocks cached by the other threads are moved to the global cache when those threads exit.
+    void empty_cache() noexcept {
+        if (ThreadCache* tc = thread_cache()) {
+            for (std::size_t i = 0; i < impl::num_size_classes; i++) {
+                for (void* p: tc->lists[i])
+                    release(p, impl::class_size(i));
+                tc->lists[i].clear();
+            }
+            impl::record_uncached(tc->cached_bytes);
+            tc->cached_bytes = 0;
+        }
+
+        std::lock_guard lock{mutex_};
+        for (std::size_t i = 0; i < impl::num_size_classes; i++) {
+            for (void* p: lists_[i])
+                release(p, impl::class_size(i));
+            lists_[i].clear();
+        }
+        impl::record_uncached(cached_bytes_);
+        cached_bytes_ = 0;
+    }
+
+    // Maximum number of bytes kept in the global cache
+    void set_limit(std::size_t bytes) {
+        std::lock_guard lock{mutex_};
+        limit_ = bytes;
+    }
+
+    std::size_t limit() const {
+        std::lock_guard lock{mutex_};
+        return limit_;
+    }
+
+    // Maximum number of bytes kept in each of the thread caches. Only affects the subsequent deallocations.
+    void set_thread_limit(std::size_t bytes) {
+        thread_limit_.store(bytes, std::memory_order_relaxed);
+    }
+
+    std::size_t thread_limit() const {
+        return thread_limit_.load(std::memory_order_relaxed);
+    }
+
+    // Number of bytes in the global cache
+    std::size_t cached_bytes() const {
+        std::lock_guard lock{mutex_};
+        return cached_bytes_;
+    }
+
+    // Number of bytes in the calling thread's cache
+    std::size_t thread_cached_bytes() const {
+        ThreadCache* tc = thread_cache();
+        return tc ? tc->cached_bytes : 0;
+    }
+
+private:
+    using FreeLists = std::array<std::vector<void*>, impl::num_size_classes>;
+
+    struct ThreadCache {
+        explicit ThreadCache(bool* destroyed) : destroyed{destroyed} {}
+
+        ~ThreadCache() {
+            *destroyed = true;
+
+            auto& global = instance();
+            impl::record_uncached(cached_bytes);
+            for (std::size_t i = 0; i < impl::num_size_classes; i++) {
+                for (void* p: lists[i])
+                    global.release_to_global(p, i);
+            }
+        }
+
+        FreeLists lists{};
+        std::size_t cached_bytes{0};
+        bool* destroyed;
     };
 
-    pointer allocate(size_type n) {
-        return static_cast<pointer>(mkl_malloc(n * sizeof(T), Alignment));
+    BlockCache() = default;
+
+    static ThreadCache* thread_cache() {
+        // The thread cache can be destroyed before the tensors with static or thread storage duration
+        thread_local bool destroyed = false;
+        if (destroyed)
+            return nullptr;
+
+        thread_local ThreadCache cache{&destroyed};
+        return &cache;
+    }
+
+    // The system allocations of the cache, which are counted as reserved bytes
+    static void* reserve(std::size_t bytes) {
+        void* p = impl::aligned_allocate(bytes, alignment);
+        impl::record_reserve(bytes);
+        return p;
+    }
+
+    static void release(void* p, std::size_t bytes) noexcept {
+        impl::aligned_deallocate(p, alignment);
+        impl::record_release(bytes);
+    }
+
+    static bool push(std::vector<void*>& list, void* p) noexcept {
+        try {
+            list.push_back(p);
+            return true;
+        }
+        catch (const std::bad_alloc&) {
+            return false;
+        }
     }
 
-    constexpr void deallocate(pointer p, size_type) {
-        mkl_free(p);
+    void release_to_global(void* p, std::size_t index) noexcept {
+        const std::size_t size = impl::class_size(index);
+        {
+            std::lock_guard lock{mutex_};
+            if (cached_bytes_ + size <= limit_ && push(lists_[index], p)) {
+                cached_bytes_ += size;
+                impl::record_cached(size);
+                return;
+            }
+        }
+
+        release(p, size);
     }
+
+    mutable std::mutex mutex_;
+    FreeLists lists_{};
+    std::size_t cached_bytes_{0};
+    std::size_t limit_{std::size_t{1} << 30};
+    std::atomic<std::size_t> thread_limit_{std::size_t{64} << 20};
 };
 
-#else
+inline void empty_cache() {
+    BlockCache::instance().empty_cache();
+}
+
+// Memory resource interface of the block cache. Alignments larger than the cache's are served by the system.
+class CachingResource : public std::pmr::memory_resource {
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (alignment <= BlockCache::alignment)
+            return BlockCache::instance().allocate(bytes);
+
+        return impl::aligned_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        if (alignment <= BlockCache::alignment)
+            BlockCache::instance().deallocate(p, bytes);
+        else if (p != nullptr)
+            impl::aligned_deallocate(p, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+inline std::pmr::memory_resource* caching_resource() {
+    static CachingResource resource;
+    return &resource;
+}
+
+// Tensors of at least this many bytes are created on zero pages by zeros()
+constexpr std::size_t zero_page_threshold = std::size_t{1} << 20;
+
+// Hands out zero-filled memory. On POSIX systems, it maps anonymous pages which the kernel zeroes lazily on the
+// first touch, so a large zero tensor costs neither a memset nor the page faults of the pages never used.
+class ZeroedResource : public std::pmr::memory_resource {
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+#if defined(__unix__) || defined(__APPLE__)
+        if (alignment <= impl::page_size()) {
+            void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc{};
+            impl::record_reserve(mapped_size(bytes));
+            return p;
+        }
+#endif
+        void* p = impl::aligned_allocate(bytes, alignment);
+        impl::record_reserve(bytes);
+        std::memset(p, 0, bytes);
+        return p;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+#if defined(__unix__) || defined(__APPLE__)
+        if (alignment <= impl::page_size()) {
+            munmap(p, bytes);
+            impl::record_release(mapped_size(bytes));
+            return;
+        }
+#endif
+        impl::aligned_deallocate(p, alignment);
+        impl::record_release(bytes);
+    }
+
+    static std::size_t mapped_size(std::size_t bytes) {
+        return (bytes + impl::page_size() - 1) / impl::page_size() * impl::page_size();
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+inline std::pmr::memory_resource* zeroed_resource() {
+    static ZeroedResource resource;
+    return &resource;
+}
+
+namespace impl {
+inline std::pmr::memory_resource*& current_resource() {
+    thread_local std::pmr::memory_resource* resource = nullptr;
+    return resource;
+}
+}
+
+// The resource used by the default constructed allocators of the calling thread
+inline std::pmr::memory_resource* default_resource() {
+    auto* resource = impl::current_resource();
+    return resource ? resource : caching_resource();
+}
+
+// Routes the tensors created by the calling thread to the given resource until the end of the scope.
+// Usage:
+//     MonotonicArena arena;
+//     {
+//         ScopedResource scope{&arena};
+//         auto tmp = a + b;   // Allocated from the arena
+//     }
+class ScopedResource {
+public:
+    explicit ScopedResource(std::pmr::memory_resource* resource) : previous_{impl::current_resource()} {
+        impl::current_resource() = resource;
+    }
+
+    ScopedResource(const ScopedResource&) = delete;
+    ScopedResource& operator=(const ScopedResource&) = delete;
 
+    ~ScopedResource() {
+        impl::current_resource() = previous_;
+    }
+
+private:
+    std::pmr::memory_resource* previous_;
+};
+
+namespace impl {
+// Scratch memory of the kernels. Always taken from the block cache, regardless of the scoped resource.
+template<typename T>
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+
+    explicit AlignedBuffer(std::size_t n) : size_{n} {
+        data_ = static_cast<T*>(BlockCache::instance().allocate(n * sizeof(T)));
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+            : data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)} {}
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ~AlignedBuffer() {
+        BlockCache::instance().deallocate(data_, size_ * sizeof(T));
+    }
+
+    // Grows the buffer to at least n elements, discarding the contents
+    void reserve(std::size_t n) {
+        if (n > size_)
+            *this = AlignedBuffer(n);
+    }
+
+    T* data() const {
+        return data_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    T* data_{nullptr};
+    std::size_t size_{0};
+};
+}
+
+// Allocates from a polymorphic memory resource. Uses the block cache unless another resource is given.
 template <typename T, size_t Alignment=default_alignment>
-class TensorAllocator : public std::allocator<T> {
+class TensorAllocator {
 public:
     using size_type = size_t;
     using difference_type = ptrdiff_t;
@@ -50,21 +468,54 @@ public:
     using reference = T&;
     using const_reference = const T&;
     using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
 
     template<typename U>
     struct rebind {
         using other = TensorAllocator<U, Alignment> ;
     };
 
+    TensorAllocator() noexcept : resource_{default_resource()} {}
+
+    TensorAllocator(std::pmr::memory_resource* resource) noexcept : resource_{resource} {}
+
+    template<typename U>
+    TensorAllocator(const TensorAllocator<U, Alignment>& other) noexcept : resource_{other.resource()} {}
+
     pointer allocate(size_type n) {
-        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        if (n == 0)
+            return nullptr;
+
+        auto p = static_cast<pointer>(resource_->allocate(n * sizeof(T), Alignment));
+        impl::record_allocation(n * sizeof(T));
+        return p;
     }
 
-    constexpr void deallocate(pointer p, size_type n) {
-        ::operator delete(p, std::align_val_t(std::align_val_t(Alignment)));
+    void deallocate(pointer p, size_type n) {
+        if (p != nullptr) {
+            resource_->deallocate(p, n * sizeof(T), Alignment);
+            impl::record_deallocation(n * sizeof(T));
+        }
     }
-};
 
-#endif
+    // Copies of a tensor do not inherit the resource, they use the default resource of the copying thread
+    TensorAllocator select_on_container_copy_construction() const {
+        return {};
+    }
+
+    std::pmr::memory_resource* resource() const noexcept {
+        return resource_;
+    }
+
+    template<typename U>
+    bool operator==(const TensorAllocator<U, Alignment>& other) const noexcept {
+        return resource_ == other.resource() || resource_->is_equal(*other.resource());
+    }
+
+private:
+    std::pmr::memory_resource* resource_;
+};
 
 }
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "allocator.h"
+
+
+namespace ck {
+
+// A bump allocator for the short-lived tensors. Deallocation is a no-op; the memory is reclaimed all at once
+// by reset() or release(). It is not thread-safe, use one arena per thread or per request.
+// Usage:
+//     MonotonicArena arena;
+//     Tensor<float, 2> scratch{shape, &arena};
+//     ...
+//     arena.reset();   // Invalidates all the tensors allocated from the arena
+class MonotonicArena : public std::pmr::memory_resource {
+public:
+    explicit MonotonicArena(std::size_t initial_size = std::size_t{1} << 20,
+                            std::pmr::memory_resource* upstream = caching_resource())
+            : upstream_{upstream}, next_size_{std::max(initial_size, min_chunk_size)} {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    ~MonotonicArena() override {
+        release();
+    }
+
+    // Rewinds the arena while keeping its memory. If the last cycle needed more than one chunk, they are merged
+    // into a single chunk, so that the steady state is a single pointer bump per allocation.
+    void reset() {
+        if (chunks_.size() > 1) {
+            const std::size_t total = capacity();
+            release();
+            add_chunk(total);
+        }
+
+        if (!chunks_.empty()) {
+            current_ = chunks_.front().data;
+            end_ = current_ + chunks_.front().size;
+        }
+        used_ = 0;
+    }
+
+    // Gives all the memory back to the upstream resource
+    void release() {
+        for (const auto& chunk: chunks_)
+            upstream_->deallocate(chunk.data, chunk.size, chunk_alignment);
+        chunks_.clear();
+        current_ = end_ = nullptr;
+        used_ = 0;
+    }
+
+    // Number of bytes handed out since the last reset, including the alignment padding
+    std::size_t bytes_used() const {
+        return used_;
+    }
+
+    // Number of bytes owned by the arena
+    std::size_t capacity() const {
+        std::size_t total = 0;
+        for (const auto& chunk: chunks_)
+            total += chunk.size;
+        return total;
+    }
+
+    std::pmr::memory_resource* upstream() const {
+        return upstream_;
+    }
+
+private:
+    static constexpr std::size_t min_chunk_size = 4096;
+    static constexpr std::size_t chunk_alignment = default_alignment;
+
+    struct Chunk {
+        std::byte* data;
+        std::size_t size;
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        std::size_t padding = padding_for(current_, alignment);
+        if (current_ == nullptr || padding + bytes > static_cast<std::size_t>(end_ - current_)) {
+            add_chunk(std::max(next_size_, bytes + alignment));
+            padding = padding_for(current_, alignment);
+        }
+
+        auto* p = current_ + padding;
+        used_ += padding + bytes;
+        current_ = p + bytes;
+        return p;
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    static std::size_t padding_for(const std::byte* p, std::size_t alignment) {
+        const auto addr = reinterpret_cast<std::uintptr_t>(p);
+        return (alignment - addr % alignment) % alignment;
+    }
+
+    void add_chunk(std::size_t size) {
+        auto* data = static_cast<std::byte*>(upstream_->allocate(size, chunk_alignment));
+        chunks_.push_back({data, size});
+        current_ = data;
+        end_ = data + size;
+        next_size_ = size * 2;
+    }
+
+    std::pmr::memory_resource* upstream_;
+    std::vector<Chunk> chunks_;
+    std::byte* current_{nullptr};
+    std::byte* end_{nullptr};
+    std::size_t next_size_;
+    std::size_t used_{0};
+};
+
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <utility>
+
+#include "tensor.h"
+
+
+namespace ck {
+
+// Implementation for the broadcasting ops
+class BroadcastError : public std::exception {
+};
+
+namespace impl {
+
+template<std::size_t LHSDim, std::size_t RHSDim>
+auto broadcast_shape(const Shape<LHSDim>& lhs, const Shape<RHSDim>& rhs) {
+    Shape<std::max(LHSDim, RHSDim)> ret;
+
+    std::size_t i = 0;
+    // Scalars have no dimensions to match
+    if constexpr (LHSDim != 0 && RHSDim != 0) {
+        for (; i < std::min(LHSDim, RHSDim); i++) {
+            if (lhs.rat(i) == rhs.rat(i)) {
+                ret.rat(i) = lhs.rat(i);
+            }
+            else if (lhs.rat(i) == 1) {
+                ret.rat(i) = rhs.rat(i);
+            }
+            else if (rhs.rat(i) == 1) {
+                ret.rat(i) = lhs.rat(i);
+            }
+            else {
+                throw BroadcastError{};
+            }
+        }
+    }
+
+    if constexpr (LHSDim > RHSDim) {
+        for (; i < LHSDim; i++) {
+            ret.rat(i) = lhs.rat(i);
+        }
+    }
+    else if constexpr (RHSDim > LHSDim) {
+        for (; i < RHSDim; i++) {
+            ret.rat(i) = rhs.rat(i);
+        }
+    }
+
+    return ret;
+}
+
+
+// The broadcasting engine. A cursor reads the elements of the operands of an expression whose result has OutDims
+// dimensions. A tensor operand has a stride for each dimension of the result, 0 for the broadcast ones, and
+// leaves is the number of tensor operands under a cursor.
+// flat(i) is the i-th element when every tensor has the number of elements of the result. Otherwise seek() moves
+// to an element of the result, and the row from there is read with [j], or with get<Mask, 0>(j) where each bit
+// of Mask tells that a tensor operand is broadcast along the row.
+template<typename T, std::size_t OutDims>
+struct TensorCursor {
+    static constexpr std::size_t leaves = 1;
+
+    const T* data;
+    std::array<std::size_t, OutDims> strides;
+    const T* row;
+
+    void seek(const std::array<std::size_t, OutDims>& index) {
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < OutDims; i++)
+            offset += index[i] * strides[i];
+        row = data + offset;
+    }
+
+    T operator[](std::size_t j) const {
+        return row[j * strides[OutDims - 1]];
+    }
+
+    // The rows of the tensors are contiguous, so that the stride along them is 1 or 0
+    template<std::size_t Mask, std::size_t Offset>
+    T get(std::size_t j) const {
+        if constexpr ((Mask >> Offset & 1) != 0)
+            return *row;
+        else
+            return row[j];
+    }
+
+    T flat(std::size_t i) const {
+        return data[i];
+    }
+
+    // Whether the dimension outer and the group of dimensions ending with inner, of inner_size elements, can be
+    // iterated as one
+    bool mergeable(std::size_t outer, std::size_t inner, std::size_t inner_size) const {
+        return strides[outer] == strides[inner] * inner_size;
+    }
+
+    std::size_t broadcast_mask() const {
+        return strides[OutDims - 1] == 0;
+    }
+};
+
+template<typename T>
+struct ScalarCursor {
+    static constexpr std::size_t leaves = 0;
+
+    T value;
+
+    void seek(const auto&) {}
+
+    T operator[](std::size_t) const {
+        return value;
+    }
+
+    template<std::size_t Mask, std::size_t Offset>
+    T get(std::size_t) const {
+        return value;
+    }
+
+    T flat(std::size_t) const {
+        return value;
+    }
+
+    bool mergeable(std::size_t, std::size_t, std::size_t) const {
+        return true;
+    }
+
+    std::size_t broadcast_mask() const {
+        return 0;
+    }
+};
+
+template<typename Op, typename C>
+struct UnaryCursor {
+    static constexpr std::size_t leaves = C::leaves;
+
+    Op op;
+    C arg;
+
+    void seek(const auto& index) {
+        arg.seek(index);
+    }
+
+    auto operator[](std::size_t j) const {
+        return op(arg[j]);
+    }
+
+    template<std::size_t Mask, std::size_t Offset>
+    auto get(std::size_t j) const {
+        return op(arg.template get<Mask, Offset>(j));
+    }
+
+    auto flat(std::size_t i) const {
+        return op(arg.flat(i));
+    }
+
+    bool mergeable(std::size_t outer, std::size_t inner, std::size_t inner_size) const {
+        return arg.mergeable(outer, inner, inner_size);
+    }
+
+    std::size_t broadcast_mask() const {
+        return arg.broadcast_mask();
+    }
+};
+
+template<typename Op, typename L, typename R>
+struct BinaryCursor {
+    static constexpr std::size_t leaves = L::leaves + R::leaves;
+
+    Op op;
+    L lhs;
+    R rhs;
+
+    void seek(const auto& index) {
+        lhs.seek(index);
+        rhs.seek(index);
+    }
+
+    auto operator[](std::size_t j) const {
+        return op(lhs[j], rhs[j]);
+    }
+
+    template<std::size_t Mask, std::size_t Offset>
+    auto get(std::size_t j) const {
+        return op(lhs.template get<Mask, Offset>(j), rhs.template get<Mask, Offset + L::leaves>(j));
+    }
+
+    auto flat(std::size_t i) const {
+        return op(lhs.flat(i), rhs.flat(i));
+    }
+
+    bool mergeable(std::size_t outer, std::size_t inner, std::size_t inner_size) const {
+        return lhs.mergeable(outer, inner, inner_size) && rhs.mergeable(outer, inner, inner_size);
+    }
+
+    std::size_t broadcast_mask() const {
+        return lhs.broadcast_mask() | rhs.broadcast_mask() << L::leaves;
+    }
+};
+
+// Above this number of tensors, the rows are read with strides rather than with a loop for each combination of
+// broadcast operands
+constexpr std::size_t max_row_specializations = 4;
+constexpr std::size_t strided_rows = ~std::size_t{0};
+
+// The dimensions along which no operand changes from contiguous to broadcast are iterated as one, so that
+// [N, C, H, W] + [C, 1, 1] is N * C rows of H * W elements with a scalar operand. The merged dimensions are left
+// with a single element.
+template<typename C, std::size_t Dims>
+std::array<std::size_t, Dims> collapse_dims(const C& cursor, const Shape<Dims>& shape) {
+    std::array<std::size_t, Dims> collapsed = shape.shape_;
+    std::size_t inner = Dims - 1;
+    for (std::size_t i = Dims - 1; i-- > 0;) {
+        if (collapsed[i] == 1)
+            continue;
+
+        if (cursor.mergeable(i, inner, collapsed[inner])) {
+            collapsed[inner] *= collapsed[i];
+            collapsed[i] = 1;
+        }
+        else {
+            inner = i;
+        }
+    }
+    return collapsed;
+}
+
+// The index of the element i of the shape
+template<std::size_t Dims>
+std::array<std::size_t, Dims> unravel(std::size_t i, const std::array<std::size_t, Dims>& shape) {
+    std::array<std::size_t, Dims> index{};
+    for (std::size_t d = Dims; d-- > 0;) {
+        index[d] = i % shape[d];
+        i /= shape[d];
+    }
+    return index;
+}
+
+// Moves index to the first element of the next row
+template<std::size_t Dims>
+void next_row(std::array<std::size_t, Dims>& index, const std::array<std::size_t, Dims>& shape) {
+    index[Dims - 1] = 0;
+    for (std::size_t i = Dims - 1; i-- > 0;) {
+        if (++index[i] < shape[i])
+            break;
+        index[i] = 0;
+    }
+}
+
+// Calls g(i, cols) with the cursor at the element i of the result for the rows, or the parts of the first and last
+// rows, that make up the elements [begin, end)
+template<typename C, std::size_t Dims, typename G>
+void for_each_row_in(C& cursor, const std::array<std::size_t, Dims>& shape, std::size_t begin, std::size_t end,
+                     G& g) {
+    const std::size_t cols = shape[Dims - 1];
+    auto index = unravel(begin, shape);
+    for (std::size_t i = begin; i < end;) {
+        cursor.seek(index);
+        const std::size_t n = std::min(cols - index[Dims - 1], end - i);
+        g(i, n);
+        i += n;
+        next_row(index, shape);
+    }
+}
+
+template<std::size_t Mask, typename C, std::size_t Dims, typename F>
+void for_each_row_element(C& cursor, const std::array<std::size_t, Dims>& shape, std::size_t begin,
+                          std::size_t end, F& f) {
+    const auto row = [&](std::size_t i, std::size_t cols) {
+        if constexpr (Mask == strided_rows) {
+            for (std::size_t j = 0; j < cols; j++)
+                f(i + j, cursor[j]);
+        }
+        else {
+            for (std::size_t j = 0; j < cols; j++)
+                f(i + j, cursor.template get<Mask, 0>(j));
+        }
+    };
+    for_each_row_in(cursor, shape, begin, end, row);
+}
+
+template<typename C, std::size_t Dims, typename F, std::size_t... Masks>
+void for_each_row_element(std::size_t mask, C& cursor, const std::array<std::size_t, Dims>& shape,
+                          std::size_t begin, std::size_t end, F& f, std::index_sequence<Masks...>) {
+    ((mask == Masks && (for_each_row_element<Masks>(cursor, shape, begin, end, f), true)) || ...);
+}
+
+// Calls f(i, el) for the elements [begin, end) of the expression in row major order, i being the index of el in
+// the result. The ranges of a result can be evaluated by different threads.
+template<typename E, typename F>
+void for_each_element(const E& expr, F f, std::size_t begin, std::size_t end) {
+    constexpr std::size_t dims = E::dims;
+    const Shape<dims>& shape = expr.shape();
+    auto cursor = expr.template cursor<dims>(shape);
+
+    if (expr.flat(shape.num_elem())) {
+        for (std::size_t i = begin; i < end; i++)
+            f(i, cursor.flat(i));
+        return;
+    }
+
+    if (begin >= end)
+        return;
+
+    const auto collapsed = collapse_dims(cursor, shape);
+    using Cursor = decltype(cursor);
+    if constexpr (Cursor::leaves <= max_row_specializations)
+        for_each_row_element(cursor.broadcast_mask(), cursor, collapsed, begin, end, f,
+                             std::make_index_sequence<std::size_t{1} << Cursor::leaves>{});
+    else
+        for_each_row_element<strided_rows>(cursor, collapsed, begin, end, f);
+}
+
+template<typename E, typename F>
+void for_each_element(const E& expr, F f) {
+    for_each_element(expr, std::move(f), 0, expr.shape().num_elem());
+}
+
+// Calls g(i, cursor, cols, mask) for the rows of the elements [begin, end) of the expression, with the cursor at
+// the element i of the result where the row starts, and the broadcast_mask() of the row. An expression that needs
+// no broadcasting is a single row.
+template<typename E, typename G>
+void for_each_row(const E& expr, G g, std::size_t begin, std::size_t end) {
+    constexpr std::size_t dims = E::dims;
+    const Shape<dims>& shape = expr.shape();
+    const std::size_t num_elem = shape.num_elem();
+    auto cursor = expr.template cursor<dims>(shape);
+
+    if (begin >= end)
+        return;
+
+    if (expr.flat(num_elem)) {
+        cursor.seek(unravel(begin, shape.shape_));
+        g(begin, cursor, end - begin, std::size_t{0});
+        return;
+    }
+
+    const auto collapsed = collapse_dims(cursor, shape);
+    const std::size_t mask = cursor.broadcast_mask();
+    const auto row = [&](std::size_t i, std::size_t cols) { g(i, cursor, cols, mask); };
+    for_each_row_in(cursor, collapsed, begin, end, row);
+}
+
+template<typename E, typename G>
+void for_each_row(const E& expr, G g) {
+    for_each_row(expr, std::move(g), 0, expr.shape().num_elem());
+}
+
+}
+
+}
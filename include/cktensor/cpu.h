@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CKTENSOR_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+// Functions compiled for an instruction set that the rest of the binary is not compiled for.
+// They can only be called after checking cpu_features().
+#define CKTENSOR_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define CKTENSOR_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq,fma,f16c")))
+#define CKTENSOR_TARGET_AVX512_BF16 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq,avx512bf16,fma,f16c")))
+#define CKTENSOR_TARGET_AVX512_VNNI __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq,avx512vnni,fma,f16c")))
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// Generic kernel bodies are inlined into the functions above to be compiled for their instruction sets
+#define CKTENSOR_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define CKTENSOR_ALWAYS_INLINE inline
+#endif
+
+
+namespace ck {
+
+struct CpuFeatures {
+    bool avx2{false};
+    bool fma{false};
+    bool f16c{false};
+    bool avx512f{false};
+    bool avx512bw{false};
+    bool avx512vl{false};
+    bool avx512dq{false};
+    bool avx512_vnni{false};
+    bool avx512_bf16{false};
+};
+
+// Instruction sets that the kernels are written for, from the least to the most capable
+enum class Isa {
+    Scalar,
+    AVX2,       // AVX2 + FMA + F16C
+    AVX512      // AVX-512 F/BW/VL/DQ
+};
+
+namespace impl {
+
+inline CpuFeatures detect_cpu_features() {
+    CpuFeatures features;
+
+#ifdef CKTENSOR_X86
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return features;
+
+    const bool osxsave = ecx & (1u << 27);
+    const bool avx = ecx & (1u << 28);
+    if (!osxsave || !avx)
+        return features;
+
+    // The OS has to save the vector registers on context switches
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    const bool ymm_state = (xcr0_lo & 0x6) == 0x6;
+    const bool zmm_state = (xcr0_lo & 0xe6) == 0xe6;
+    if (!ymm_state)
+        return features;
+
+    features.fma = ecx & (1u << 12);
+    features.f16c = ecx & (1u << 29);
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        features.avx2 = ebx & (1u << 5);
+
+        if (zmm_state) {
+            features.avx512f = ebx & (1u << 16);
+            features.avx512dq = ebx & (1u << 17);
+            features.avx512bw = ebx & (1u << 30);
+            features.avx512vl = ebx & (1u << 31);
+            features.avx512_vnni = ecx & (1u << 11);
+
+            if (__get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx))
+                features.avx512_bf16 = eax & (1u << 5);
+        }
+    }
+#endif
+
+    return features;
+}
+
+// The processor brand string, such as "Intel(R) Xeon(R) Gold 6338 CPU @ 2.00GHz", or "unknown"
+inline std::string detect_cpu_model() {
+#ifdef CKTENSOR_X86
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000004) {
+        unsigned brand[12];
+        for (unsigned i = 0; i < 3; i++)
+            __get_cpuid(0x80000002 + i, &brand[4 * i], &brand[4 * i + 1], &brand[4 * i + 2], &brand[4 * i + 3]);
+
+        std::string model(reinterpret_cast<const char*>(brand), sizeof(brand));
+        model.resize(std::strlen(model.c_str()));
+        const auto first = model.find_first_not_of(' ');
+        const auto last = model.find_last_not_of(' ');
+        if (first != std::string::npos)
+            return model.substr(first, last - first + 1);
+    }
+#endif
+
+    return "unknown";
+}
+
+inline Isa detect_isa(const CpuFeatures& features) {
+    if (features.avx512f && features.avx512bw && features.avx512vl && features.avx512dq && features.fma &&
+        features.f16c)
+        return Isa::AVX512;
+
+    if (features.avx2 && features.fma && features.f16c)
+        return Isa::AVX2;
+
+    return Isa::Scalar;
+}
+
+inline const char* isa_name(Isa isa) {
+    if (isa == Isa::AVX512)
+        return "avx512";
+    if (isa == Isa::AVX2)
+        return "avx2";
+    return "scalar";
+}
+
+// The instruction set called name by isa_name(), false if there is none
+inline bool parse_isa(std::string_view name, Isa& isa) {
+    for (Isa candidate: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        if (name == isa_name(candidate)) {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+inline const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = impl::detect_cpu_features();
+    return features;
+}
+
+// The instruction set the kernels use. Can be lowered, but not raised, with the CKTENSOR_ISA environment
+// variable set to "scalar", "avx2" or "avx512".
+inline Isa kernel_isa() {
+    static const Isa isa = [] {
+        const Isa detected = impl::detect_isa(cpu_features());
+
+        const char* env = std::getenv("CKTENSOR_ISA");
+        if (env == nullptr)
+            return detected;
+
+        Isa requested = detected;
+        impl::parse_isa(env, requested);
+        return requested < detected ? requested : detected;
+    }();
+    return isa;
+}
+
+inline const std::string& cpu_model() {
+    static const std::string model = impl::detect_cpu_model();
+    return model;
+}
+
+}
+
+#ifdef CKTENSOR_X86
+
+namespace ck::impl {
+
+// A vector of Bytes / sizeof(T) elements that can be loaded from and stored to unaligned addresses
+template<typename T, std::size_t Bytes>
+struct SimdVec {
+    typedef T type __attribute__((vector_size(Bytes), aligned(alignof(T)), may_alias));
+    static constexpr std::size_t width = Bytes / sizeof(T);
+};
+
+}
+
+#endif
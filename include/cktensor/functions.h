@@ -4,14 +4,42 @@
 
 #include <cmath>
 #include <exception>
+#include <type_traits>
 
 #include "cktensor/tensor.h"
+#include "cktensor/thread_pool.h"
 
 
 namespace ck {
 
 constexpr double pi = M_PI;
 
+// The functions take tensors or the expressions of ops.h, which are evaluated first
+
+namespace impl {
+// Applies f to each element, on several threads for large tensors. Half precision elements are computed in float
+// and rounded back.
+template<typename T, std::size_t Dims, typename F>
+auto map_math(const Tensor<T, Dims>& t, F f) {
+    const auto g = [&](T el) {
+        if constexpr (IsHalf<T>::value)
+            return static_cast<T>(f(static_cast<float>(el)));
+        else
+            return f(el);
+    };
+
+    using R = std::invoke_result_t<decltype(g), T>;
+    auto result = Tensor<R, Dims>::empty(t.shape());
+    const T* src = t.data();
+    R* dst = result.data();
+    parallel_elementwise(t.num_elem(), dst, sizeof(R), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++)
+            dst[i] = g(src[i]);
+    });
+    return result;
+}
+}
+
 template<typename T, std::size_t Dims>
 auto stack(const std::vector<Tensor<T, Dims>>& vals) {
     const auto& el_shape = vals.front().shape();
@@ -26,7 +54,7 @@ auto stack(const std::vector<Tensor<T, Dims>>& vals) {
     ret_shape[0] = vals.size();
     std::copy(el_shape.begin(), el_shape.end(), ret_shape.begin() + 1);
 
-    Tensor<T, Dims + 1ul> ret{ret_shape};
+    auto ret = Tensor<T, Dims + 1ul>::empty(ret_shape);
     auto dest = ret.begin();
 
     for (const auto& val: vals) {
@@ -36,144 +64,144 @@ auto stack(const std::vector<Tensor<T, Dims>>& vals) {
     return ret;
 }
 
-template<typename T, std::size_t Dims>
-auto abs(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::abs(el); });
+template<typename X> requires impl::expression_operand<X>
+auto abs(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::abs(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto sqrt(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::sqrt(el); });
+template<typename X> requires impl::expression_operand<X>
+auto sqrt(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::sqrt(el); });
 }
 
 /* Trigonometric functions */
 
-template<typename T, std::size_t Dims>
-auto sin(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::sin(el); });
+template<typename X> requires impl::expression_operand<X>
+auto sin(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::sin(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto cos(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::cos(el); });
+template<typename X> requires impl::expression_operand<X>
+auto cos(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::cos(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto tan(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::tan(el); });
+template<typename X> requires impl::expression_operand<X>
+auto tan(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::tan(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto asin(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::asin(el); });
+template<typename X> requires impl::expression_operand<X>
+auto asin(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::asin(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto acos(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::acos(el); });
+template<typename X> requires impl::expression_operand<X>
+auto acos(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::acos(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto atan(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::atan(el); });
+template<typename X> requires impl::expression_operand<X>
+auto atan(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::atan(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto atan2(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::atan2(el); });
+template<typename X> requires impl::expression_operand<X>
+auto atan2(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::atan2(el); });
 }
 
 /* Exponential functions */
 
-template<typename T, std::size_t Dims>
-auto exp(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::exp(el); });
+template<typename X> requires impl::expression_operand<X>
+auto exp(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::exp(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto log(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::log(el); });
+template<typename X> requires impl::expression_operand<X>
+auto log(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::log(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto log2(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::log2(el); });
+template<typename X> requires impl::expression_operand<X>
+auto log2(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::log2(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto log10(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::log10(el); });
+template<typename X> requires impl::expression_operand<X>
+auto log10(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::log10(el); });
 }
 
 /* Hyperbolic functions */
 
-template<typename T, std::size_t Dims>
-auto sinh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::sinh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto sinh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::sinh(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto cosh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::cosh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto cosh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::cosh(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto tanh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::tanh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto tanh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::tanh(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto asinh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::asinh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto asinh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::asinh(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto acosh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::acosh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto acosh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::acosh(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto atanh(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::atanh(el); });
+template<typename X> requires impl::expression_operand<X>
+auto atanh(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::atanh(el); });
 }
 
 /* Error and Gamma functions */
 
-template<typename T, std::size_t Dims>
-auto erf(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::erf(el); });
+template<typename X> requires impl::expression_operand<X>
+auto erf(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::erf(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto erfc(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::erfc(el); });
+template<typename X> requires impl::expression_operand<X>
+auto erfc(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::erfc(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto tgamma(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::tgamma(el); });
+template<typename X> requires impl::expression_operand<X>
+auto tgamma(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::tgamma(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto lgamma(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::lgamma(el); });
+template<typename X> requires impl::expression_operand<X>
+auto lgamma(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::lgamma(el); });
 }
 
 /* Nearest integer functions */
 
-template<typename T, std::size_t Dims>
-auto ceil(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::ceil(el); });
+template<typename X> requires impl::expression_operand<X>
+auto ceil(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::ceil(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto floor(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::floor(el); });
+template<typename X> requires impl::expression_operand<X>
+auto floor(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::floor(el); });
 }
 
-template<typename T, std::size_t Dims>
-auto round(const Tensor<T, Dims>& t) {
-    return t.map([](T el){ return std::round(el); });
+template<typename X> requires impl::expression_operand<X>
+auto round(const X& t) {
+    return impl::map_math(impl::evaluated(t), [](auto el){ return std::round(el); });
 }
 
 }
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <complex>
+#include <memory>
+#include <mutex>
+#include <vector>
 
+#include "gemm_blocked.h"
+#include "gemm_strassen.h"
+#include "gemm_tuning.h"
 #include "tensor.h"
 
 #ifdef CKTENSOR_USE_MKL
@@ -22,62 +30,110 @@ template<typename T>
 struct GEMM {
     void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
                     const CBLAS_TRANSPOSE TransB, const int M, const int N,
-                    const int K, const float alpha, const T* A,
+                    const int K, const T alpha, const T* A,
                     const int lda, const T* B, const int ldb,
-                    const T beta, T* C, const int ldc) const {
+                    const T beta, T* C, const int ldc, const GemmOptions& options = {},
+                    const GemmEpilogue<T>* epilogue = nullptr) const {
         assert(Layout == CblasRowMajor && "Only row major matrices are supported.");
 
-        if (beta != T{1}) {
-            for (int i = 0; i < M * N; ++i) {
-                C[i] *= beta;
+        if constexpr (IsStrassenType<T>::value) {
+            if (TransA == CblasNoTrans && TransB == CblasNoTrans && use_strassen(M, N, K, options.strassen_cutoff)) {
+                gemm_strassen(M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, options, [&](auto... args) {
+                    gemm_dispatch<T>(false, false, args..., options);
+                });
+                if (epilogue != nullptr)
+                    apply_epilogue(*epilogue, M, N, C, ldc, 0, 0);
+                return;
             }
         }
 
-        if (TransA == CblasNoTrans && TransB == CblasNoTrans) {
-            // #pragma omp parallel for
-            for (int i = 0; i < M; i++) {
-                for (int k = 0; k < K; k++) {
-                    for (int j = 0; j < N; j++) {
-                        C[ldc * i + j] += alpha * A[lda * i + k] * B[ldb * k + j];
-                    }
-                }
-            }
-        }
-        else if (TransA == CblasTrans && TransB == CblasNoTrans) {
-            // #pragma omp parallel for
-            for (int k = 0; k < K; k++) {
-                for (int i = 0; i < M; i++) {
-                    for (int j = 0; j < N; j++) {
-                        C[ldc * i + j] += alpha * A[lda * k + i] * B[ldb * k + j];
-                    }
-                }
-            }
-        }
-        else if (TransA == CblasNoTrans && TransB == CblasTrans) {
-            // #pragma omp parallel for
-            for (int i = 0; i < M; i++) {
-                for (int j = 0; j < N; j++) {
-                    for (int k = 0; k < K; k++) {
-                        C[ldc * i + j] += alpha * A[lda * i + k] * B[ldb * j + k];
-                    }
-                }
-            }
-        }
-        else {
-            // #pragma omp parallel for
-            for (int i = 0; i < M; i++) {
-                for (int j = 0; j < N; j++) {
-                    for (int k = 0; k < K; k++) {
-                        C[ldc * i + j] += alpha * A[lda * k + i] * B[ldb * j + k];
-                    }
-                }
-            }
-        }
+        gemm_dispatch<T>(TransA == CblasTrans, TransB == CblasTrans, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc,
+                         options, epilogue);
+    }
+};
+
+template<typename T>
+struct GEMMBatchStrided {
+    void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
+                    const CBLAS_TRANSPOSE TransB, const int M, const int N,
+                    const int K, const T alpha, const T* A,
+                    const int lda, const int stridea, const T* B, const int ldb, const int strideb,
+                    const T beta, T* C, const int ldc, const int stridec, const int batch_size,
+                    const GemmOptions& options = {}) const {
+        assert(Layout == CblasRowMajor && "Only row major matrices are supported.");
+
+        gemm_blocked_batch_strided<T>(TransA == CblasTrans, TransB == CblasTrans, M, N, K, alpha, A, lda, stridea,
+                                      B, ldb, strideb, beta, C, ldc, stridec, batch_size, options);
     }
 };
 
+// Products with a B which is packed once at construction. B is a row major k x n matrix.
+template<typename T>
+class PackedGEMM {
+public:
+    PackedGEMM(const T* B, const int K, const int N) : panels_(false, K, N, B, N) {}
+
+    // C = alpha * op(A) * B + beta * C, op(A) is M x K
+    void operator()(const CBLAS_TRANSPOSE TransA, const int M, const T alpha, const T* A, const int lda,
+                    const T beta, T* C, const int ldc, const GemmOptions& options = {},
+                    const GemmEpilogue<T>* epilogue = nullptr) const {
+        gemm_blocked_packed<T>(TransA == CblasTrans, M, alpha, A, lda, panels_, beta, C, ldc, options, epilogue);
+    }
+
+private:
+    PackedPanels<T> panels_;
+};
+
+// Half precision B is packed into float panels, A is converted as it is packed and C accumulated in float
+template<typename H>
+class HalfPackedGEMM {
+public:
+    HalfPackedGEMM(const H* B, const int K, const int N) : panels_(false, K, N, B, N) {}
+
+    void operator()(const CBLAS_TRANSPOSE TransA, const int M, const H alpha, const H* A, const int lda,
+                    const H beta, H* C, const int ldc, const GemmOptions& options = {},
+                    const GemmEpilogue<H>* epilogue = nullptr) const {
+        half_product(M, panels_.cols(), beta, C, ldc, epilogue,
+                     [&](float* c_float, const GemmEpilogue<float>* epilogue_float) {
+            gemm_blocked_packed<float>(TransA == CblasTrans, M, alpha, A, lda, panels_, beta, c_float,
+                                       panels_.cols(), options, epilogue_float);
+        });
+    }
+
+private:
+    PackedPanels<float> panels_;
+};
+
+template<>
+class PackedGEMM<bf16> : public HalfPackedGEMM<bf16> {
+public:
+    using HalfPackedGEMM<bf16>::HalfPackedGEMM;
+};
+
+template<>
+class PackedGEMM<f16> : public HalfPackedGEMM<f16> {
+public:
+    using HalfPackedGEMM<f16>::HalfPackedGEMM;
+};
+
 #ifdef CKTENSOR_USE_MKL
 
+// Limits the MKL threads of the calling thread while it is alive, MKL uses its own pool
+class MklThreadLimit {
+public:
+    explicit MklThreadLimit(const GemmOptions& options)
+            : previous_{options.num_threads > 0 ? mkl_set_num_threads_local(static_cast<int>(options.num_threads))
+                                                : -1} {}
+
+    ~MklThreadLimit() {
+        if (previous_ >= 0)
+            mkl_set_num_threads_local(previous_);
+    }
+
+private:
+    int previous_;
+};
+
 template<>
 struct GEMM<float> {
     template<typename... Args>
@@ -85,8 +141,20 @@ struct GEMM<float> {
                     const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
                     const MKL_INT K, const float alpha, const float *A,
                     const MKL_INT lda, const float *B, const MKL_INT ldb,
-                    const float beta, float *C, const MKL_INT ldc) const noexcept {
-        cblas_sgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+                    const float beta, float *C, const MKL_INT ldc,
+                    const GemmOptions& options = {}, const GemmEpilogue<float>* epilogue = nullptr) const {
+        MklThreadLimit limit{options};
+        if (TransA == CblasNoTrans && TransB == CblasNoTrans && use_strassen(M, N, K, options.strassen_cutoff))
+            gemm_strassen(std::size_t(M), std::size_t(N), std::size_t(K), alpha, A, std::size_t(lda), B,
+                          std::size_t(ldb), beta, C, std::size_t(ldc), options,
+                          [&](auto... args) {
+                cblas_sgemm(Layout, CblasNoTrans, CblasNoTrans, args...);
+            });
+        else
+            cblas_sgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+        // MKL has no fused epilogues, this is one more pass over C
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, M, N, C, ldc, 0, 0);
     }
 };
 
@@ -97,62 +165,210 @@ struct GEMM<double> {
                     const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
                     const MKL_INT K, const double alpha, const double *A,
                     const MKL_INT lda, const double *B, const MKL_INT ldb,
-                    const double beta, double *C, const MKL_INT ldc) const noexcept {
-        cblas_dgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+                    const double beta, double *C, const MKL_INT ldc,
+                    const GemmOptions& options = {}, const GemmEpilogue<double>* epilogue = nullptr) const {
+        MklThreadLimit limit{options};
+        if (TransA == CblasNoTrans && TransB == CblasNoTrans && use_strassen(M, N, K, options.strassen_cutoff))
+            gemm_strassen(std::size_t(M), std::size_t(N), std::size_t(K), alpha, A, std::size_t(lda), B,
+                          std::size_t(ldb), beta, C, std::size_t(ldc), options,
+                          [&](auto... args) {
+                cblas_dgemm(Layout, CblasNoTrans, CblasNoTrans, args...);
+            });
+        else
+            cblas_dgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+        // MKL has no fused epilogues, this is one more pass over C
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, M, N, C, ldc, 0, 0);
     }
 };
 
+// MKL takes complex scalars by pointer
 template<>
 struct GEMM<std::complex<float>> {
-    template<typename... Args>
     void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
                     const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
-                    const MKL_INT K, const void *alpha, const void *A,
-                    const MKL_INT lda, const void *B, const MKL_INT ldb,
-                    const void *beta, void *C, const MKL_INT ldc) const noexcept {
-        cblas_cgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+                    const MKL_INT K, const std::complex<float> alpha, const std::complex<float> *A,
+                    const MKL_INT lda, const std::complex<float> *B, const MKL_INT ldb,
+                    const std::complex<float> beta, std::complex<float> *C, const MKL_INT ldc,
+                    const GemmOptions& options = {},
+                    const GemmEpilogue<std::complex<float>>* epilogue = nullptr) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_cgemm(Layout, TransA, TransB, M, N, K, &alpha, A, lda, B, ldb, &beta, C, ldc);
+        // MKL has no fused epilogues, this is one more pass over C
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, M, N, C, ldc, 0, 0);
     }
 };
 
+// MKL takes complex scalars by pointer
 template<>
 struct GEMM<std::complex<double>> {
-    template<typename... Args>
     void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
                     const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
-                    const MKL_INT K, const void *alpha, const void *A,
-                    const MKL_INT lda, const void *B, const MKL_INT ldb,
-                    const void *beta, void *C, const MKL_INT ldc) const noexcept {
-        cblas_zgemm(Layout, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+                    const MKL_INT K, const std::complex<double> alpha, const std::complex<double> *A,
+                    const MKL_INT lda, const std::complex<double> *B, const MKL_INT ldb,
+                    const std::complex<double> beta, std::complex<double> *C, const MKL_INT ldc,
+                    const GemmOptions& options = {},
+                    const GemmEpilogue<std::complex<double>>* epilogue = nullptr) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_zgemm(Layout, TransA, TransB, M, N, K, &alpha, A, lda, B, ldb, &beta, C, ldc);
+        // MKL has no fused epilogues, this is one more pass over C
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, M, N, C, ldc, 0, 0);
     }
 };
 
-#endif // CKTENSOR_USE_MKL
+template<>
+struct GEMMBatchStrided<float> {
+    void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
+                    const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
+                    const MKL_INT K, const float alpha, const float *A,
+                    const MKL_INT lda, const MKL_INT stridea, const float *B, const MKL_INT ldb,
+                    const MKL_INT strideb, const float beta, float *C, const MKL_INT ldc, const MKL_INT stridec,
+                    const MKL_INT batch_size, const GemmOptions& options = {}) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_sgemm_batch_strided(Layout, TransA, TransB, M, N, K, alpha, A, lda, stridea, B, ldb, strideb, beta,
+                                  C, ldc, stridec, batch_size);
+    }
+};
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-struct MatMul {};
+template<>
+struct GEMMBatchStrided<double> {
+    void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
+                    const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
+                    const MKL_INT K, const double alpha, const double *A,
+                    const MKL_INT lda, const MKL_INT stridea, const double *B, const MKL_INT ldb,
+                    const MKL_INT strideb, const double beta, double *C, const MKL_INT ldc, const MKL_INT stridec,
+                    const MKL_INT batch_size, const GemmOptions& options = {}) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_dgemm_batch_strided(Layout, TransA, TransB, M, N, K, alpha, A, lda, stridea, B, ldb, strideb, beta,
+                                  C, ldc, stridec, batch_size);
+    }
+};
 
+template<>
+struct GEMMBatchStrided<std::complex<float>> {
+    void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
+                    const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
+                    const MKL_INT K, const std::complex<float> alpha, const std::complex<float> *A,
+                    const MKL_INT lda, const MKL_INT stridea, const std::complex<float> *B, const MKL_INT ldb,
+                    const MKL_INT strideb, const std::complex<float> beta, std::complex<float> *C,
+                    const MKL_INT ldc, const MKL_INT stridec, const MKL_INT batch_size,
+                    const GemmOptions& options = {}) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_cgemm_batch_strided(Layout, TransA, TransB, M, N, K, &alpha, A, lda, stridea, B, ldb, strideb, &beta,
+                                  C, ldc, stridec, batch_size);
+    }
+};
 
-template<typename T, typename U>
-struct MatMul<T, 2, U, 2> {
-    auto operator()(const Tensor<T, 2>& lhs, const Tensor<U, 2>& rhs) const {
-        assert(lhs.shape().rat(0) == rhs.shape().at(0) && "Incompatible shapes");
+template<>
+struct GEMMBatchStrided<std::complex<double>> {
+    void operator()(const CBLAS_LAYOUT Layout, const CBLAS_TRANSPOSE TransA,
+                    const CBLAS_TRANSPOSE TransB, const MKL_INT M, const MKL_INT N,
+                    const MKL_INT K, const std::complex<double> alpha, const std::complex<double> *A,
+                    const MKL_INT lda, const MKL_INT stridea, const std::complex<double> *B, const MKL_INT ldb,
+                    const MKL_INT strideb, const std::complex<double> beta, std::complex<double> *C,
+                    const MKL_INT ldc, const MKL_INT stridec, const MKL_INT batch_size,
+                    const GemmOptions& options = {}) const noexcept {
+        MklThreadLimit limit{options};
+        cblas_zgemm_batch_strided(Layout, TransA, TransB, M, N, K, &alpha, A, lda, stridea, B, ldb, strideb, &beta,
+                                  C, ldc, stridec, batch_size);
+    }
+};
 
-        using RetType = decltype(std::declval<T>() * std::declval<U>());
+// MKL packs B for a given number of rows of A, so a packed copy is made for each M the matrix is used with. The
+// packed copies of the last few M are kept, the least recently used one is dropped for a new M. B itself is kept
+// only in the unpacked form these copies are packed from, which also serves the products with alpha other than
+// one, since MKL scales B while packing.
+template<typename T>
+class MklPackedGEMM {
+public:
+    // Number of packed copies kept at a time
+    static constexpr std::size_t max_packed = 4;
 
-        if constexpr (!(std::is_same_v<T, RetType> && std::is_same_v<U, RetType>)) {
-            return MatMul<RetType, 2, RetType, 2>{}(lhs, rhs);
+    MklPackedGEMM(const T* B, const MKL_INT K, const MKL_INT N) : b_(B, B + std::size_t(K) * N), k_{K}, n_{N} {}
+
+    void operator()(const CBLAS_TRANSPOSE TransA, const MKL_INT M, const T alpha, const T* A, const MKL_INT lda,
+                    const T beta, T* C, const MKL_INT ldc, const GemmOptions& options = {},
+                    const GemmEpilogue<T>* epilogue = nullptr) const {
+        MklThreadLimit limit{options};
+
+        if (alpha != T{1}) {
+            GEMM<T>{}(CblasRowMajor, TransA, CblasNoTrans, M, n_, k_, alpha, A, lda, b_.data(), n_, beta, C, ldc,
+                      {}, epilogue);
+            return;
         }
-        else {
-            auto ret = zeros<RetType, 2>({lhs.shape()[0], rhs.shape()[1]});
 
-            GEMM<RetType>{}(CblasRowMajor, CblasNoTrans, CblasNoTrans, lhs.shape_at(0), rhs.shape_at(1),
-                            lhs.shape_at(1),
-                            1.0, lhs.data(), lhs.shape_at(1), rhs.data(), rhs.shape_at(1), 0.0, ret.data(),
-                            ret.shape_at(1));
+        // Held until the product is done, even if another thread drops it from the cache meanwhile
+        const auto b = packed(M);
+        if constexpr (std::is_same_v<T, float>)
+            cblas_sgemm_compute(CblasRowMajor, TransA, CblasPacked, M, n_, k_, A, lda, b.get(), n_, beta, C, ldc);
+        else
+            cblas_dgemm_compute(CblasRowMajor, TransA, CblasPacked, M, n_, k_, A, lda, b.get(), n_, beta, C, ldc);
+
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, M, n_, C, ldc, 0, 0);
+    }
+
+private:
+    struct Packed {
+        MKL_INT m;
+        std::shared_ptr<const T> data;
+    };
 
-            return ret;
+    std::shared_ptr<const T> packed(const MKL_INT M) const {
+        std::lock_guard lock{mutex_};
+
+        // Most recently used first
+        const auto it = std::find_if(packed_.begin(), packed_.end(), [M](const Packed& p) { return p.m == M; });
+        if (it != packed_.end()) {
+            std::rotate(packed_.begin(), it, it + 1);
+            return packed_.front().data;
+        }
+
+        std::shared_ptr<T> buffer;
+        if constexpr (std::is_same_v<T, float>) {
+            const std::size_t bytes = cblas_sgemm_pack_get_size(CblasBMatrix, M, n_, k_);
+            buffer.reset(static_cast<T*>(mkl_malloc(bytes, default_alignment)), mkl_free);
+            if (!buffer)
+                throw std::bad_alloc{};
+            cblas_sgemm_pack(CblasRowMajor, CblasBMatrix, CblasNoTrans, M, n_, k_, 1.0f, b_.data(), n_,
+                             buffer.get());
+        }
+        else {
+            const std::size_t bytes = cblas_dgemm_pack_get_size(CblasBMatrix, M, n_, k_);
+            buffer.reset(static_cast<T*>(mkl_malloc(bytes, default_alignment)), mkl_free);
+            if (!buffer)
+                throw std::bad_alloc{};
+            cblas_dgemm_pack(CblasRowMajor, CblasBMatrix, CblasNoTrans, M, n_, k_, 1.0, b_.data(), n_,
+                             buffer.get());
         }
+
+        if (packed_.size() == max_packed)
+            packed_.pop_back();
+        packed_.insert(packed_.begin(), Packed{M, buffer});
+        return buffer;
     }
+
+    std::vector<T> b_;
+    MKL_INT k_;
+    MKL_INT n_;
+    mutable std::mutex mutex_;
+    mutable std::vector<Packed> packed_;
+};
+
+template<>
+class PackedGEMM<float> : public MklPackedGEMM<float> {
+public:
+    using MklPackedGEMM<float>::MklPackedGEMM;
 };
 
+template<>
+class PackedGEMM<double> : public MklPackedGEMM<double> {
+public:
+    using MklPackedGEMM<double>::MklPackedGEMM;
+};
+
+#endif // CKTENSOR_USE_MKL
+
 }
@@ -0,0 +1,849 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+
+#include "allocator.h"
+#include "cpu.h"
+#include "gemm_simd.h"
+#include "gemm_small.h"
+#include "half.h"
+#include "thread_pool.h"
+#include "traits.h"
+
+
+// Cache-blocked GEMM in the style of BLIS (Van Zee & van de Geijn). For C = alpha * op(A) * op(B) + beta * C,
+//   - op(B) is split into kc x nc blocks which are packed into nr wide column panels (fits into L3),
+//   - op(A) is split into mc x kc blocks which are packed into mr high row panels (fits into L2),
+//   - a micro-kernel multiplies an mr x kc panel of A with a kc x nr panel of B (fits into L1) and keeps
+//     the mr x nr tile of C in registers.
+// Packing makes the micro-kernel read both operands contiguously, whichever transpose they are given in.
+// An epilogue is applied to each tile of C right after its last rank-kc update, while the tile is still in L1.
+// With several threads, each block of op(B) is packed cooperatively and then the mc x nr-panel macro-tiles of C
+// are shared out, every thread packing its own blocks of op(A).
+
+namespace ck {
+
+struct GemmOptions {
+    // Upper limit of the threads a call uses, zero means every thread of the pool. Small products run on the
+    // calling thread whatever the limit is.
+    std::size_t num_threads{0};
+    // The pool the threads come from, default_thread_pool() if null
+    ThreadPool* pool{nullptr};
+    // Single floating point products with no transposes and every dimension at least this large use
+    // Strassen-Winograd recursion, see gemm_strassen.h. It does fewer multiplications but has larger rounding
+    // errors, zero disables it.
+    std::size_t strassen_cutoff{0};
+    // Where its workspace of at most strassen_workspace_bytes() comes from, caching_resource() if null
+    std::pmr::memory_resource* strassen_workspace{nullptr};
+};
+
+enum class Activation {
+    None,
+    ReLU,
+    Tanh,
+    Sigmoid,
+    GELU    // Tanh approximation
+};
+
+}
+
+namespace ck::impl {
+
+// C = scale * activation(C + bias) + residual, applied after the product. Bias is either per row (m values) or
+// per column (n values), and the residual is an m x n matrix with the leading dimension ldr. Null pointers are
+// skipped. Complex types support everything but the activations.
+template<typename T>
+struct GemmEpilogue {
+    const T* bias{nullptr};
+    bool bias_per_row{false};
+    Activation activation{Activation::None};
+    T scale{1};
+    const T* residual{nullptr};
+    std::size_t ldr{0};
+};
+
+template<typename T, Activation Act>
+T activate(T x) {
+    if constexpr (Act == Activation::ReLU)
+        return x > T{0} ? x : T{0};
+    else if constexpr (Act == Activation::Tanh)
+        return static_cast<T>(std::tanh(x));
+    else if constexpr (Act == Activation::Sigmoid)
+        return static_cast<T>(1 / (1 + std::exp(-x)));
+    else if constexpr (Act == Activation::GELU)
+        return static_cast<T>(0.5 * x * (1 + std::tanh(0.7978845608028654 * (x + 0.044715 * x * x * x))));
+    else
+        return x;
+}
+
+template<typename T, Activation Act>
+void apply_epilogue(const GemmEpilogue<T>& epilogue, std::size_t m, std::size_t n, T* c, std::size_t ldc,
+                    std::size_t row0, std::size_t col0) {
+    const T* col_bias = epilogue.bias != nullptr && !epilogue.bias_per_row ? epilogue.bias + col0 : nullptr;
+    const T scale = epilogue.scale;
+
+    for (std::size_t i = 0; i < m; i++) {
+        T* row = c + i * ldc;
+        const T row_bias = epilogue.bias != nullptr && epilogue.bias_per_row ? epilogue.bias[row0 + i] : T{0};
+        const T* residual = epilogue.residual != nullptr ? epilogue.residual + (row0 + i) * epilogue.ldr + col0
+                                                         : nullptr;
+
+        for (std::size_t j = 0; j < n; j++) {
+            T val = row[j] + row_bias;
+            if (col_bias != nullptr)
+                val += col_bias[j];
+            val = scale * activate<T, Act>(val);
+            if (residual != nullptr)
+                val += residual[j];
+            row[j] = val;
+        }
+    }
+}
+
+// Applies the epilogue to the m x n block of C at (row0, col0) of the whole product
+template<typename T>
+void apply_epilogue(const GemmEpilogue<T>& epilogue, std::size_t m, std::size_t n, T* c, std::size_t ldc,
+                    std::size_t row0, std::size_t col0) {
+    if constexpr (IsComplex<T>::value) {
+        assert(epilogue.activation == Activation::None && "Activations are not defined for complex numbers");
+        apply_epilogue<T, Activation::None>(epilogue, m, n, c, ldc, row0, col0);
+    }
+    else {
+        switch (epilogue.activation) {
+            case Activation::None:
+                return apply_epilogue<T, Activation::None>(epilogue, m, n, c, ldc, row0, col0);
+            case Activation::ReLU:
+                return apply_epilogue<T, Activation::ReLU>(epilogue, m, n, c, ldc, row0, col0);
+            case Activation::Tanh:
+                return apply_epilogue<T, Activation::Tanh>(epilogue, m, n, c, ldc, row0, col0);
+            case Activation::Sigmoid:
+                return apply_epilogue<T, Activation::Sigmoid>(epilogue, m, n, c, ldc, row0, col0);
+            case Activation::GELU:
+                return apply_epilogue<T, Activation::GELU>(epilogue, m, n, c, ldc, row0, col0);
+        }
+    }
+}
+
+// Below this many multiply-adds a product runs on a single thread, and each additional thread needs this
+// much more work
+constexpr std::size_t gemm_min_parallel_work = 128 * 128 * 128;
+constexpr std::size_t gemm_work_per_thread = 64 * 64 * 64;
+// The same for the elements of the matrix of a GEMV
+constexpr std::size_t gemv_min_parallel_work = 1 << 18;
+constexpr std::size_t gemv_work_per_thread = 1 << 16;
+// Products up to this many multiply-adds use plain loops
+constexpr std::size_t tiny_gemm_max_work = 8 * 8 * 8;
+
+struct GemmBlocking {
+    std::size_t mc;
+    std::size_t kc;
+    std::size_t nc;
+};
+
+// C[0:mr, 0:nr] = alpha * A_panel * B_panel + beta * C, C is not read if beta is zero.
+template<typename T>
+struct MicroKernel {
+    using Fn = void (*)(std::size_t kc, const T* a, const T* b, T* c, std::size_t ldc, T alpha, T beta);
+
+    std::size_t mr;
+    std::size_t nr;
+    Fn fn;
+    const char* name;
+};
+
+template<typename T, std::size_t MR, std::size_t NR>
+void scalar_micro_kernel(std::size_t kc, const T* a, const T* b, T* c, std::size_t ldc, T alpha, T beta) {
+    T acc[MR][NR] = {};
+
+    for (std::size_t k = 0; k < kc; k++) {
+        for (std::size_t i = 0; i < MR; i++) {
+            for (std::size_t j = 0; j < NR; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+
+    if (beta == T{0}) {
+        for (std::size_t i = 0; i < MR; i++) {
+            for (std::size_t j = 0; j < NR; j++) {
+                c[i * ldc + j] = alpha * acc[i][j];
+            }
+        }
+    }
+    else {
+        for (std::size_t i = 0; i < MR; i++) {
+            for (std::size_t j = 0; j < NR; j++) {
+                c[i * ldc + j] = alpha * acc[i][j] + beta * c[i * ldc + j];
+            }
+        }
+    }
+}
+
+// Complex products with the real and imaginary parts accumulated separately, which avoids the inf and NaN
+// recovery of std::complex multiplication in the inner loop, as BLAS does
+template<typename R, std::size_t MR, std::size_t NR>
+void scalar_complex_micro_kernel(std::size_t kc, const std::complex<R>* a, const std::complex<R>* b,
+                                 std::complex<R>* c, std::size_t ldc, std::complex<R> alpha, std::complex<R> beta) {
+    R acc_re[MR][NR] = {};
+    R acc_im[MR][NR] = {};
+
+    for (std::size_t k = 0; k < kc; k++) {
+        for (std::size_t i = 0; i < MR; i++) {
+            const R are = a[i].real();
+            const R aim = a[i].imag();
+            for (std::size_t j = 0; j < NR; j++) {
+                acc_re[i][j] += are * b[j].real() - aim * b[j].imag();
+                acc_im[i][j] += are * b[j].imag() + aim * b[j].real();
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+
+    for (std::size_t i = 0; i < MR; i++) {
+        for (std::size_t j = 0; j < NR; j++) {
+            const std::complex<R> prod{acc_re[i][j], acc_im[i][j]};
+            std::complex<R>& dst = c[i * ldc + j];
+            dst = beta == std::complex<R>{0} ? alpha * prod : alpha * prod + beta * dst;
+        }
+    }
+}
+
+// The micro-kernels and the blocking for each instruction set
+template<typename T>
+struct GemmKernels {
+    static MicroKernel<T> kernel(Isa) {
+        return {4, 4, scalar_micro_kernel<T, 4, 4>, "scalar"};
+    }
+
+    static GemmBlocking blocking(Isa) {
+        return {96, 256, 4096};
+    }
+};
+
+template<>
+struct GemmKernels<float> {
+    static MicroKernel<float> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {12, 32, avx512_micro_kernel_f32, "avx512"};
+        if (isa == Isa::AVX2)
+            return {6, 16, avx2_micro_kernel_f32, "avx2"};
+#endif
+        (void) isa;
+        return {4, 8, scalar_micro_kernel<float, 4, 8>, "scalar"};
+    }
+
+    static GemmBlocking blocking(Isa isa) {
+        if (isa == Isa::AVX512)
+            return {144, 384, 4096};
+        if (isa == Isa::AVX2)
+            return {144, 256, 4096};
+        return {128, 256, 4096};
+    }
+};
+
+template<>
+struct GemmKernels<double> {
+    static MicroKernel<double> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {12, 16, avx512_micro_kernel_f64, "avx512"};
+        if (isa == Isa::AVX2)
+            return {6, 8, avx2_micro_kernel_f64, "avx2"};
+#endif
+        (void) isa;
+        return {4, 4, scalar_micro_kernel<double, 4, 4>, "scalar"};
+    }
+
+    static GemmBlocking blocking(Isa isa) {
+        if (isa == Isa::AVX512)
+            return {96, 256, 4096};
+        if (isa == Isa::AVX2)
+            return {72, 256, 4096};
+        return {96, 256, 4096};
+    }
+};
+
+template<>
+struct GemmKernels<std::complex<float>> {
+    static MicroKernel<std::complex<float>> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {6, 16, avx512_micro_kernel_c64, "avx512"};
+        if (isa == Isa::AVX2)
+            return {3, 8, avx2_micro_kernel_c64, "avx2"};
+#endif
+        (void) isa;
+        return {4, 4, scalar_complex_micro_kernel<float, 4, 4>, "scalar"};
+    }
+
+    static GemmBlocking blocking(Isa isa) {
+        if (isa == Isa::AVX512)
+            return {96, 256, 4096};
+        if (isa == Isa::AVX2)
+            return {72, 256, 4096};
+        return {96, 256, 4096};
+    }
+};
+
+template<>
+struct GemmKernels<std::complex<double>> {
+    static MicroKernel<std::complex<double>> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {6, 8, avx512_micro_kernel_c128, "avx512"};
+        if (isa == Isa::AVX2)
+            return {3, 4, avx2_micro_kernel_c128, "avx2"};
+#endif
+        (void) isa;
+        return {4, 4, scalar_complex_micro_kernel<double, 4, 4>, "scalar"};
+    }
+
+    // Twice the size of a double, so half the depth
+    static GemmBlocking blocking(Isa isa) {
+        if (isa == Isa::AVX512)
+            return {96, 128, 2048};
+        if (isa == Isa::AVX2)
+            return {72, 128, 2048};
+        return {96, 128, 2048};
+    }
+};
+
+// The instruction set and the blocking of the GEMM of T on this machine, defined in gemm_tuning.h
+template<typename T>
+std::pair<Isa, GemmBlocking> default_gemm_tuning();
+
+// The kernel and the blocking of the GEMM when none are given, chosen at the first use
+template<typename T>
+struct DefaultGemmConfig {
+    static MicroKernel<T> kernel() {
+        return config().kernel;
+    }
+
+    static GemmBlocking blocking() {
+        return config().blocking;
+    }
+
+private:
+    struct Config {
+        MicroKernel<T> kernel;
+        GemmBlocking blocking;
+    };
+
+    static const Config& config() {
+        static const Config config = [] {
+            const auto [isa, blocking] = default_gemm_tuning<T>();
+            return Config{GemmKernels<T>::kernel(isa), blocking};
+        }();
+        return config;
+    }
+};
+
+// Packs the mc x kc block of op(A) starting at a into row panels of height mr, zero padding the last one:
+// ap[panel][k][r] = op(A)[panel * mr + r][k]
+// A may be stored in another type, such as a half precision one, and is converted while it is packed.
+template<typename T, typename S>
+void pack_a(bool trans, std::size_t mc, std::size_t kc, const S* a, std::size_t lda, T* ap, std::size_t mr) {
+    for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+        const std::size_t m = std::min(mr, mc - i0);
+
+        if (!trans) {
+            for (std::size_t k = 0; k < kc; k++) {
+                for (std::size_t r = 0; r < m; r++)
+                    ap[k * mr + r] = static_cast<T>(a[(i0 + r) * lda + k]);
+                for (std::size_t r = m; r < mr; r++)
+                    ap[k * mr + r] = T{0};
+            }
+        }
+        else {
+            for (std::size_t k = 0; k < kc; k++) {
+                convert_n(a + k * lda + i0, m, ap + k * mr);
+                for (std::size_t r = m; r < mr; r++)
+                    ap[k * mr + r] = T{0};
+            }
+        }
+
+        ap += mr * kc;
+    }
+}
+
+// Packs the kc x nc block of op(B) starting at b into column panels of width nr, zero padding the last one:
+// bp[panel][k][c] = op(B)[k][panel * nr + c]
+// B is converted like A in pack_a().
+template<typename T, typename S>
+void pack_b(bool trans, std::size_t kc, std::size_t nc, const S* b, std::size_t ldb, T* bp, std::size_t nr) {
+    for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+        const std::size_t n = std::min(nr, nc - j0);
+
+        if (!trans) {
+            for (std::size_t k = 0; k < kc; k++) {
+                convert_n(b + k * ldb + j0, n, bp + k * nr);
+                for (std::size_t c = n; c < nr; c++)
+                    bp[k * nr + c] = T{0};
+            }
+        }
+        else {
+            for (std::size_t k = 0; k < kc; k++) {
+                for (std::size_t c = 0; c < n; c++)
+                    bp[k * nr + c] = static_cast<T>(b[(j0 + c) * ldb + k]);
+                for (std::size_t c = n; c < nr; c++)
+                    bp[k * nr + c] = T{0};
+            }
+        }
+
+        bp += nr * kc;
+    }
+}
+
+// C = beta * C, C is not read if beta is zero
+template<typename T>
+void scale_c(std::size_t m, std::size_t n, T beta, T* c, std::size_t ldc) {
+    if (beta == T{1})
+        return;
+
+    for (std::size_t i = 0; i < m; i++) {
+        T* row = c + i * ldc;
+        if (beta == T{0})
+            std::fill(row, row + n, T{0});
+        else
+            for (std::size_t j = 0; j < n; j++)
+                row[j] *= beta;
+    }
+}
+
+// Multiplies the packed mc x kc block of A with the packed kc x nc block of B into C. The epilogue, if any, is
+// applied to each tile, C being the block at (row0, col0) of the whole product.
+template<typename T>
+void macro_kernel(std::size_t mc, std::size_t nc, std::size_t kc, const T* ap, const T* bp, T* c, std::size_t ldc,
+                  T alpha, T beta, const MicroKernel<T>& kernel, const GemmEpilogue<T>* epilogue = nullptr,
+                  std::size_t row0 = 0, std::size_t col0 = 0) {
+    const std::size_t mr = kernel.mr;
+    const std::size_t nr = kernel.nr;
+
+    // Edge tiles are computed into a full tile and then merged
+    T tile[16 * 32];
+    assert(mr * nr <= 16 * 32 && "Micro tile is too large");
+
+    for (std::size_t jr = 0; jr < nc; jr += nr) {
+        const std::size_t n = std::min(nr, nc - jr);
+        const T* b_panel = bp + jr * kc;
+
+        for (std::size_t ir = 0; ir < mc; ir += mr) {
+            const std::size_t m = std::min(mr, mc - ir);
+            const T* a_panel = ap + ir * kc;
+            T* c_tile = c + ir * ldc + jr;
+
+            if (m == mr && n == nr) {
+                kernel.fn(kc, a_panel, b_panel, c_tile, ldc, alpha, beta);
+            }
+            else {
+                kernel.fn(kc, a_panel, b_panel, tile, nr, alpha, T{0});
+
+                for (std::size_t i = 0; i < m; i++) {
+                    for (std::size_t j = 0; j < n; j++) {
+                        T& dst = c_tile[i * ldc + j];
+                        dst = beta == T{0} ? tile[i * nr + j] : tile[i * nr + j] + beta * dst;
+                    }
+                }
+            }
+
+            if (epilogue != nullptr)
+                apply_epilogue(*epilogue, m, n, c_tile, ldc, row0 + ir, col0 + jr);
+        }
+    }
+}
+
+// The number of threads worth using for an m x n x k product
+inline std::size_t gemm_num_threads(std::size_t m, std::size_t n, std::size_t k, std::size_t available) {
+    const std::size_t work = m * n * k;
+    if (available <= 1 || work < gemm_min_parallel_work)
+        return 1;
+    return std::min(available, work / gemm_work_per_thread);
+}
+
+inline ThreadPool& gemm_pool(const GemmOptions& options) {
+    return options.pool != nullptr ? *options.pool : default_thread_pool();
+}
+
+// The threads a call may use. Calls from inside a parallel loop are already sharing the threads out.
+inline std::size_t gemm_available_threads(const GemmOptions& options) {
+    if (ThreadPool::in_parallel_region())
+        return 1;
+
+    const std::size_t pool_threads = gemm_pool(options).num_threads();
+    return options.num_threads == 0 ? pool_threads : std::min(options.num_threads, pool_threads);
+}
+
+// The block sizes rounded to multiples of the micro tile
+inline GemmBlocking tile_blocking(const GemmBlocking& blocking, std::size_t mr, std::size_t nr) {
+    return {std::max(mr, blocking.mc / mr * mr), std::max<std::size_t>(1, blocking.kc),
+            std::max(nr, blocking.nc / nr * nr)};
+}
+
+// The loops around the macro-kernel. pack_block(jc, pc, nc_cur, kc_cur) returns the kc_cur x nc_cur block of op(B)
+// at (pc, jc) packed into panels.
+template<typename T, typename TA, typename PackB>
+void gemm_blocked_loops(bool trans_a, std::size_t m, std::size_t n, std::size_t k, T alpha, const TA* a,
+                        std::size_t lda, PackB&& pack_block, T beta, T* c, std::size_t ldc,
+                        const MicroKernel<T>& kernel, const GemmBlocking& blocks, ThreadPool& pool,
+                        std::size_t threads, const GemmEpilogue<T>* epilogue) {
+    const std::size_t mr = kernel.mr;
+    const std::size_t nr = kernel.nr;
+    const std::size_t mc = blocks.mc;
+    const std::size_t kc = blocks.kc;
+    const std::size_t nc = blocks.nc;
+    const std::size_t m_blocks = (m + mc - 1) / mc;
+
+    for (std::size_t jc = 0; jc < n; jc += nc) {
+        const std::size_t nc_cur = std::min(nc, n - jc);
+        const std::size_t n_panels = (nc_cur + nr - 1) / nr;
+        // When there are fewer row blocks than threads, the column panels are split as well
+        const std::size_t n_groups = std::min(n_panels, (threads + m_blocks - 1) / m_blocks);
+
+        for (std::size_t pc = 0; pc < k; pc += kc) {
+            const std::size_t kc_cur = std::min(kc, k - pc);
+            // Only the first rank-kc update scales C, and only the last one applies the epilogue
+            const T beta_cur = pc == 0 ? beta : T{1};
+            const GemmEpilogue<T>* epilogue_cur = pc + kc_cur == k ? epilogue : nullptr;
+            const T* bp = pack_block(jc, pc, nc_cur, kc_cur);
+
+            pool.parallel_for(m_blocks * n_groups, [&](std::size_t task) {
+                const std::size_t ic = task / n_groups * mc;
+                const std::size_t group = task % n_groups;
+                const std::size_t mc_cur = std::min(mc, m - ic);
+                const std::size_t j0 = group * n_panels / n_groups * nr;
+                const std::size_t j1 = std::min(nc_cur, (group + 1) * n_panels / n_groups * nr);
+
+                thread_local AlignedBuffer<T> a_buffer;
+                a_buffer.reserve(mc * kc);
+
+                pack_a(trans_a, mc_cur, kc_cur, a + op_offset(trans_a, ic, pc, lda), lda, a_buffer.data(), mr);
+                macro_kernel(mc_cur, j1 - j0, kc_cur, a_buffer.data(), bp + j0 * kc_cur, c + ic * ldc + jc + j0, ldc,
+                             alpha, beta_cur, kernel, epilogue_cur, ic, jc + j0);
+            }, threads);
+        }
+    }
+}
+
+// C = alpha * op(A) * op(B) + beta * C for the row major matrices, op(A) is m x k and op(B) is k x n. A and B
+// may be stored in other types than T, they are converted to T while they are packed.
+template<typename T, typename TA = T, typename TB = T>
+void gemm_blocked(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, T alpha,
+                  const TA* a, std::size_t lda, const TB* b, std::size_t ldb, T beta, T* c, std::size_t ldc,
+                  const MicroKernel<T>& kernel = DefaultGemmConfig<T>::kernel(),
+                  const GemmBlocking& blocking = DefaultGemmConfig<T>::blocking(),
+                  const GemmOptions& options = {}, const GemmEpilogue<T>* epilogue = nullptr) {
+    if (m == 0 || n == 0)
+        return;
+
+    if (k == 0 || alpha == T{0}) {
+        scale_c(m, n, beta, c, ldc);
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, m, n, c, ldc, 0, 0);
+        return;
+    }
+
+    const std::size_t nr = kernel.nr;
+    const GemmBlocking blocks = tile_blocking(blocking, kernel.mr, nr);
+
+    ThreadPool& pool = gemm_pool(options);
+    const std::size_t threads = gemm_num_threads(m, n, k, gemm_available_threads(options));
+
+    thread_local AlignedBuffer<T> b_buffer;
+    b_buffer.reserve(std::min(blocks.nc, (n + nr - 1) / nr * nr) * blocks.kc);
+    T* bp = b_buffer.data();
+
+    const auto pack_block = [&](std::size_t jc, std::size_t pc, std::size_t nc_cur, std::size_t kc_cur) {
+        const TB* b_block = b + op_offset(trans_b, pc, jc, ldb);
+        const std::size_t n_panels = (nc_cur + nr - 1) / nr;
+        const std::size_t pack_tasks = std::min(threads, n_panels);
+
+        pool.parallel_for(pack_tasks, [&](std::size_t task) {
+            const std::size_t j0 = task * n_panels / pack_tasks * nr;
+            const std::size_t j1 = std::min(nc_cur, (task + 1) * n_panels / pack_tasks * nr);
+            pack_b(trans_b, kc_cur, j1 - j0, b_block + op_offset(trans_b, 0, j0, ldb), ldb, bp + j0 * kc_cur, nr);
+        }, threads);
+
+        return static_cast<const T*>(bp);
+    };
+
+    gemm_blocked_loops(trans_a, m, n, k, alpha, a, lda, pack_block, beta, c, ldc, kernel, blocks, pool, threads,
+                       epilogue);
+}
+
+// y = alpha * op(A) * x + beta * y for the rows x cols matrix A, with the elements of x and y inc_x and inc_y
+// apart. Large matrices are split into blocks of rows, or of columns if transposed, for the threads.
+template<typename T>
+void gemv(bool trans, std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda, const T* x,
+          std::size_t inc_x, T beta, T* y, std::size_t inc_y, const GemmOptions& options = {}) {
+    const GemvKernel<T>& kernel = default_gemv_kernel<T>();
+    const std::size_t x_size = trans ? rows : cols;
+    const std::size_t y_size = trans ? cols : rows;
+
+    // The kernels take contiguous vectors
+    thread_local AlignedBuffer<T> x_buffer;
+    thread_local AlignedBuffer<T> y_buffer;
+    if (inc_x != 1) {
+        x_buffer.reserve(x_size);
+        for (std::size_t i = 0; i < x_size; i++)
+            x_buffer.data()[i] = x[i * inc_x];
+        x = x_buffer.data();
+    }
+
+    T* y_out = y;
+    if (inc_y != 1) {
+        y_buffer.reserve(y_size);
+        if (beta != T{0})
+            for (std::size_t i = 0; i < y_size; i++)
+                y_buffer.data()[i] = y[i * inc_y];
+        y = y_buffer.data();
+    }
+
+    const std::size_t work = rows * cols;
+    const std::size_t available = gemm_available_threads(options);
+    const std::size_t threads = available <= 1 || work < gemv_min_parallel_work
+                                ? 1 : std::min({available, work / gemv_work_per_thread, y_size});
+
+    if (threads <= 1) {
+        (trans ? kernel.t : kernel.n)(rows, cols, alpha, a, lda, x, beta, y);
+    }
+    else {
+        gemm_pool(options).parallel_for(threads, [&](std::size_t task) {
+            const std::size_t i0 = task * y_size / threads;
+            const std::size_t i1 = (task + 1) * y_size / threads;
+            if (trans)
+                kernel.t(rows, i1 - i0, alpha, a + i0, lda, x, beta, y + i0);
+            else
+                kernel.n(i1 - i0, cols, alpha, a + i0 * lda, lda, x, beta, y + i0);
+        }, threads);
+    }
+
+    if (inc_y != 1)
+        for (std::size_t i = 0; i < y_size; i++)
+            y_out[i * inc_y] = y[i];
+}
+
+// Computes a product into the m x n half precision C in float: product(c_float, epilogue_float) runs on a float
+// copy of C, holding C if beta is not zero, with the epilogue converted to float. The copy is rounded into C at
+// the end.
+template<typename H, typename Product>
+void half_product(std::size_t m, std::size_t n, H beta, H* c, std::size_t ldc, const GemmEpilogue<H>* epilogue,
+                  Product&& product) {
+    if (m == 0 || n == 0)
+        return;
+
+    AlignedBuffer<float> c_buffer{m * n};
+    float* c_float = c_buffer.data();
+    if (static_cast<float>(beta) != 0.0f)
+        for (std::size_t i = 0; i < m; i++)
+            convert_n(c + i * ldc, n, c_float + i * n);
+
+    GemmEpilogue<float> epilogue_float;
+    AlignedBuffer<float> bias;
+    AlignedBuffer<float> residual;
+    if (epilogue != nullptr) {
+        epilogue_float.bias_per_row = epilogue->bias_per_row;
+        epilogue_float.activation = epilogue->activation;
+        epilogue_float.scale = epilogue->scale;
+
+        if (epilogue->bias != nullptr) {
+            const std::size_t size = epilogue->bias_per_row ? m : n;
+            bias.reserve(size);
+            convert_n(epilogue->bias, size, bias.data());
+            epilogue_float.bias = bias.data();
+        }
+
+        if (epilogue->residual != nullptr) {
+            residual.reserve(m * n);
+            for (std::size_t i = 0; i < m; i++)
+                convert_n(epilogue->residual + i * epilogue->ldr, n, residual.data() + i * n);
+            epilogue_float.residual = residual.data();
+            epilogue_float.ldr = n;
+        }
+    }
+
+    product(c_float, epilogue != nullptr ? &epilogue_float : nullptr);
+
+    for (std::size_t i = 0; i < m; i++)
+        convert_n(c_float + i * n, n, c + i * ldc);
+}
+
+// C = alpha * op(A) * op(B) + beta * C for half precision matrices. The blocked float GEMM converts A and B
+// while packing them.
+template<typename H>
+void gemm_half(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, H alpha, const H* a,
+               std::size_t lda, const H* b, std::size_t ldb, H beta, H* c, std::size_t ldc,
+               const GemmOptions& options = {}, const GemmEpilogue<H>* epilogue = nullptr) {
+    half_product(m, n, beta, c, ldc, epilogue, [&](float* c_float, const GemmEpilogue<float>* epilogue_float) {
+        gemm_blocked<float>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c_float, n,
+                            DefaultGemmConfig<float>::kernel(), DefaultGemmConfig<float>::blocking(), options,
+                            epilogue_float);
+    });
+}
+
+// C = alpha * op(A) * op(B) + beta * C with the kernel that suits the shape: GEMV for a single row or column of
+// C, the unrolled kernels for small square matrices, plain loops for other tiny products and the blocked GEMM for
+// the rest. Half precision matrices always go to the blocked GEMM in float.
+template<typename T>
+void gemm_dispatch(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, T alpha,
+                   const T* a, std::size_t lda, const T* b, std::size_t ldb, T beta, T* c, std::size_t ldc,
+                   const GemmOptions& options = {}, const GemmEpilogue<T>* epilogue = nullptr) {
+    if constexpr (IsHalf<T>::value) {
+        gemm_half<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, options, epilogue);
+    }
+    else {
+        if (m == 0 || n == 0 || k == 0 || alpha == T{0}) {
+            gemm_blocked<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                            DefaultGemmConfig<T>::kernel(), DefaultGemmConfig<T>::blocking(), options, epilogue);
+            return;
+        }
+
+        const SmallGemmFn<T> small = m == n && n == k ? small_gemm_kernel<T>(m) : nullptr;
+
+        if (small != nullptr) {
+            small(trans_a, trans_b, alpha, a, lda, b, ldb, beta, c, ldc);
+        }
+        else if (m == 1) {
+            // The row of C is op(B)^T times the row of op(A)
+            gemv(!trans_b, trans_b ? n : k, trans_b ? k : n, alpha, b, ldb, a, trans_a ? lda : 1, beta, c, 1,
+                 options);
+        }
+        else if (n == 1) {
+            // The column of C is op(A) times the column of op(B)
+            gemv(trans_a, trans_a ? k : m, trans_a ? m : k, alpha, a, lda, b, trans_b ? 1 : ldb, beta, c, ldc,
+                 options);
+        }
+        else if (m * n * k <= tiny_gemm_max_work) {
+            tiny_gemm(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+        }
+        else {
+            gemm_blocked<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                            DefaultGemmConfig<T>::kernel(), DefaultGemmConfig<T>::blocking(), options, epilogue);
+            return;
+        }
+
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, m, n, c, ldc, 0, 0);
+    }
+}
+
+// op(B) packed once into the panels of a micro-kernel, for products with the same B. The kc x nc blocks are
+// stored one after another, going down each column of blocks first.
+template<typename T>
+class PackedPanels {
+public:
+    PackedPanels() = default;
+
+    template<typename S>
+    PackedPanels(bool trans, std::size_t k, std::size_t n, const S* b, std::size_t ldb,
+                 const MicroKernel<T>& kernel = DefaultGemmConfig<T>::kernel(),
+                 const GemmBlocking& blocking = DefaultGemmConfig<T>::blocking())
+            : k_{k}, n_{n}, kernel_{kernel}, blocks_{tile_blocking(blocking, kernel.mr, kernel.nr)} {
+        const std::size_t nr = kernel.nr;
+        data_.reserve((n + nr - 1) / nr * nr * k);
+
+        for (std::size_t jc = 0; jc < n; jc += blocks_.nc) {
+            const std::size_t nc_cur = std::min(blocks_.nc, n - jc);
+            for (std::size_t pc = 0; pc < k; pc += blocks_.kc) {
+                const std::size_t kc_cur = std::min(blocks_.kc, k - pc);
+                pack_b(trans, kc_cur, nc_cur, b + op_offset(trans, pc, jc, ldb), ldb, block(jc, pc, nc_cur), nr);
+            }
+        }
+    }
+
+    // The block at (pc, jc) which is nc_cur columns wide
+    T* block(std::size_t jc, std::size_t pc, std::size_t nc_cur) const {
+        const std::size_t nr = kernel_.nr;
+        return data_.data() + jc * k_ + pc * ((nc_cur + nr - 1) / nr * nr);
+    }
+
+    std::size_t rows() const {
+        return k_;
+    }
+
+    std::size_t cols() const {
+        return n_;
+    }
+
+    const MicroKernel<T>& kernel() const {
+        return kernel_;
+    }
+
+    const GemmBlocking& blocking() const {
+        return blocks_;
+    }
+
+private:
+    std::size_t k_{0};
+    std::size_t n_{0};
+    MicroKernel<T> kernel_{};
+    GemmBlocking blocks_{};
+    AlignedBuffer<T> data_;
+};
+
+// C = alpha * op(A) * B + beta * C with the pre-packed B, op(A) is m x b.rows()
+template<typename T, typename TA = T>
+void gemm_blocked_packed(bool trans_a, std::size_t m, T alpha, const TA* a, std::size_t lda, const PackedPanels<T>& b,
+                         T beta, T* c, std::size_t ldc, const GemmOptions& options = {},
+                         const GemmEpilogue<T>* epilogue = nullptr) {
+    const std::size_t n = b.cols();
+    const std::size_t k = b.rows();
+    if (m == 0 || n == 0)
+        return;
+
+    if (k == 0 || alpha == T{0}) {
+        scale_c(m, n, beta, c, ldc);
+        if (epilogue != nullptr)
+            apply_epilogue(*epilogue, m, n, c, ldc, 0, 0);
+        return;
+    }
+
+    const auto pack_block = [&](std::size_t jc, std::size_t pc, std::size_t nc_cur, std::size_t) {
+        return static_cast<const T*>(b.block(jc, pc, nc_cur));
+    };
+
+    const std::size_t threads = gemm_num_threads(m, n, k, gemm_available_threads(options));
+    gemm_blocked_loops(trans_a, m, n, k, alpha, a, lda, pack_block, beta, c, ldc, b.kernel(), b.blocking(),
+                       gemm_pool(options), threads, epilogue);
+}
+
+// C_i = alpha * op(A_i) * op(B_i) + beta * C_i for i in [0, batch), where X_i starts at x + i * stride_x.
+// A zero stride repeats the same matrix for every product.
+template<typename T>
+void gemm_blocked_batch_strided(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, T alpha,
+                                const T* a, std::size_t lda, std::size_t stride_a,
+                                const T* b, std::size_t ldb, std::size_t stride_b, T beta,
+                                T* c, std::size_t ldc, std::size_t stride_c, std::size_t batch,
+                                const GemmOptions& options = {}) {
+    const std::size_t available = gemm_available_threads(options);
+    const std::size_t per_product = gemm_num_threads(m, n, k, available);
+
+    // A few large products are threaded one by one, many small ones are shared out whole
+    if (batch == 1 || (batch < available && per_product > 1)) {
+        for (std::size_t i = 0; i < batch; i++)
+            gemm_dispatch<T>(trans_a, trans_b, m, n, k, alpha, a + i * stride_a, lda, b + i * stride_b, ldb, beta,
+                             c + i * stride_c, ldc, options);
+        return;
+    }
+
+    const std::size_t threads = std::min(batch, gemm_num_threads(batch * m, n, k, available));
+    const GemmOptions single_thread{1, options.pool};
+    gemm_pool(options).parallel_for(batch, [&](std::size_t i) {
+        gemm_dispatch<T>(trans_a, trans_b, m, n, k, alpha, a + i * stride_a, lda, b + i * stride_b, ldb, beta,
+                         c + i * stride_c, ldc, single_thread);
+    }, threads);
+}
+
+}
+
+// Defines default_gemm_tuning(), so that the default configuration links with this header alone
+#include "gemm_tuning.h"
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "allocator.h"
+#include "cpu.h"
+#include "gemm_blocked.h"
+#include "thread_pool.h"
+#include "traits.h"
+
+
+// GEMM of 8-bit integer matrices with 32-bit sums, for quantized inference. It is blocked like the float GEMM,
+// but the packed panels hold groups of consecutive k values, and one instruction multiplies a group and adds it
+// to a 32-bit lane:
+//   - AVX-512 VNNI: vpdpbusd, groups of 4 unsigned bytes of A times 4 signed bytes of B,
+//   - AVX-512 BW and AVX2: the values widened to 16 bits, vpmaddwd on groups of 2,
+//   - scalar: the 16-bit layout.
+// vpmaddubsw is not used, as its 16-bit sums saturate for full range weights.
+// vpdpbusd needs an unsigned A and a signed B, so a signed A is shifted by +128 and an unsigned B by -128 while
+// packing. The zero points are shifted with them, which leaves every (a - za) * (b - zb) unchanged:
+//     sum_k (a - za)(b - zb) = sum_k a b - za sum_k b - zb sum_k a + k za zb
+// The corrections are applied with the conversion to the output type, to each tile after its last rank-kc update.
+
+namespace ck::impl {
+
+template<typename T>
+using IsInt8 = IsOneOf<T, std::int8_t, std::uint8_t>;
+
+// The shifts to an unsigned A and a signed B
+template<typename T>
+constexpr std::int32_t int8_shift_a = std::is_signed_v<T> ? 128 : 0;
+
+template<typename T>
+constexpr std::int32_t int8_shift_b = std::is_signed_v<T> ? 0 : -128;
+
+// C[0:mr, 0:nr] = A_panel * B_panel over the given number of k groups, or C += with accumulate
+struct Int8MicroKernel {
+    using Fn = void (*)(std::size_t groups, const void* a, const void* b, std::int32_t* c, std::size_t ldc,
+                        bool accumulate);
+
+    std::size_t mr;
+    std::size_t nr;
+    // The k values of a group, 4 bytes or 2 16-bit values
+    std::size_t k_group;
+    Fn fn;
+    const char* name;
+
+    std::size_t value_size() const {
+        return k_group == 4 ? 1 : 2;
+    }
+};
+
+template<std::size_t MR, std::size_t NR>
+void scalar_int8_micro_kernel(std::size_t groups, const void* a_panel, const void* b_panel, std::int32_t* c,
+                              std::size_t ldc, bool accumulate) {
+    const auto* a = static_cast<const std::int16_t*>(a_panel);
+    const auto* b = static_cast<const std::int16_t*>(b_panel);
+    std::int32_t acc[MR][NR] = {};
+
+    for (std::size_t g = 0; g < groups; g++) {
+        for (std::size_t i = 0; i < MR; i++) {
+            for (std::size_t j = 0; j < NR; j++) {
+                acc[i][j] += a[2 * i] * b[2 * j] + a[2 * i + 1] * b[2 * j + 1];
+            }
+        }
+        a += 2 * MR;
+        b += 2 * NR;
+    }
+
+    for (std::size_t i = 0; i < MR; i++) {
+        for (std::size_t j = 0; j < NR; j++) {
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+#ifdef CKTENSOR_X86
+
+// Both values of a group of A, for broadcasting
+inline std::int32_t load_group(const void* p) {
+    std::int32_t group;
+    std::memcpy(&group, p, sizeof(group));
+    return group;
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_int8_micro_kernel(std::size_t groups, const void* a_panel, const void* b_panel, std::int32_t* c,
+                                   std::size_t ldc, bool accumulate) {
+    constexpr std::size_t MR = 6;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 8;
+
+    const auto* a = static_cast<const std::int16_t*>(a_panel);
+    const auto* b = static_cast<const std::int16_t*>(b_panel);
+
+    __m256i acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm256_setzero_si256();
+
+    for (std::size_t g = 0; g < groups; g++) {
+        __m256i bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * v * W));
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m256i av = _mm256_set1_epi32(load_group(a + 2 * i));
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm256_add_epi32(acc[i][v], _mm256_madd_epi16(av, bv[v]));
+        }
+
+        a += 2 * MR;
+        b += 2 * NV * W;
+    }
+
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            auto* dst = reinterpret_cast<__m256i*>(c + i * ldc + v * W);
+            __m256i res = acc[i][v];
+            if (accumulate)
+                res = _mm256_add_epi32(res, _mm256_loadu_si256(dst));
+            _mm256_storeu_si256(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_int8_micro_kernel(std::size_t groups, const void* a_panel, const void* b_panel, std::int32_t* c,
+                                     std::size_t ldc, bool accumulate) {
+    constexpr std::size_t MR = 12;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 16;
+
+    const auto* a = static_cast<const std::int16_t*>(a_panel);
+    const auto* b = static_cast<const std::int16_t*>(b_panel);
+
+    __m512i acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm512_setzero_si512();
+
+    for (std::size_t g = 0; g < groups; g++) {
+        __m512i bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_si512(b + 2 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512i av = _mm512_set1_epi32(load_group(a + 2 * i));
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm512_add_epi32(acc[i][v], _mm512_madd_epi16(av, bv[v]));
+        }
+
+        a += 2 * MR;
+        b += 2 * NV * W;
+    }
+
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            std::int32_t* dst = c + i * ldc + v * W;
+            __m512i res = acc[i][v];
+            if (accumulate)
+                res = _mm512_add_epi32(res, _mm512_loadu_si512(dst));
+            _mm512_storeu_si512(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512_VNNI
+inline void avx512_vnni_int8_micro_kernel(std::size_t groups, const void* a_panel, const void* b_panel,
+                                          std::int32_t* c, std::size_t ldc, bool accumulate) {
+    constexpr std::size_t MR = 12;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 16;
+
+    const auto* a = static_cast<const std::uint8_t*>(a_panel);
+    const auto* b = static_cast<const std::int8_t*>(b_panel);
+
+    __m512i acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm512_setzero_si512();
+
+    for (std::size_t g = 0; g < groups; g++) {
+        __m512i bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_si512(b + 4 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512i av = _mm512_set1_epi32(load_group(a + 4 * i));
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm512_dpbusd_epi32(acc[i][v], av, bv[v]);
+        }
+
+        a += 4 * MR;
+        b += 4 * NV * W;
+    }
+
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            std::int32_t* dst = c + i * ldc + v * W;
+            __m512i res = acc[i][v];
+            if (accumulate)
+                res = _mm512_add_epi32(res, _mm512_loadu_si512(dst));
+            _mm512_storeu_si512(dst, res);
+        }
+    }
+}
+
+#endif // CKTENSOR_X86
+
+// The micro-kernels and the blocking for each instruction set. vnni selects vpdpbusd for AVX-512.
+struct Int8GemmKernels {
+    static Int8MicroKernel kernel(Isa isa, bool vnni) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512 && vnni)
+            return {12, 32, 4, avx512_vnni_int8_micro_kernel, "avx512-vnni"};
+        if (isa == Isa::AVX512)
+            return {12, 32, 2, avx512_int8_micro_kernel, "avx512"};
+        if (isa == Isa::AVX2)
+            return {6, 16, 2, avx2_int8_micro_kernel, "avx2"};
+#endif
+        (void) isa;
+        (void) vnni;
+        return {4, 8, 2, scalar_int8_micro_kernel<4, 8>, "scalar"};
+    }
+
+    // kc is in k values, sized for the same bytes per panel whatever the packed values are
+    static GemmBlocking blocking(const Int8MicroKernel& kernel) {
+        return {144, 1024 / kernel.value_size() / 2, 4096};
+    }
+};
+
+inline const Int8MicroKernel& default_int8_kernel() {
+    static const Int8MicroKernel kernel = Int8GemmKernels::kernel(kernel_isa(), cpu_features().avx512_vnni);
+    return kernel;
+}
+
+// Packs the mc x kc block of A starting at a into row panels of height mr, shifted to unsigned values and zero
+// padded to whole panels and groups: ap[panel][k / G][r][k % G] = A[panel * mr + r][k]
+template<typename P, std::size_t G, typename T>
+void pack_a_int8(std::size_t mc, std::size_t kc, const T* a, std::size_t lda, P* ap, std::size_t mr) {
+    const std::size_t groups = (kc + G - 1) / G;
+
+    for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+        const std::size_t m = std::min(mr, mc - i0);
+
+        for (std::size_t g = 0; g < groups; g++) {
+            const std::size_t k0 = g * G;
+            const std::size_t kn = std::min(G, kc - k0);
+            P* dst = ap + g * mr * G;
+
+            for (std::size_t r = 0; r < m; r++) {
+                const T* src = a + (i0 + r) * lda + k0;
+                for (std::size_t l = 0; l < kn; l++)
+                    dst[r * G + l] = static_cast<P>(src[l] + int8_shift_a<T>);
+                for (std::size_t l = kn; l < G; l++)
+                    dst[r * G + l] = P{0};
+            }
+            std::fill(dst + m * G, dst + mr * G, P{0});
+        }
+
+        ap += groups * mr * G;
+    }
+}
+
+// Packs the kc x nc block of B starting at b into column panels of width nr, shifted to signed values and zero
+// padded to whole panels and groups: bp[panel][k / G][c][k % G] = B[k][panel * nr + c]
+template<typename P, std::size_t G, typename T>
+void pack_b_int8(std::size_t kc, std::size_t nc, const T* b, std::size_t ldb, P* bp, std::size_t nr) {
+    const std::size_t groups = (kc + G - 1) / G;
+
+    for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+        const std::size_t n = std::min(nr, nc - j0);
+
+        for (std::size_t g = 0; g < groups; g++) {
+            const std::size_t k0 = g * G;
+            const std::size_t kn = std::min(G, kc - k0);
+            P* dst = bp + g * nr * G;
+
+            for (std::size_t l = 0; l < kn; l++) {
+                const T* src = b + (k0 + l) * ldb + j0;
+                for (std::size_t c = 0; c < n; c++)
+                    dst[c * G + l] = static_cast<P>(src[c] + int8_shift_b<T>);
+                for (std::size_t c = n; c < nr; c++)
+                    dst[c * G + l] = P{0};
+            }
+            for (std::size_t l = kn; l < G; l++)
+                for (std::size_t c = 0; c < nr; c++)
+                    dst[c * G + l] = P{0};
+        }
+
+        bp += groups * nr * G;
+    }
+}
+
+// The packing of the kernel, into panels of bytes or of 16-bit values
+template<typename T>
+void pack_a_int8(const Int8MicroKernel& kernel, std::size_t mc, std::size_t kc, const T* a, std::size_t lda,
+                 void* ap) {
+    if (kernel.k_group == 4)
+        pack_a_int8<std::uint8_t, 4>(mc, kc, a, lda, static_cast<std::uint8_t*>(ap), kernel.mr);
+    else
+        pack_a_int8<std::int16_t, 2>(mc, kc, a, lda, static_cast<std::int16_t*>(ap), kernel.mr);
+}
+
+template<typename T>
+void pack_b_int8(const Int8MicroKernel& kernel, std::size_t kc, std::size_t nc, const T* b, std::size_t ldb,
+                 void* bp) {
+    if (kernel.k_group == 4)
+        pack_b_int8<std::int8_t, 4>(kc, nc, b, ldb, static_cast<std::int8_t*>(bp), kernel.nr);
+    else
+        pack_b_int8<std::int16_t, 2>(kc, nc, b, ldb, static_cast<std::int16_t*>(bp), kernel.nr);
+}
+
+// What happens to the 32-bit sums of an int8 product. With Out = std::int32_t they are corrected for the zero
+// points and stored. With float they are then scaled to real values, and with 8-bit types also requantized:
+//     out = activation(scale[j] * (sum_k (a - za)(b - zb[j])) + bias[j]),  real valued
+//     q = clamp(round(out / out_scale) + out_zero_point)
+template<typename Out>
+struct Int8Epilogue {
+    std::int32_t a_zero_point{0};
+    // One per column, zero if null
+    const std::int32_t* b_zero_points{nullptr};
+    // One per column, the product of the scales of A and B. Needed for every output but std::int32_t.
+    const float* scales{nullptr};
+    const float* bias{nullptr};
+    Activation activation{Activation::None};
+    float out_scale{1};
+    std::int32_t out_zero_point{0};
+};
+
+// The zero points of the shifted operands and the sums they are multiplied with, null if the other zero point is
+// zero
+struct Int8Correction {
+    std::int32_t k;
+    std::int32_t a_zero_point;
+    const std::int32_t* b_zero_points;
+    const std::int32_t* a_row_sums;
+    const std::int32_t* b_col_sums;
+};
+
+template<typename Out, Activation Act>
+void apply_int8_epilogue(const Int8Epilogue<Out>& epilogue, const Int8Correction& correction, std::size_t m,
+                         std::size_t n, const std::int32_t* acc, std::size_t ld_acc, Out* c, std::size_t ldc,
+                         std::size_t row0, std::size_t col0) {
+    const std::int32_t za = correction.a_zero_point;
+    const std::int32_t* zb = correction.b_zero_points + col0;
+    const std::int32_t* col_sums = correction.b_col_sums != nullptr ? correction.b_col_sums + col0 : nullptr;
+    [[maybe_unused]] const float inv_out_scale = 1.0f / epilogue.out_scale;
+
+    for (std::size_t i = 0; i < m; i++) {
+        const std::int32_t row_sum = correction.a_row_sums != nullptr ? correction.a_row_sums[row0 + i] : 0;
+
+        for (std::size_t j = 0; j < n; j++) {
+            std::int32_t sum = acc[i * ld_acc + j] - zb[j] * row_sum + correction.k * za * zb[j];
+            if (col_sums != nullptr)
+                sum -= za * col_sums[j];
+
+            if constexpr (std::is_same_v<Out, std::int32_t>) {
+                c[i * ldc + j] = sum;
+            }
+            else {
+                float val = epilogue.scales[col0 + j] * static_cast<float>(sum);
+                if (epilogue.bias != nullptr)
+                    val += epilogue.bias[col0 + j];
+                val = activate<float, Act>(val);
+
+                if constexpr (std::is_same_v<Out, float>) {
+                    c[i * ldc + j] = val;
+                }
+                else {
+                    const long q = std::lrint(val * inv_out_scale) + epilogue.out_zero_point;
+                    c[i * ldc + j] = static_cast<Out>(std::clamp<long>(q, std::numeric_limits<Out>::min(),
+                                                                       std::numeric_limits<Out>::max()));
+                }
+            }
+        }
+    }
+}
+
+// Converts the m x n sums at (row0, col0) of the whole product into C
+template<typename Out>
+void apply_int8_epilogue(const Int8Epilogue<Out>& epilogue, const Int8Correction& correction, std::size_t m,
+                         std::size_t n, const std::int32_t* acc, std::size_t ld_acc, Out* c, std::size_t ldc,
+                         std::size_t row0, std::size_t col0) {
+    switch (epilogue.activation) {
+        case Activation::None:
+            return apply_int8_epilogue<Out, Activation::None>(epilogue, correction, m, n, acc, ld_acc, c, ldc, row0,
+                                                              col0);
+        case Activation::ReLU:
+            return apply_int8_epilogue<Out, Activation::ReLU>(epilogue, correction, m, n, acc, ld_acc, c, ldc, row0,
+                                                              col0);
+        case Activation::Tanh:
+            return apply_int8_epilogue<Out, Activation::Tanh>(epilogue, correction, m, n, acc, ld_acc, c, ldc, row0,
+                                                              col0);
+        case Activation::Sigmoid:
+            return apply_int8_epilogue<Out, Activation::Sigmoid>(epilogue, correction, m, n, acc, ld_acc, c, ldc,
+                                                                 row0, col0);
+        case Activation::GELU:
+            return apply_int8_epilogue<Out, Activation::GELU>(epilogue, correction, m, n, acc, ld_acc, c, ldc, row0,
+                                                              col0);
+    }
+}
+
+// Multiplies the packed mc x kc block of A with the packed kc x nc block of B into the sums. The last rank-kc
+// update passes the epilogue, which converts each tile into C, both being the block at (row0, col0).
+template<typename Out>
+void macro_kernel_int8(std::size_t mc, std::size_t nc, std::size_t kc, const std::byte* ap, const std::byte* bp,
+                       std::int32_t* acc, std::size_t ld_acc, bool accumulate, const Int8MicroKernel& kernel,
+                       const Int8Epilogue<Out>* epilogue, const Int8Correction& correction, Out* c, std::size_t ldc,
+                       std::size_t row0, std::size_t col0) {
+    const std::size_t mr = kernel.mr;
+    const std::size_t nr = kernel.nr;
+    const std::size_t groups = (kc + kernel.k_group - 1) / kernel.k_group;
+    const std::size_t panel_stride = groups * kernel.k_group * kernel.value_size();
+
+    // Edge tiles are computed into a full tile and then merged
+    std::int32_t tile[16 * 32];
+    assert(mr * nr <= 16 * 32 && "Micro tile is too large");
+
+    for (std::size_t jr = 0; jr < nc; jr += nr) {
+        const std::size_t n = std::min(nr, nc - jr);
+        const std::byte* b_panel = bp + jr * panel_stride;
+
+        for (std::size_t ir = 0; ir < mc; ir += mr) {
+            const std::size_t m = std::min(mr, mc - ir);
+            const std::byte* a_panel = ap + ir * panel_stride;
+            std::int32_t* acc_tile = acc + ir * ld_acc + jr;
+
+            if (m == mr && n == nr) {
+                kernel.fn(groups, a_panel, b_panel, acc_tile, ld_acc, accumulate);
+            }
+            else {
+                kernel.fn(groups, a_panel, b_panel, tile, nr, false);
+
+                for (std::size_t i = 0; i < m; i++) {
+                    for (std::size_t j = 0; j < n; j++) {
+                        std::int32_t& dst = acc_tile[i * ld_acc + j];
+                        dst = accumulate ? dst + tile[i * nr + j] : tile[i * nr + j];
+                    }
+                }
+            }
+
+            if (epilogue != nullptr)
+                apply_int8_epilogue(*epilogue, correction, m, n, acc_tile, ld_acc, c + ir * ldc + jr, ldc,
+                                    row0 + ir, col0 + jr);
+        }
+    }
+}
+
+// C = epilogue(A * B) for the row major m x k matrix A and k x n matrix B of 8-bit integers. The sums are
+// accumulated in C itself for 32-bit outputs, and in a temporary matrix for the others.
+template<typename A, typename B, typename Out>
+void gemm_int8(std::size_t m, std::size_t n, std::size_t k, const A* a, std::size_t lda, const B* b,
+               std::size_t ldb, Out* c, std::size_t ldc, const Int8Epilogue<Out>& epilogue = {},
+               const GemmOptions& options = {}, const Int8MicroKernel& kernel = default_int8_kernel()) {
+    static_assert(IsInt8<A>::value && IsInt8<B>::value, "Only 8-bit integer operands are supported");
+    static_assert(IsOneOf<Out, std::int32_t, float, std::int8_t, std::uint8_t>::value, "Unsupported output type");
+    assert((std::is_same_v<Out, std::int32_t> || epilogue.scales != nullptr) && "The output needs the scales");
+
+    if (m == 0 || n == 0)
+        return;
+
+    AlignedBuffer<std::int32_t> b_zero_points{n};
+    bool b_zero = true;
+    for (std::size_t j = 0; j < n; j++) {
+        const std::int32_t zb = (epilogue.b_zero_points != nullptr ? epilogue.b_zero_points[j] : 0) +
+                                int8_shift_b<B>;
+        b_zero_points.data()[j] = zb;
+        b_zero = b_zero && zb == 0;
+    }
+
+    Int8Correction correction{static_cast<std::int32_t>(k), epilogue.a_zero_point + int8_shift_a<A>,
+                              b_zero_points.data(), nullptr, nullptr};
+
+    AlignedBuffer<std::int32_t> row_sums;
+    if (!b_zero) {
+        row_sums.reserve(m);
+        for (std::size_t i = 0; i < m; i++) {
+            std::int32_t sum = 0;
+            for (std::size_t l = 0; l < k; l++)
+                sum += a[i * lda + l] + int8_shift_a<A>;
+            row_sums.data()[i] = sum;
+        }
+        correction.a_row_sums = row_sums.data();
+    }
+
+    AlignedBuffer<std::int32_t> col_sums;
+    if (correction.a_zero_point != 0) {
+        col_sums.reserve(n);
+        std::fill(col_sums.data(), col_sums.data() + n, 0);
+        for (std::size_t l = 0; l < k; l++)
+            for (std::size_t j = 0; j < n; j++)
+                col_sums.data()[j] += b[l * ldb + j] + int8_shift_b<B>;
+        correction.b_col_sums = col_sums.data();
+    }
+
+    std::int32_t* acc;
+    std::size_t ld_acc;
+    AlignedBuffer<std::int32_t> acc_buffer;
+    if constexpr (std::is_same_v<Out, std::int32_t>) {
+        acc = c;
+        ld_acc = ldc;
+    }
+    else {
+        acc_buffer.reserve(m * n);
+        acc = acc_buffer.data();
+        ld_acc = n;
+    }
+
+    if (k == 0) {
+        for (std::size_t i = 0; i < m; i++)
+            std::fill(acc + i * ld_acc, acc + i * ld_acc + n, 0);
+        apply_int8_epilogue(epilogue, correction, m, n, acc, ld_acc, c, ldc, 0, 0);
+        return;
+    }
+
+    const std::size_t mr = kernel.mr;
+    const std::size_t nr = kernel.nr;
+    const std::size_t group = kernel.k_group;
+    const std::size_t value_size = kernel.value_size();
+    GemmBlocking blocks = tile_blocking(Int8GemmKernels::blocking(kernel), mr, nr);
+    // Groups must not straddle blocks
+    blocks.kc = std::max(group, blocks.kc / group * group);
+
+    const std::size_t mc = blocks.mc;
+    const std::size_t kc = blocks.kc;
+    const std::size_t nc = blocks.nc;
+    const std::size_t m_blocks = (m + mc - 1) / mc;
+
+    ThreadPool& pool = gemm_pool(options);
+    const std::size_t threads = gemm_num_threads(m, n, k, gemm_available_threads(options));
+
+    thread_local AlignedBuffer<std::byte> b_buffer;
+    b_buffer.reserve(std::min(nc, (n + nr - 1) / nr * nr) * kc * value_size);
+    std::byte* bp = b_buffer.data();
+
+    for (std::size_t jc = 0; jc < n; jc += nc) {
+        const std::size_t nc_cur = std::min(nc, n - jc);
+        const std::size_t n_panels = (nc_cur + nr - 1) / nr;
+        const std::size_t n_groups = std::min(n_panels, (threads + m_blocks - 1) / m_blocks);
+
+        for (std::size_t pc = 0; pc < k; pc += kc) {
+            const std::size_t kc_cur = std::min(kc, k - pc);
+            const std::size_t panel_stride = (kc_cur + group - 1) / group * group * value_size;
+            const Int8Epilogue<Out>* epilogue_cur = pc + kc_cur == k ? &epilogue : nullptr;
+
+            const std::size_t pack_tasks = std::min(threads, n_panels);
+            pool.parallel_for(pack_tasks, [&](std::size_t task) {
+                const std::size_t j0 = task * n_panels / pack_tasks * nr;
+                const std::size_t j1 = std::min(nc_cur, (task + 1) * n_panels / pack_tasks * nr);
+                pack_b_int8(kernel, kc_cur, j1 - j0, b + pc * ldb + jc + j0, ldb, bp + j0 * panel_stride);
+            }, threads);
+
+            pool.parallel_for(m_blocks * n_groups, [&](std::size_t task) {
+                const std::size_t ic = task / n_groups * mc;
+                const std::size_t group_idx = task % n_groups;
+                const std::size_t mc_cur = std::min(mc, m - ic);
+                const std::size_t j0 = group_idx * n_panels / n_groups * nr;
+                const std::size_t j1 = std::min(nc_cur, (group_idx + 1) * n_panels / n_groups * nr);
+
+                thread_local AlignedBuffer<std::byte> a_buffer;
+                a_buffer.reserve(mc * kc * value_size);
+
+                pack_a_int8(kernel, mc_cur, kc_cur, a + ic * lda + pc, lda, a_buffer.data());
+                macro_kernel_int8(mc_cur, j1 - j0, kc_cur, a_buffer.data(), bp + j0 * panel_stride,
+                                  acc + ic * ld_acc + jc + j0, ld_acc, pc > 0, kernel, epilogue_cur, correction,
+                                  c + ic * ldc + jc + j0, ldc, ic, jc + j0);
+            }, threads);
+        }
+    }
+}
+
+}
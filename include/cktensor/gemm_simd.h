@@ -0,0 +1,481 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+
+#include "cpu.h"
+
+
+// Hand-vectorized GEMM micro-kernels for x86. Each computes an MR x NR tile of C from the packed panels the
+// blocked GEMM produces: MR values of A broadcast per k, NR values of B loaded as NR / width vectors per k.
+//   AVX2:    float 6 x 16, double 6 x 8   (12 accumulators of 16 registers)
+//   AVX-512: float 12 x 32, double 12 x 16 (24 accumulators of 32 registers)
+// The complex kernels keep the panels interleaved. Each vector of B is multiplied by the broadcast real and the
+// broadcast imaginary part of A into two accumulators, which are only combined when the tile is stored:
+//   (ar * [br, bi]) +- swap(ai * [br, bi]) = [ar * br - ai * bi, ar * bi + ai * br]
+//   AVX2:    complex float 3 x 8, complex double 3 x 4  (12 accumulators of 16 registers)
+//   AVX-512: complex float 6 x 16, complex double 6 x 8 (24 accumulators of 32 registers)
+
+#ifdef CKTENSOR_X86
+
+namespace ck::impl {
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_micro_kernel_f32(std::size_t kc, const float* a, const float* b, float* c, std::size_t ldc,
+                                  float alpha, float beta) {
+    constexpr std::size_t MR = 6;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 8;
+
+    __m256 acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm256_setzero_ps();
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m256 bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm256_loadu_ps(b + v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m256 av = _mm256_broadcast_ss(a + i);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm256_fmadd_ps(av, bv[v], acc[i][v]);
+        }
+
+        a += MR;
+        b += NV * W;
+    }
+
+    const __m256 alpha_v = _mm256_set1_ps(alpha);
+    const __m256 beta_v = _mm256_set1_ps(beta);
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            float* dst = c + i * ldc + v * W;
+            __m256 res = _mm256_mul_ps(alpha_v, acc[i][v]);
+            if (beta != 0.0f)
+                res = _mm256_fmadd_ps(beta_v, _mm256_loadu_ps(dst), res);
+            _mm256_storeu_ps(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_micro_kernel_f64(std::size_t kc, const double* a, const double* b, double* c, std::size_t ldc,
+                                  double alpha, double beta) {
+    constexpr std::size_t MR = 6;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 4;
+
+    __m256d acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm256_setzero_pd();
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m256d bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm256_loadu_pd(b + v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m256d av = _mm256_broadcast_sd(a + i);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm256_fmadd_pd(av, bv[v], acc[i][v]);
+        }
+
+        a += MR;
+        b += NV * W;
+    }
+
+    const __m256d alpha_v = _mm256_set1_pd(alpha);
+    const __m256d beta_v = _mm256_set1_pd(beta);
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            double* dst = c + i * ldc + v * W;
+            __m256d res = _mm256_mul_pd(alpha_v, acc[i][v]);
+            if (beta != 0.0)
+                res = _mm256_fmadd_pd(beta_v, _mm256_loadu_pd(dst), res);
+            _mm256_storeu_pd(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_micro_kernel_f32(std::size_t kc, const float* a, const float* b, float* c, std::size_t ldc,
+                                    float alpha, float beta) {
+    constexpr std::size_t MR = 12;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 16;
+
+    __m512 acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm512_setzero_ps();
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m512 bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_ps(b + v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512 av = _mm512_set1_ps(a[i]);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm512_fmadd_ps(av, bv[v], acc[i][v]);
+        }
+
+        a += MR;
+        b += NV * W;
+    }
+
+    const __m512 alpha_v = _mm512_set1_ps(alpha);
+    const __m512 beta_v = _mm512_set1_ps(beta);
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            float* dst = c + i * ldc + v * W;
+            __m512 res = _mm512_mul_ps(alpha_v, acc[i][v]);
+            if (beta != 0.0f)
+                res = _mm512_fmadd_ps(beta_v, _mm512_loadu_ps(dst), res);
+            _mm512_storeu_ps(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_micro_kernel_f64(std::size_t kc, const double* a, const double* b, double* c, std::size_t ldc,
+                                    double alpha, double beta) {
+    constexpr std::size_t MR = 12;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 8;
+
+    __m512d acc[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++)
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            acc[i][v] = _mm512_setzero_pd();
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m512d bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_pd(b + v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512d av = _mm512_set1_pd(a[i]);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++)
+                acc[i][v] = _mm512_fmadd_pd(av, bv[v], acc[i][v]);
+        }
+
+        a += MR;
+        b += NV * W;
+    }
+
+    const __m512d alpha_v = _mm512_set1_pd(alpha);
+    const __m512d beta_v = _mm512_set1_pd(beta);
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            double* dst = c + i * ldc + v * W;
+            __m512d res = _mm512_mul_pd(alpha_v, acc[i][v]);
+            if (beta != 0.0)
+                res = _mm512_fmadd_pd(beta_v, _mm512_loadu_pd(dst), res);
+            _mm512_storeu_pd(dst, res);
+        }
+    }
+}
+
+// [re, im] pairs times the scalar re + i im
+CKTENSOR_TARGET_AVX2
+inline __m256 avx2_complex_scale_ps(__m256 v, __m256 re, __m256 im) {
+    return _mm256_fmaddsub_ps(v, re, _mm256_mul_ps(_mm256_permute_ps(v, 0xb1), im));
+}
+
+CKTENSOR_TARGET_AVX2
+inline __m256d avx2_complex_scale_pd(__m256d v, __m256d re, __m256d im) {
+    return _mm256_fmaddsub_pd(v, re, _mm256_mul_pd(_mm256_permute_pd(v, 0x5), im));
+}
+
+CKTENSOR_TARGET_AVX512
+inline __m512 avx512_complex_scale_ps(__m512 v, __m512 re, __m512 im) {
+    return _mm512_fmaddsub_ps(v, re, _mm512_mul_ps(_mm512_permute_ps(v, 0xb1), im));
+}
+
+CKTENSOR_TARGET_AVX512
+inline __m512d avx512_complex_scale_pd(__m512d v, __m512d re, __m512d im) {
+    return _mm512_fmaddsub_pd(v, re, _mm512_mul_pd(_mm512_permute_pd(v, 0x55), im));
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_micro_kernel_c64(std::size_t kc, const std::complex<float>* a, const std::complex<float>* b,
+                                  std::complex<float>* c, std::size_t ldc, std::complex<float> alpha,
+                                  std::complex<float> beta) {
+    constexpr std::size_t MR = 3;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 4;
+
+    const auto* af = reinterpret_cast<const float*>(a);
+    const auto* bf = reinterpret_cast<const float*>(b);
+
+    __m256 acc_re[MR][NV];
+    __m256 acc_im[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            acc_re[i][v] = _mm256_setzero_ps();
+            acc_im[i][v] = _mm256_setzero_ps();
+        }
+    }
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m256 bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm256_loadu_ps(bf + 2 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m256 are = _mm256_broadcast_ss(af + 2 * i);
+            const __m256 aim = _mm256_broadcast_ss(af + 2 * i + 1);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++) {
+                acc_re[i][v] = _mm256_fmadd_ps(are, bv[v], acc_re[i][v]);
+                acc_im[i][v] = _mm256_fmadd_ps(aim, bv[v], acc_im[i][v]);
+            }
+        }
+
+        af += 2 * MR;
+        bf += 2 * NV * W;
+    }
+
+    const __m256 alpha_re = _mm256_set1_ps(alpha.real());
+    const __m256 alpha_im = _mm256_set1_ps(alpha.imag());
+    const __m256 beta_re = _mm256_set1_ps(beta.real());
+    const __m256 beta_im = _mm256_set1_ps(beta.imag());
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            auto* dst = reinterpret_cast<float*>(c + i * ldc + v * W);
+            const __m256 prod = _mm256_addsub_ps(acc_re[i][v], _mm256_permute_ps(acc_im[i][v], 0xb1));
+            __m256 res = avx2_complex_scale_ps(prod, alpha_re, alpha_im);
+            if (beta != std::complex<float>{0})
+                res = _mm256_add_ps(res, avx2_complex_scale_ps(_mm256_loadu_ps(dst), beta_re, beta_im));
+            _mm256_storeu_ps(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_micro_kernel_c128(std::size_t kc, const std::complex<double>* a, const std::complex<double>* b,
+                                   std::complex<double>* c, std::size_t ldc, std::complex<double> alpha,
+                                   std::complex<double> beta) {
+    constexpr std::size_t MR = 3;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 2;
+
+    const auto* ad = reinterpret_cast<const double*>(a);
+    const auto* bd = reinterpret_cast<const double*>(b);
+
+    __m256d acc_re[MR][NV];
+    __m256d acc_im[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            acc_re[i][v] = _mm256_setzero_pd();
+            acc_im[i][v] = _mm256_setzero_pd();
+        }
+    }
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m256d bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm256_loadu_pd(bd + 2 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m256d are = _mm256_broadcast_sd(ad + 2 * i);
+            const __m256d aim = _mm256_broadcast_sd(ad + 2 * i + 1);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++) {
+                acc_re[i][v] = _mm256_fmadd_pd(are, bv[v], acc_re[i][v]);
+                acc_im[i][v] = _mm256_fmadd_pd(aim, bv[v], acc_im[i][v]);
+            }
+        }
+
+        ad += 2 * MR;
+        bd += 2 * NV * W;
+    }
+
+    const __m256d alpha_re = _mm256_set1_pd(alpha.real());
+    const __m256d alpha_im = _mm256_set1_pd(alpha.imag());
+    const __m256d beta_re = _mm256_set1_pd(beta.real());
+    const __m256d beta_im = _mm256_set1_pd(beta.imag());
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            auto* dst = reinterpret_cast<double*>(c + i * ldc + v * W);
+            const __m256d prod = _mm256_addsub_pd(acc_re[i][v], _mm256_permute_pd(acc_im[i][v], 0x5));
+            __m256d res = avx2_complex_scale_pd(prod, alpha_re, alpha_im);
+            if (beta != std::complex<double>{0})
+                res = _mm256_add_pd(res, avx2_complex_scale_pd(_mm256_loadu_pd(dst), beta_re, beta_im));
+            _mm256_storeu_pd(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_micro_kernel_c64(std::size_t kc, const std::complex<float>* a, const std::complex<float>* b,
+                                    std::complex<float>* c, std::size_t ldc, std::complex<float> alpha,
+                                    std::complex<float> beta) {
+    constexpr std::size_t MR = 6;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 8;
+
+    const auto* af = reinterpret_cast<const float*>(a);
+    const auto* bf = reinterpret_cast<const float*>(b);
+
+    __m512 acc_re[MR][NV];
+    __m512 acc_im[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            acc_re[i][v] = _mm512_setzero_ps();
+            acc_im[i][v] = _mm512_setzero_ps();
+        }
+    }
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m512 bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_ps(bf + 2 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512 are = _mm512_set1_ps(af[2 * i]);
+            const __m512 aim = _mm512_set1_ps(af[2 * i + 1]);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++) {
+                acc_re[i][v] = _mm512_fmadd_ps(are, bv[v], acc_re[i][v]);
+                acc_im[i][v] = _mm512_fmadd_ps(aim, bv[v], acc_im[i][v]);
+            }
+        }
+
+        af += 2 * MR;
+        bf += 2 * NV * W;
+    }
+
+    // AVX-512 has no addsub, a multiply by one does it
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 alpha_re = _mm512_set1_ps(alpha.real());
+    const __m512 alpha_im = _mm512_set1_ps(alpha.imag());
+    const __m512 beta_re = _mm512_set1_ps(beta.real());
+    const __m512 beta_im = _mm512_set1_ps(beta.imag());
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            auto* dst = reinterpret_cast<float*>(c + i * ldc + v * W);
+            const __m512 prod = _mm512_fmaddsub_ps(acc_re[i][v], one, _mm512_permute_ps(acc_im[i][v], 0xb1));
+            __m512 res = avx512_complex_scale_ps(prod, alpha_re, alpha_im);
+            if (beta != std::complex<float>{0})
+                res = _mm512_add_ps(res, avx512_complex_scale_ps(_mm512_loadu_ps(dst), beta_re, beta_im));
+            _mm512_storeu_ps(dst, res);
+        }
+    }
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_micro_kernel_c128(std::size_t kc, const std::complex<double>* a, const std::complex<double>* b,
+                                     std::complex<double>* c, std::size_t ldc, std::complex<double> alpha,
+                                     std::complex<double> beta) {
+    constexpr std::size_t MR = 6;
+    constexpr std::size_t NV = 2;
+    constexpr std::size_t W = 4;
+
+    const auto* ad = reinterpret_cast<const double*>(a);
+    const auto* bd = reinterpret_cast<const double*>(b);
+
+    __m512d acc_re[MR][NV];
+    __m512d acc_im[MR][NV];
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            acc_re[i][v] = _mm512_setzero_pd();
+            acc_im[i][v] = _mm512_setzero_pd();
+        }
+    }
+
+    for (std::size_t k = 0; k < kc; k++) {
+        __m512d bv[NV];
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++)
+            bv[v] = _mm512_loadu_pd(bd + 2 * v * W);
+
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < MR; i++) {
+            const __m512d are = _mm512_set1_pd(ad[2 * i]);
+            const __m512d aim = _mm512_set1_pd(ad[2 * i + 1]);
+#pragma GCC unroll 4
+            for (std::size_t v = 0; v < NV; v++) {
+                acc_re[i][v] = _mm512_fmadd_pd(are, bv[v], acc_re[i][v]);
+                acc_im[i][v] = _mm512_fmadd_pd(aim, bv[v], acc_im[i][v]);
+            }
+        }
+
+        ad += 2 * MR;
+        bd += 2 * NV * W;
+    }
+
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d alpha_re = _mm512_set1_pd(alpha.real());
+    const __m512d alpha_im = _mm512_set1_pd(alpha.imag());
+    const __m512d beta_re = _mm512_set1_pd(beta.real());
+    const __m512d beta_im = _mm512_set1_pd(beta.imag());
+#pragma GCC unroll 16
+    for (std::size_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+        for (std::size_t v = 0; v < NV; v++) {
+            auto* dst = reinterpret_cast<double*>(c + i * ldc + v * W);
+            const __m512d prod = _mm512_fmaddsub_pd(acc_re[i][v], one, _mm512_permute_pd(acc_im[i][v], 0x55));
+            __m512d res = avx512_complex_scale_pd(prod, alpha_re, alpha_im);
+            if (beta != std::complex<double>{0})
+                res = _mm512_add_pd(res, avx512_complex_scale_pd(_mm512_loadu_pd(dst), beta_re, beta_im));
+            _mm512_storeu_pd(dst, res);
+        }
+    }
+}
+
+}
+
+#endif // CKTENSOR_X86
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "cpu.h"
+
+
+// Kernels for the products where packing costs more than it saves:
+//   - GEMV, for a single row or column. Memory bound, so every pass over the matrix serves four rows of it,
+//   - fully unrolled kernels for small square matrices,
+//   - plain loops for the other tiny products.
+
+namespace ck::impl {
+
+// Element (row, col) of op(X) where X is row major with the leading dimension ld
+inline std::size_t op_offset(bool trans, std::size_t row, std::size_t col, std::size_t ld) {
+    return trans ? col * ld + row : row * ld + col;
+}
+
+// y = alpha * A * x + beta * y for the rows x cols matrix A, y is not read if beta is zero
+template<typename T>
+void gemv_n_scalar(std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda, const T* x, T beta,
+                   T* y) {
+    for (std::size_t i = 0; i < rows; i++) {
+        const T* row = a + i * lda;
+        T sum{0};
+        for (std::size_t j = 0; j < cols; j++)
+            sum += row[j] * x[j];
+        y[i] = beta == T{0} ? alpha * sum : alpha * sum + beta * y[i];
+    }
+}
+
+// y = alpha * A^T * x + beta * y for the rows x cols matrix A, y is not read if beta is zero
+template<typename T>
+void gemv_t_scalar(std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda, const T* x, T beta,
+                   T* y) {
+    for (std::size_t j = 0; j < cols; j++)
+        y[j] = beta == T{0} ? T{0} : beta * y[j];
+
+    for (std::size_t i = 0; i < rows; i++) {
+        const T* row = a + i * lda;
+        const T s = alpha * x[i];
+        for (std::size_t j = 0; j < cols; j++)
+            y[j] += s * row[j];
+    }
+}
+
+#ifdef CKTENSOR_X86
+
+template<typename T, std::size_t Bytes>
+CKTENSOR_ALWAYS_INLINE void gemv_n_simd(std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda,
+                                        const T* x, T beta, T* y) {
+    using V = typename SimdVec<T, Bytes>::type;
+    constexpr std::size_t W = SimdVec<T, Bytes>::width;
+    constexpr std::size_t R = 4;
+
+    std::size_t i = 0;
+    for (; i < rows; i += R) {
+        const std::size_t r_cur = std::min(R, rows - i);
+        const T* row[R];
+        for (std::size_t r = 0; r < R; r++)
+            row[r] = a + (i + std::min(r, r_cur - 1)) * lda;
+
+        V acc[R] = {};
+        std::size_t j = 0;
+        for (; j + W <= cols; j += W) {
+            const V xv = *reinterpret_cast<const V*>(x + j);
+#pragma GCC unroll 4
+            for (std::size_t r = 0; r < R; r++)
+                acc[r] += *reinterpret_cast<const V*>(row[r] + j) * xv;
+        }
+
+        for (std::size_t r = 0; r < r_cur; r++) {
+            T sum{0};
+            for (std::size_t l = 0; l < W; l++)
+                sum += acc[r][l];
+            for (std::size_t jj = j; jj < cols; jj++)
+                sum += row[r][jj] * x[jj];
+            y[i + r] = beta == T{0} ? alpha * sum : alpha * sum + beta * y[i + r];
+        }
+    }
+}
+
+template<typename T, std::size_t Bytes>
+CKTENSOR_ALWAYS_INLINE void gemv_t_simd(std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda,
+                                        const T* x, T beta, T* y) {
+    using V = typename SimdVec<T, Bytes>::type;
+    constexpr std::size_t W = SimdVec<T, Bytes>::width;
+    constexpr std::size_t R = 4;
+
+    for (std::size_t j = 0; j < cols; j++)
+        y[j] = beta == T{0} ? T{0} : beta * y[j];
+
+    for (std::size_t i = 0; i < rows; i += R) {
+        const std::size_t r_cur = std::min(R, rows - i);
+        const T* row[R];
+        T s[R];
+        for (std::size_t r = 0; r < R; r++) {
+            // Missing rows repeat the last one with a zero factor
+            row[r] = a + (i + std::min(r, r_cur - 1)) * lda;
+            s[r] = r < r_cur ? alpha * x[i + r] : T{0};
+        }
+
+        std::size_t j = 0;
+        for (; j + W <= cols; j += W) {
+            V yv = *reinterpret_cast<const V*>(y + j);
+#pragma GCC unroll 4
+            for (std::size_t r = 0; r < R; r++)
+                yv += s[r] * *reinterpret_cast<const V*>(row[r] + j);
+            *reinterpret_cast<V*>(y + j) = yv;
+        }
+
+        for (; j < cols; j++)
+            for (std::size_t r = 0; r < r_cur; r++)
+                y[j] += s[r] * row[r][j];
+    }
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_gemv_n_f32(std::size_t rows, std::size_t cols, float alpha, const float* a, std::size_t lda,
+                            const float* x, float beta, float* y) {
+    gemv_n_simd<float, 32>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_gemv_t_f32(std::size_t rows, std::size_t cols, float alpha, const float* a, std::size_t lda,
+                            const float* x, float beta, float* y) {
+    gemv_t_simd<float, 32>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_gemv_n_f64(std::size_t rows, std::size_t cols, double alpha, const double* a, std::size_t lda,
+                            const double* x, double beta, double* y) {
+    gemv_n_simd<double, 32>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_gemv_t_f64(std::size_t rows, std::size_t cols, double alpha, const double* a, std::size_t lda,
+                            const double* x, double beta, double* y) {
+    gemv_t_simd<double, 32>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_gemv_n_f32(std::size_t rows, std::size_t cols, float alpha, const float* a, std::size_t lda,
+                              const float* x, float beta, float* y) {
+    gemv_n_simd<float, 64>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_gemv_t_f32(std::size_t rows, std::size_t cols, float alpha, const float* a, std::size_t lda,
+                              const float* x, float beta, float* y) {
+    gemv_t_simd<float, 64>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_gemv_n_f64(std::size_t rows, std::size_t cols, double alpha, const double* a, std::size_t lda,
+                              const double* x, double beta, double* y) {
+    gemv_n_simd<double, 64>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_gemv_t_f64(std::size_t rows, std::size_t cols, double alpha, const double* a, std::size_t lda,
+                              const double* x, double beta, double* y) {
+    gemv_t_simd<double, 64>(rows, cols, alpha, a, lda, x, beta, y);
+}
+
+#endif // CKTENSOR_X86
+
+template<typename T>
+struct GemvKernel {
+    using Fn = void (*)(std::size_t rows, std::size_t cols, T alpha, const T* a, std::size_t lda, const T* x, T beta,
+                        T* y);
+
+    Fn n;   // y = alpha * A * x + beta * y
+    Fn t;   // y = alpha * A^T * x + beta * y
+    const char* name;
+};
+
+template<typename T>
+struct GemvKernels {
+    static GemvKernel<T> kernel(Isa) {
+        return {gemv_n_scalar<T>, gemv_t_scalar<T>, "scalar"};
+    }
+};
+
+template<>
+struct GemvKernels<float> {
+    static GemvKernel<float> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {avx512_gemv_n_f32, avx512_gemv_t_f32, "avx512"};
+        if (isa == Isa::AVX2)
+            return {avx2_gemv_n_f32, avx2_gemv_t_f32, "avx2"};
+#endif
+        (void) isa;
+        return {gemv_n_scalar<float>, gemv_t_scalar<float>, "scalar"};
+    }
+};
+
+template<>
+struct GemvKernels<double> {
+    static GemvKernel<double> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {avx512_gemv_n_f64, avx512_gemv_t_f64, "avx512"};
+        if (isa == Isa::AVX2)
+            return {avx2_gemv_n_f64, avx2_gemv_t_f64, "avx2"};
+#endif
+        (void) isa;
+        return {gemv_n_scalar<double>, gemv_t_scalar<double>, "scalar"};
+    }
+};
+
+template<typename T>
+const GemvKernel<T>& default_gemv_kernel() {
+    static const GemvKernel<T> kernel = GemvKernels<T>::kernel(kernel_isa());
+    return kernel;
+}
+
+// C = alpha * op(A) * op(B) + beta * C with the sizes known at compile time. The operands are first copied
+// into local arrays in the orientation the fully unrolled product needs.
+template<typename T, std::size_t M, std::size_t N, std::size_t K>
+void small_gemm(bool trans_a, bool trans_b, T alpha, const T* a, std::size_t lda, const T* b, std::size_t ldb,
+                T beta, T* c, std::size_t ldc) {
+    T at[M][K];
+    T bt[K][N];
+    for (std::size_t i = 0; i < M; i++)
+        for (std::size_t p = 0; p < K; p++)
+            at[i][p] = a[op_offset(trans_a, i, p, lda)];
+    for (std::size_t p = 0; p < K; p++)
+        for (std::size_t j = 0; j < N; j++)
+            bt[p][j] = b[op_offset(trans_b, p, j, ldb)];
+
+    T acc[M][N] = {};
+#pragma GCC unroll 16
+    for (std::size_t p = 0; p < K; p++)
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < M; i++)
+#pragma GCC unroll 16
+            for (std::size_t j = 0; j < N; j++)
+                acc[i][j] += at[i][p] * bt[p][j];
+
+    for (std::size_t i = 0; i < M; i++)
+        for (std::size_t j = 0; j < N; j++)
+            c[i * ldc + j] = beta == T{0} ? alpha * acc[i][j] : alpha * acc[i][j] + beta * c[i * ldc + j];
+}
+
+template<typename T>
+using SmallGemmFn = void (*)(bool trans_a, bool trans_b, T alpha, const T* a, std::size_t lda, const T* b,
+                             std::size_t ldb, T beta, T* c, std::size_t ldc);
+
+// The unrolled kernel for n x n matrices, null if there is none
+template<typename T>
+SmallGemmFn<T> small_gemm_kernel(std::size_t n) {
+    switch (n) {
+        case 2:
+            return small_gemm<T, 2, 2, 2>;
+        case 3:
+            return small_gemm<T, 3, 3, 3>;
+        case 4:
+            return small_gemm<T, 4, 4, 4>;
+        case 8:
+            return small_gemm<T, 8, 8, 8>;
+        default:
+            return nullptr;
+    }
+}
+
+// C = alpha * op(A) * op(B) + beta * C without any blocking, for the tiny products
+template<typename T>
+void tiny_gemm(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, T alpha, const T* a,
+               std::size_t lda, const T* b, std::size_t ldb, T beta, T* c, std::size_t ldc) {
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            T sum{0};
+            for (std::size_t p = 0; p < k; p++)
+                sum += a[op_offset(trans_a, i, p, lda)] * b[op_offset(trans_b, p, j, ldb)];
+            T& dst = c[i * ldc + j];
+            dst = beta == T{0} ? alpha * sum : alpha * sum + beta * dst;
+        }
+    }
+}
+
+}
+
+namespace ck {
+
+// C = A * B for the row major M x K matrix A and K x N matrix B, with the sizes known at compile time
+template<std::size_t M, std::size_t N, std::size_t K, typename T>
+void small_matmul(const T* a, const T* b, T* c) {
+    impl::small_gemm<T, M, N, K>(false, false, T{1}, a, K, b, N, T{0}, c, N);
+}
+
+}
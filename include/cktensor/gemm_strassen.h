@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+
+#include "allocator.h"
+#include "gemm_blocked.h"
+#include "traits.h"
+
+
+// Strassen-Winograd multiplication on top of a base GEMM. Each level of recursion computes C = A * B from 7
+// products of half size matrices and 15 additions, instead of 8 products, so that k levels do (7/8)^k of the
+// multiplications of the base GEMM. The rounding errors grow with the depth, which is why it is opt-in with
+// GemmOptions::strassen_cutoff.
+// The schedule of the products and additions is the one of Boyer, Dumas, Pernet and Zhou, "Memory efficient
+// scheduling of Strassen-Winograd's matrix multiplication algorithm" (2009): a level needs two temporaries,
+// X of m/2 x max(k/2, n/2) and Y of k/2 x n/2, and the quadrants of C hold the other intermediate results.
+// Odd dimensions are peeled off: the even part is recursive and the last row and column of C and the rank one
+// update of the last column of A and row of B are products of the base GEMM.
+
+namespace ck {
+
+namespace impl {
+
+template<typename T>
+struct IsStrassenType : std::bool_constant<std::is_floating_point_v<T> || IsComplex<T>::value> {};
+
+// Whether the product recurses at least once
+inline bool use_strassen(std::size_t m, std::size_t n, std::size_t k, std::size_t cutoff) {
+    return cutoff != 0 && std::min({m, n, k}) >= std::max<std::size_t>(cutoff, 2);
+}
+
+// The elements of the temporaries of every level
+inline std::size_t strassen_temporaries_size(std::size_t m, std::size_t n, std::size_t k, std::size_t cutoff) {
+    if (!use_strassen(m, n, k, cutoff))
+        return 0;
+
+    const std::size_t m2 = m / 2;
+    const std::size_t n2 = n / 2;
+    const std::size_t k2 = k / 2;
+    return m2 * std::max(k2, n2) + k2 * n2 + strassen_temporaries_size(m2, n2, k2, cutoff);
+}
+
+// z = x + y, or x - y, for m x n matrices. z may be x or y.
+template<typename T>
+void matrix_add(std::size_t m, std::size_t n, const T* x, std::size_t ldx, const T* y, std::size_t ldy, T* z,
+                std::size_t ldz) {
+    for (std::size_t i = 0; i < m; i++)
+        for (std::size_t j = 0; j < n; j++)
+            z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+}
+
+template<typename T>
+void matrix_sub(std::size_t m, std::size_t n, const T* x, std::size_t ldx, const T* y, std::size_t ldy, T* z,
+                std::size_t ldz) {
+    for (std::size_t i = 0; i < m; i++)
+        for (std::size_t j = 0; j < n; j++)
+            z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+}
+
+// C = A * B for row major matrices. base(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc) computes the products
+// below the cutoff. workspace holds strassen_temporaries_size(m, n, k, cutoff) elements.
+template<typename T, typename Base>
+void strassen_product(std::size_t m, std::size_t n, std::size_t k, const T* a, std::size_t lda, const T* b,
+                      std::size_t ldb, T* c, std::size_t ldc, std::size_t cutoff, T* workspace, const Base& base) {
+    if (!use_strassen(m, n, k, cutoff)) {
+        base(m, n, k, T{1}, a, lda, b, ldb, T{0}, c, ldc);
+        return;
+    }
+
+    const std::size_t m2 = m / 2;
+    const std::size_t n2 = n / 2;
+    const std::size_t k2 = k / 2;
+
+    const T* a11 = a;
+    const T* a12 = a + k2;
+    const T* a21 = a + m2 * lda;
+    const T* a22 = a21 + k2;
+    const T* b11 = b;
+    const T* b12 = b + n2;
+    const T* b21 = b + k2 * ldb;
+    const T* b22 = b21 + n2;
+    T* c11 = c;
+    T* c12 = c + n2;
+    T* c21 = c + m2 * ldc;
+    T* c22 = c21 + n2;
+
+    const std::size_t ldx = std::max(k2, n2);
+    const std::size_t ldy = n2;
+    T* x = workspace;
+    T* y = x + m2 * ldx;
+    T* next = y + k2 * ldy;
+
+    const auto product = [&](const T* pa, std::size_t ldpa, const T* pb, std::size_t ldpb, T* pc, std::size_t ldpc) {
+        strassen_product(m2, n2, k2, pa, ldpa, pb, ldpb, pc, ldpc, cutoff, next, base);
+    };
+
+    matrix_sub(m2, k2, a11, lda, a21, lda, x, ldx);      // S3 = A11 - A21
+    matrix_sub(k2, n2, b22, ldb, b12, ldb, y, ldy);      // T3 = B22 - B12
+    product(x, ldx, y, ldy, c21, ldc);                   // P7 = S3 T3
+    matrix_add(m2, k2, a21, lda, a22, lda, x, ldx);      // S1 = A21 + A22
+    matrix_sub(k2, n2, b12, ldb, b11, ldb, y, ldy);      // T1 = B12 - B11
+    product(x, ldx, y, ldy, c22, ldc);                   // P5 = S1 T1
+    matrix_sub(m2, k2, x, ldx, a11, lda, x, ldx);        // S2 = S1 - A11
+    matrix_sub(k2, n2, b22, ldb, y, ldy, y, ldy);        // T2 = B22 - T1
+    product(x, ldx, y, ldy, c12, ldc);                   // P6 = S2 T2
+    matrix_sub(m2, k2, a12, lda, x, ldx, x, ldx);        // S4 = A12 - S2
+    product(x, ldx, b22, ldb, c11, ldc);                 // P3 = S4 B22
+    product(a11, lda, b11, ldb, x, ldx);                 // P1 = A11 B11
+    matrix_add(m2, n2, x, ldx, c12, ldc, c12, ldc);      // U2 = P1 + P6
+    matrix_add(m2, n2, c12, ldc, c21, ldc, c21, ldc);    // U3 = U2 + P7
+    matrix_add(m2, n2, c12, ldc, c22, ldc, c12, ldc);    // U4 = U2 + P5
+    matrix_add(m2, n2, c21, ldc, c22, ldc, c22, ldc);    // C22 = U7 = U3 + P5
+    matrix_add(m2, n2, c12, ldc, c11, ldc, c12, ldc);    // C12 = U5 = U4 + P3
+    matrix_sub(k2, n2, y, ldy, b21, ldb, y, ldy);        // T4 = T2 - B21
+    product(a22, lda, y, ldy, c11, ldc);                 // P4 = A22 T4
+    matrix_sub(m2, n2, c21, ldc, c11, ldc, c21, ldc);    // C21 = U6 = U3 - P4
+    product(a12, lda, b21, ldb, c11, ldc);               // P2 = A12 B21
+    matrix_add(m2, n2, x, ldx, c11, ldc, c11, ldc);      // C11 = U1 = P1 + P2
+
+    const std::size_t m_even = 2 * m2;
+    const std::size_t n_even = 2 * n2;
+    const std::size_t k_even = 2 * k2;
+    if (k > k_even)
+        base(m_even, n_even, 1, T{1}, a + k_even, lda, b + k_even * ldb, ldb, T{1}, c, ldc);
+    if (n > n_even)
+        base(m, 1, k, T{1}, a, lda, b + n_even, ldb, T{0}, c + n_even, ldc);
+    if (m > m_even)
+        base(1, n_even, k, T{1}, a + m_even * lda, lda, b, ldb, T{0}, c + m_even * ldc, ldc);
+}
+
+// C = alpha * A * B + beta * C with Strassen-Winograd down to options.strassen_cutoff. The workspace is taken
+// from options.strassen_workspace at once.
+template<typename T, typename Base>
+void gemm_strassen(std::size_t m, std::size_t n, std::size_t k, T alpha, const T* a, std::size_t lda, const T* b,
+                   std::size_t ldb, T beta, T* c, std::size_t ldc, const GemmOptions& options, const Base& base) {
+    // Anything but C = A * B goes through a temporary product
+    const bool in_place = alpha == T{1} && beta == T{0};
+    const std::size_t size = (in_place ? 0 : m * n) + strassen_temporaries_size(m, n, k, options.strassen_cutoff);
+
+    std::pmr::memory_resource* resource = options.strassen_workspace != nullptr ? options.strassen_workspace
+                                                                                 : caching_resource();
+    T* workspace = static_cast<T*>(resource->allocate(size * sizeof(T), default_alignment));
+    struct Release {
+        std::pmr::memory_resource* resource;
+        T* p;
+        std::size_t size;
+
+        ~Release() {
+            resource->deallocate(p, size * sizeof(T), default_alignment);
+        }
+    } release{resource, workspace, size};
+
+    if (in_place) {
+        strassen_product(m, n, k, a, lda, b, ldb, c, ldc, options.strassen_cutoff, workspace, base);
+        return;
+    }
+
+    T* product = workspace;
+    strassen_product(m, n, k, a, lda, b, ldb, product, n, options.strassen_cutoff, workspace + m * n, base);
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            T& dst = c[i * ldc + j];
+            dst = beta == T{0} ? alpha * product[i * n + j] : alpha * product[i * n + j] + beta * dst;
+        }
+    }
+}
+
+}
+
+// The bytes of a GemmOptions::strassen_workspace that is enough for an m x n x k product of T, including the
+// alignment
+template<typename T>
+std::size_t strassen_workspace_bytes(std::size_t m, std::size_t n, std::size_t k, std::size_t cutoff) {
+    return (m * n + impl::strassen_temporaries_size(m, n, k, cutoff)) * sizeof(T) + default_alignment;
+}
+
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "allocator.h"
+#include "cpu.h"
+#include "gemm_blocked.h"
+
+
+// Per-machine configurations of the blocked GEMM. The best micro-kernel and block sizes depend on the caches of
+// the host, so they can be measured on it and kept in a profile, a text file with a configuration per line:
+//     <type> <isa> <mc> <kc> <nc> <cpu model>
+// The profile is read from the file named by CKTENSOR_GEMM_PROFILE, by default
+// $XDG_CACHE_HOME/cktensor/gemm_profile or ~/.cache/cktensor/gemm_profile. A configuration is used by the
+// machines with the same CPU model. With CKTENSOR_GEMM_AUTOTUNE=1, the first GEMM of a type that has no
+// configuration for the CPU tunes one, which takes a few seconds, and adds it to the profile.
+
+namespace ck {
+
+// The file the GEMM profile is kept in, see above
+inline std::string gemm_profile_path() {
+    if (const char* env = std::getenv("CKTENSOR_GEMM_PROFILE"); env != nullptr && env[0] != '\0')
+        return env;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && cache[0] != '\0')
+        return std::string{cache} + "/cktensor/gemm_profile";
+    if (const char* home = std::getenv("HOME"); home != nullptr && home[0] != '\0')
+        return std::string{home} + "/.cache/cktensor/gemm_profile";
+    return "cktensor_gemm_profile";
+}
+
+namespace impl {
+
+// The name of the type in profiles, nullptr for the types that are not tuned
+template<typename T>
+struct GemmTypeName {
+    static constexpr const char* value = nullptr;
+};
+
+template<>
+struct GemmTypeName<float> {
+    static constexpr const char* value = "float";
+};
+
+template<>
+struct GemmTypeName<double> {
+    static constexpr const char* value = "double";
+};
+
+template<>
+struct GemmTypeName<std::complex<float>> {
+    static constexpr const char* value = "complex64";
+};
+
+template<>
+struct GemmTypeName<std::complex<double>> {
+    static constexpr const char* value = "complex128";
+};
+
+struct GemmProfileEntry {
+    std::string type;
+    Isa isa;
+    GemmBlocking blocking;
+    std::string cpu;
+};
+
+class GemmProfile {
+public:
+    // A missing file is an empty profile, and malformed lines are skipped
+    static GemmProfile load(const std::string& path) {
+        GemmProfile profile;
+        std::ifstream file{path};
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields{line};
+            GemmProfileEntry entry;
+            std::string isa;
+            if (!(fields >> entry.type >> isa >> entry.blocking.mc >> entry.blocking.kc >> entry.blocking.nc))
+                continue;
+            std::getline(fields >> std::ws, entry.cpu);
+
+            if (entry.cpu.empty() || !parse_isa(isa, entry.isa) || entry.blocking.mc == 0 ||
+                entry.blocking.kc == 0 || entry.blocking.nc == 0)
+                continue;
+
+            profile.set(std::move(entry));
+        }
+
+        return profile;
+    }
+
+    // Writes a temporary file which replaces the profile, so that readers never see a partial one
+    void save(const std::string& path) const {
+        const std::filesystem::path target{path};
+        if (target.has_parent_path())
+            std::filesystem::create_directories(target.parent_path());
+
+        const std::string temporary = path + ".tmp" + std::to_string(std::chrono::steady_clock::now()
+                                                                          .time_since_epoch().count());
+        {
+            std::ofstream file{temporary, std::ios::trunc};
+            if (!file)
+                throw std::runtime_error{"Cannot open " + temporary + " for writing"};
+
+            file << "# type isa mc kc nc cpu\n";
+            for (const auto& entry: entries_)
+                file << entry.type << ' ' << isa_name(entry.isa) << ' ' << entry.blocking.mc << ' '
+                     << entry.blocking.kc << ' ' << entry.blocking.nc << ' ' << entry.cpu << '\n';
+
+            if (!file.flush())
+                throw std::runtime_error{"Cannot write " + temporary};
+        }
+
+        std::filesystem::rename(temporary, target);
+    }
+
+    const GemmProfileEntry* find(std::string_view cpu, std::string_view type) const {
+        const auto it = std::find_if(entries_.begin(), entries_.end(), [&](const GemmProfileEntry& entry) {
+            return entry.cpu == cpu && entry.type == type;
+        });
+        return it != entries_.end() ? &*it : nullptr;
+    }
+
+    // Adds the entry, replacing the one of the same CPU and type
+    void set(GemmProfileEntry entry) {
+        for (auto& existing: entries_) {
+            if (existing.cpu == entry.cpu && existing.type == entry.type) {
+                existing = std::move(entry);
+                return;
+            }
+        }
+        entries_.push_back(std::move(entry));
+    }
+
+    const std::vector<GemmProfileEntry>& entries() const {
+        return entries_;
+    }
+
+private:
+    std::vector<GemmProfileEntry> entries_;
+};
+
+struct GemmTuningShape {
+    std::size_t m;
+    std::size_t n;
+    std::size_t k;
+};
+
+// Large enough for every block size to matter, small enough to tune a type in a few seconds
+inline const std::vector<GemmTuningShape> default_tuning_shapes{{512, 512, 512}, {256, 2048, 256}};
+
+// Measures the single threaded GEMM of T for the micro-kernels up to max_isa and a range of block sizes, one
+// parameter after the other, on the given shapes. The returned entry is for the CPU the tuning ran on.
+template<typename T>
+GemmProfileEntry autotune_gemm(Isa max_isa = kernel_isa(),
+                               const std::vector<GemmTuningShape>& shapes = default_tuning_shapes) {
+    std::size_t a_size = 0;
+    std::size_t b_size = 0;
+    std::size_t c_size = 0;
+    for (const auto& shape: shapes) {
+        a_size = std::max(a_size, shape.m * shape.k);
+        b_size = std::max(b_size, shape.k * shape.n);
+        c_size = std::max(c_size, shape.m * shape.n);
+    }
+
+    AlignedBuffer<T> a{a_size};
+    AlignedBuffer<T> b{b_size};
+    AlignedBuffer<T> c{c_size};
+    for (std::size_t i = 0; i < a_size; i++)
+        a.data()[i] = static_cast<T>(static_cast<int>(i % 7) - 3);
+    for (std::size_t i = 0; i < b_size; i++)
+        b.data()[i] = static_cast<T>(static_cast<int>(i % 5) - 2);
+
+    // The best of two runs of each shape
+    const auto measure = [&](Isa isa, const GemmBlocking& blocking) {
+        const MicroKernel<T> kernel = GemmKernels<T>::kernel(isa);
+        double total = 0;
+        for (const auto& shape: shapes) {
+            double best = 0;
+            for (int run = 0; run < 2; run++) {
+                const auto start = std::chrono::steady_clock::now();
+                gemm_blocked<T>(false, false, shape.m, shape.n, shape.k, T{1}, a.data(), shape.k, b.data(), shape.n,
+                                T{0}, c.data(), shape.n, kernel, blocking, GemmOptions{1});
+                const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+                best = run == 0 ? time.count() : std::min(best, time.count());
+            }
+            total += best;
+        }
+        return total;
+    };
+
+    // The scalar kernels are only candidates where there is nothing else
+    GemmProfileEntry best{GemmTypeName<T>::value, max_isa, GemmKernels<T>::blocking(max_isa), cpu_model()};
+    double best_time = measure(best.isa, best.blocking);
+    for (Isa isa: {Isa::AVX2, Isa::AVX512}) {
+        if (isa >= max_isa)
+            continue;
+        const double time = measure(isa, GemmKernels<T>::blocking(isa));
+        if (time < best_time) {
+            best_time = time;
+            best.isa = isa;
+            best.blocking = GemmKernels<T>::blocking(isa);
+        }
+    }
+
+    const auto try_blocking = [&](GemmBlocking blocking) {
+        const MicroKernel<T> kernel = GemmKernels<T>::kernel(best.isa);
+        blocking = tile_blocking(blocking, kernel.mr, kernel.nr);
+        const double time = measure(best.isa, blocking);
+        if (time < best_time) {
+            best_time = time;
+            best.blocking = blocking;
+        }
+    };
+
+    for (std::size_t kc: {128, 192, 256, 384, 512})
+        try_blocking({best.blocking.mc, kc, best.blocking.nc});
+
+    const std::size_t mr = GemmKernels<T>::kernel(best.isa).mr;
+    for (std::size_t panels: {4, 8, 12, 16, 24, 32})
+        try_blocking({panels * mr, best.blocking.kc, best.blocking.nc});
+
+    for (std::size_t nc: {1024, 2048, 4096, 8192})
+        try_blocking({best.blocking.mc, best.blocking.kc, nc});
+
+    return best;
+}
+
+inline bool gemm_autotune_enabled() {
+    const char* env = std::getenv("CKTENSOR_GEMM_AUTOTUNE");
+    return env != nullptr && env[0] != '\0' && env[0] != '0';
+}
+
+// The configuration for T in the profile at path, or a tuned one with autotuning enabled, or the built in one.
+// Profile entries for an instruction set above isa are ignored.
+template<typename T>
+std::pair<Isa, GemmBlocking> gemm_tuning(Isa isa, const std::string& path) {
+    if constexpr (GemmTypeName<T>::value != nullptr) {
+        const auto profile = GemmProfile::load(path);
+        const auto* entry = profile.find(cpu_model(), GemmTypeName<T>::value);
+        if (entry != nullptr && entry->isa <= isa)
+            return {entry->isa, entry->blocking};
+
+        if (gemm_autotune_enabled()) {
+            const auto tuned = autotune_gemm<T>(isa);
+            // Another process may have added to the profile in the meantime
+            auto latest = GemmProfile::load(path);
+            latest.set(tuned);
+            try {
+                latest.save(path);
+            }
+            catch (const std::exception&) {
+                // Without a writable profile every process tunes again
+            }
+            return {tuned.isa, tuned.blocking};
+        }
+    }
+
+    return {isa, GemmKernels<T>::blocking(isa)};
+}
+
+// The configuration for T on this machine, from the profile at gemm_profile_path()
+template<typename T>
+std::pair<Isa, GemmBlocking> default_gemm_tuning() {
+    return gemm_tuning<T>(kernel_isa(), gemm_profile_path());
+}
+
+}
+
+// Tunes the GEMM of every floating point type for this CPU and stores the results in the profile at path, for
+// example as a deployment step instead of on the first run
+inline void autotune_gemm_profile(const std::string& path = gemm_profile_path()) {
+    const auto entries = {impl::autotune_gemm<float>(), impl::autotune_gemm<double>(),
+                          impl::autotune_gemm<std::complex<float>>(), impl::autotune_gemm<std::complex<double>>()};
+
+    auto profile = impl::GemmProfile::load(path);
+    for (const auto& entry: entries)
+        profile.set(entry);
+    profile.save(path);
+}
+
+}
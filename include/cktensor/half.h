@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "cpu.h"
+#include "traits.h"
+
+
+// 16-bit floating point element types, for storing weights and activations at half the memory traffic. They
+// only store values: arithmetic converts them to float, and an operation on two values of the same type rounds
+// its result back to that type.
+//   bf16: bfloat16, the upper half of a float. The range of float with 8 bits of precision.
+//   f16:  IEEE 754 binary16. 11 bits of precision up to 65504.
+// Conversions round to nearest even. Bulk conversions of arrays use F16C, AVX-512 and AVX-512 BF16.
+
+namespace ck {
+
+namespace impl {
+
+constexpr std::uint16_t float_to_bf16_bits(float f) {
+    const auto x = std::bit_cast<std::uint32_t>(f);
+    // Rounding would turn a NaN with only low payload bits into infinity
+    if ((x & 0x7fffffff) > 0x7f800000)
+        return static_cast<std::uint16_t>((x >> 16) | 0x40);
+    return static_cast<std::uint16_t>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+}
+
+constexpr float bf16_bits_to_float(std::uint16_t h) {
+    return std::bit_cast<float>(static_cast<std::uint32_t>(h) << 16);
+}
+
+constexpr std::uint16_t float_to_f16_bits(float f) {
+    std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+    const auto sign = static_cast<std::uint16_t>((x >> 16) & 0x8000);
+    x &= 0x7fffffff;
+
+    // Infinity and NaN
+    if (x >= 0x7f800000)
+        return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+    // 65520 and above round to infinity
+    if (x >= 0x477ff000)
+        return sign | 0x7c00;
+
+    // Below 2^-14 the result is subnormal, m * 2^-24 with m = round(x / 2^-24)
+    if (x < 0x38800000) {
+        if (x < 0x33000000)
+            return sign;
+
+        const std::uint32_t shift = 126 - (x >> 23);
+        const std::uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+        std::uint32_t m = mantissa >> shift;
+        const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+        const std::uint32_t half = 1u << (shift - 1);
+        if (rest > half || (rest == half && (m & 1)))
+            m++;
+        return static_cast<std::uint16_t>(sign | m);
+    }
+
+    // Rebias the exponent from 127 to 15 and round off 13 bits of the mantissa
+    std::uint32_t h = (x >> 13) - ((127 - 15) << 10);
+    const std::uint32_t rest = x & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+        h++;
+    return static_cast<std::uint16_t>(sign | h);
+}
+
+constexpr float f16_bits_to_float(std::uint16_t h) {
+    const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+    const std::uint32_t exponent = (h >> 10) & 0x1f;
+    std::uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0x1f)
+        return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+
+    if (exponent == 0) {
+        if (mantissa == 0)
+            return std::bit_cast<float>(sign);
+
+        // Subnormal, normalized for float
+        std::uint32_t e = 127 - 14;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            e--;
+        }
+        return std::bit_cast<float>(sign | (e << 23) | ((mantissa & 0x3ff) << 13));
+    }
+
+    return std::bit_cast<float>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+}
+
+struct bf16 {
+    std::uint16_t bits;
+
+    bf16() = default;
+
+    constexpr bf16(float f) : bits{impl::float_to_bf16_bits(f)} {}
+
+    constexpr operator float() const {
+        return impl::bf16_bits_to_float(bits);
+    }
+
+    static constexpr bf16 from_bits(std::uint16_t bits) {
+        bf16 ret;
+        ret.bits = bits;
+        return ret;
+    }
+};
+
+struct f16 {
+    std::uint16_t bits;
+
+    f16() = default;
+
+    constexpr f16(float f) : bits{impl::float_to_f16_bits(f)} {}
+
+    constexpr operator float() const {
+        return impl::f16_bits_to_float(bits);
+    }
+
+    static constexpr f16 from_bits(std::uint16_t bits) {
+        f16 ret;
+        ret.bits = bits;
+        return ret;
+    }
+};
+
+template<typename T>
+struct IsHalf : IsOneOf<T, bf16, f16> {};
+
+template<>
+struct IsZeroBitsZero<bf16> {
+    static constexpr bool value = true;
+};
+
+template<>
+struct IsZeroBitsZero<f16> {
+    static constexpr bool value = true;
+};
+
+namespace impl {
+
+// The type the values are computed in
+template<typename T>
+using ComputeType = std::conditional_t<IsHalf<T>::value, float, T>;
+
+// Two values of the same half type give that type, anything else what their compute types give
+template<typename T, typename U>
+using HalfResult = std::conditional_t<std::is_same_v<T, U>, T,
+                                      decltype(std::declval<ComputeType<T>>() + std::declval<ComputeType<U>>())>;
+
+template<typename T, typename U>
+constexpr bool half_operands = (IsHalf<T>::value || IsHalf<U>::value) &&
+                               (IsHalf<T>::value || std::is_arithmetic_v<T>) &&
+                               (IsHalf<U>::value || std::is_arithmetic_v<U>);
+
+}
+
+template<typename T, typename U> requires impl::half_operands<T, U>
+constexpr impl::HalfResult<T, U> operator+(T lhs, U rhs) {
+    using C = impl::HalfResult<T, U>;
+    return static_cast<C>(static_cast<impl::ComputeType<T>>(lhs) + static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename T, typename U> requires impl::half_operands<T, U>
+constexpr impl::HalfResult<T, U> operator-(T lhs, U rhs) {
+    using C = impl::HalfResult<T, U>;
+    return static_cast<C>(static_cast<impl::ComputeType<T>>(lhs) - static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename T, typename U> requires impl::half_operands<T, U>
+constexpr impl::HalfResult<T, U> operator*(T lhs, U rhs) {
+    using C = impl::HalfResult<T, U>;
+    return static_cast<C>(static_cast<impl::ComputeType<T>>(lhs) * static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename T, typename U> requires impl::half_operands<T, U>
+constexpr impl::HalfResult<T, U> operator/(T lhs, U rhs) {
+    using C = impl::HalfResult<T, U>;
+    return static_cast<C>(static_cast<impl::ComputeType<T>>(lhs) / static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename H> requires IsHalf<H>::value
+constexpr H operator-(H h) {
+    return H::from_bits(static_cast<std::uint16_t>(h.bits ^ 0x8000));
+}
+
+template<typename H, typename U> requires IsHalf<H>::value && impl::half_operands<H, U>
+constexpr H& operator+=(H& lhs, U rhs) {
+    return lhs = static_cast<H>(static_cast<float>(lhs) + static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename H, typename U> requires IsHalf<H>::value && impl::half_operands<H, U>
+constexpr H& operator-=(H& lhs, U rhs) {
+    return lhs = static_cast<H>(static_cast<float>(lhs) - static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename H, typename U> requires IsHalf<H>::value && impl::half_operands<H, U>
+constexpr H& operator*=(H& lhs, U rhs) {
+    return lhs = static_cast<H>(static_cast<float>(lhs) * static_cast<impl::ComputeType<U>>(rhs));
+}
+
+template<typename H, typename U> requires IsHalf<H>::value && impl::half_operands<H, U>
+constexpr H& operator/=(H& lhs, U rhs) {
+    return lhs = static_cast<H>(static_cast<float>(lhs) / static_cast<impl::ComputeType<U>>(rhs));
+}
+
+namespace impl {
+
+inline void bf16_to_float_scalar(const bf16* src, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+inline void float_to_bf16_scalar(const float* src, bf16* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+inline void f16_to_float_scalar(const f16* src, float* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+inline void float_to_f16_scalar(const float* src, f16* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+#ifdef CKTENSOR_X86
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_bf16_to_float(const bf16* src, float* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16)));
+    }
+    bf16_to_float_scalar(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_float_to_bf16(const float* src, bf16* dst, std::size_t n) {
+    const __m256i rounding = _mm256_set1_epi32(0x7fff);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i quiet = _mm256_set1_epi32(0x400000);
+
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 f = _mm256_loadu_ps(src + i);
+        const __m256i x = _mm256_castps_si256(f);
+        const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, rounding), odd), 16);
+        // NaNs are truncated and kept quiet instead
+        const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+        r = _mm256_blendv_epi8(r, _mm256_srli_epi32(_mm256_or_si256(x, quiet), 16), nan);
+
+        // The 16-bit halves of the 32-bit lanes, in order
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+    }
+    float_to_bf16_scalar(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_f16_to_float(const f16* src, float* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    f16_to_float_scalar(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX2
+inline void avx2_float_to_f16(const float* src, f16* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    float_to_f16_scalar(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_bf16_to_float(const bf16* src, float* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16)));
+    }
+    avx2_bf16_to_float(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_float_to_bf16(const float* src, bf16* dst, std::size_t n) {
+    const __m512i rounding = _mm512_set1_epi32(0x7fff);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i quiet = _mm512_set1_epi32(0x400000);
+
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 f = _mm512_loadu_ps(src + i);
+        const __m512i x = _mm512_castps_si512(f);
+        const __m512i odd = _mm512_and_si512(_mm512_srli_epi32(x, 16), one);
+        __m512i r = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(x, rounding), odd), 16);
+        // NaNs are truncated and kept quiet instead
+        const __mmask16 nan = _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q);
+        r = _mm512_mask_srli_epi32(r, nan, _mm512_or_si512(x, quiet), 16);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtepi32_epi16(r));
+    }
+    avx2_float_to_bf16(src + i, dst + i, n - i);
+}
+
+// vcvtneps2bf16 rounds like float_to_bf16_bits(), except that subnormal inputs are flushed to zero
+CKTENSOR_TARGET_AVX512_BF16
+inline void avx512_bf16_float_to_bf16(const float* src, bf16* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            (__m256i) _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i)));
+    avx2_float_to_bf16(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_f16_to_float(const f16* src, float* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+    avx2_f16_to_float(src + i, dst + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX512
+inline void avx512_float_to_f16(const float* src, f16* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    avx2_float_to_f16(src + i, dst + i, n - i);
+}
+
+#endif // CKTENSOR_X86
+
+struct HalfConversions {
+    void (*bf16_to_float)(const bf16* src, float* dst, std::size_t n);
+    void (*float_to_bf16)(const float* src, bf16* dst, std::size_t n);
+    void (*f16_to_float)(const f16* src, float* dst, std::size_t n);
+    void (*float_to_f16)(const float* src, f16* dst, std::size_t n);
+    const char* name;
+
+    // The kernels for the instruction set, bf16_native selects the AVX-512 BF16 rounding instruction
+    static HalfConversions kernels(Isa isa, bool bf16_native) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {avx512_bf16_to_float, bf16_native ? avx512_bf16_float_to_bf16 : avx512_float_to_bf16,
+                    avx512_f16_to_float, avx512_float_to_f16, bf16_native ? "avx512-bf16" : "avx512"};
+        if (isa == Isa::AVX2)
+            return {avx2_bf16_to_float, avx2_float_to_bf16, avx2_f16_to_float, avx2_float_to_f16, "avx2"};
+#endif
+        (void) isa;
+        (void) bf16_native;
+        return {bf16_to_float_scalar, float_to_bf16_scalar, f16_to_float_scalar, float_to_f16_scalar, "scalar"};
+    }
+};
+
+inline const HalfConversions& half_conversions() {
+    static const HalfConversions conversions = HalfConversions::kernels(kernel_isa(), cpu_features().avx512_bf16);
+    return conversions;
+}
+
+// dst[i] = src[i] for i in [0, n), vectorized between float and the half types
+template<typename S, typename D>
+void convert_n(const S* src, std::size_t n, D* dst) {
+    std::copy_n(src, n, dst);
+}
+
+inline void convert_n(const bf16* src, std::size_t n, float* dst) {
+    half_conversions().bf16_to_float(src, dst, n);
+}
+
+inline void convert_n(const float* src, std::size_t n, bf16* dst) {
+    half_conversions().float_to_bf16(src, dst, n);
+}
+
+inline void convert_n(const f16* src, std::size_t n, float* dst) {
+    half_conversions().f16_to_float(src, dst, n);
+}
+
+inline void convert_n(const float* src, std::size_t n, f16* dst) {
+    half_conversions().float_to_f16(src, dst, n);
+}
+
+}
+
+}
+
+template<>
+struct std::numeric_limits<ck::bf16> {
+    static constexpr bool is_specialized = true;
+    static constexpr bool is_signed = true;
+    static constexpr bool is_integer = false;
+    static constexpr bool is_exact = false;
+    static constexpr bool has_infinity = true;
+    static constexpr bool has_quiet_NaN = true;
+    static constexpr int digits = 8;
+    static constexpr int radix = 2;
+
+    static constexpr ck::bf16 min() noexcept { return ck::bf16::from_bits(0x0080); }
+    static constexpr ck::bf16 max() noexcept { return ck::bf16::from_bits(0x7f7f); }
+    static constexpr ck::bf16 lowest() noexcept { return ck::bf16::from_bits(0xff7f); }
+    static constexpr ck::bf16 epsilon() noexcept { return ck::bf16::from_bits(0x3c00); }
+    static constexpr ck::bf16 infinity() noexcept { return ck::bf16::from_bits(0x7f80); }
+    static constexpr ck::bf16 quiet_NaN() noexcept { return ck::bf16::from_bits(0x7fc0); }
+};
+
+template<>
+struct std::numeric_limits<ck::f16> {
+    static constexpr bool is_specialized = true;
+    static constexpr bool is_signed = true;
+    static constexpr bool is_integer = false;
+    static constexpr bool is_exact = false;
+    static constexpr bool has_infinity = true;
+    static constexpr bool has_quiet_NaN = true;
+    static constexpr int digits = 11;
+    static constexpr int radix = 2;
+
+    static constexpr ck::f16 min() noexcept { return ck::f16::from_bits(0x0400); }
+    static constexpr ck::f16 max() noexcept { return ck::f16::from_bits(0x7bff); }
+    static constexpr ck::f16 lowest() noexcept { return ck::f16::from_bits(0xfbff); }
+    static constexpr ck::f16 epsilon() noexcept { return ck::f16::from_bits(0x1400); }
+    static constexpr ck::f16 infinity() noexcept { return ck::f16::from_bits(0x7c00); }
+    static constexpr ck::f16 quiet_NaN() noexcept { return ck::f16::from_bits(0x7e00); }
+};
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cerrno>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include "allocator.h"
+#include "tensor.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace ck {
+
+// Element type codes of the tensor files
+enum class DType : std::uint32_t {
+    Bool = 1,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Int64,
+    UInt64,
+    Float32,
+    Float64,
+    Complex64,
+    Complex128,
+};
+
+template<typename T>
+struct DTypeOf;
+
+template<> struct DTypeOf<bool> { static constexpr DType value = DType::Bool; };
+template<> struct DTypeOf<std::int8_t> { static constexpr DType value = DType::Int8; };
+template<> struct DTypeOf<std::uint8_t> { static constexpr DType value = DType::UInt8; };
+template<> struct DTypeOf<std::int16_t> { static constexpr DType value = DType::Int16; };
+template<> struct DTypeOf<std::uint16_t> { static constexpr DType value = DType::UInt16; };
+template<> struct DTypeOf<std::int32_t> { static constexpr DType value = DType::Int32; };
+template<> struct DTypeOf<std::uint32_t> { static constexpr DType value = DType::UInt32; };
+template<> struct DTypeOf<std::int64_t> { static constexpr DType value = DType::Int64; };
+template<> struct DTypeOf<std::uint64_t> { static constexpr DType value = DType::UInt64; };
+template<> struct DTypeOf<float> { static constexpr DType value = DType::Float32; };
+template<> struct DTypeOf<double> { static constexpr DType value = DType::Float64; };
+template<> struct DTypeOf<std::complex<float>> { static constexpr DType value = DType::Complex64; };
+template<> struct DTypeOf<std::complex<double>> { static constexpr DType value = DType::Complex128; };
+
+enum class MapMode {
+    ReadOnly,       // Pages are shared with every process mapping the file, the tensor is only readable
+    CopyOnWrite     // Pages are shared until written, the writes stay private to the process
+};
+
+namespace impl {
+
+// File layout:
+//     FileHeader | shape (Dims x uint64) | zero padding | data at data_offset
+// The data starts at a page boundary so that it is suitably aligned in the mapping.
+struct FileHeader {
+    static constexpr char tensor_magic[8] = {'C', 'K', 'T', 'E', 'N', 'S', 'O', 'R'};
+    static constexpr std::uint32_t current_version = 1;
+    static constexpr std::uint64_t data_alignment = 4096;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dtype;
+    std::uint32_t dims;
+    std::uint32_t reserved;
+    std::uint64_t data_offset;
+};
+
+// Tensors whose buffers are file mappings. Unmaps them when the tensors release their buffers, anything else
+// such as reserve() goes to the upstream resource.
+class MappedResource : public std::pmr::memory_resource {
+public:
+    static MappedResource& instance() {
+        // Never destroyed, so that the tensors with static storage duration can still release their memory
+        static auto* resource = new MappedResource;
+        return *resource;
+    }
+
+    void add(void* data, void* base, std::size_t length) {
+        std::lock_guard lock{mutex_};
+        mappings_[data] = {base, length};
+    }
+
+private:
+    struct Mapping {
+        void* base;
+        std::size_t length;
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        return caching_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        {
+            std::lock_guard lock{mutex_};
+            auto it = mappings_.find(p);
+            if (it != mappings_.end()) {
+#if defined(__unix__) || defined(__APPLE__)
+                munmap(it->second.base, it->second.length);
+#endif
+                mappings_.erase(it);
+                return;
+            }
+        }
+
+        caching_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<void*, Mapping> mappings_;
+};
+
+}
+
+// Writes the tensor in the format map_tensor() reads
+template<typename T, std::size_t Dims>
+void save_tensor(const Tensor<T, Dims>& t, const std::string& path) {
+    static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable elements can be saved");
+
+    impl::FileHeader header{};
+    std::memcpy(header.magic, impl::FileHeader::tensor_magic, sizeof(header.magic));
+    header.version = impl::FileHeader::current_version;
+    header.dtype = static_cast<std::uint32_t>(DTypeOf<T>::value);
+    header.dims = Dims;
+
+    const std::size_t header_size = sizeof(header) + Dims * sizeof(std::uint64_t);
+    const std::uint64_t alignment = impl::FileHeader::data_alignment;
+    header.data_offset = (header_size + alignment - 1) / alignment * alignment;
+
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file)
+        throw std::runtime_error{"Cannot open " + path + " for writing"};
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (std::size_t i = 0; i < Dims; i++) {
+        const std::uint64_t dim = t.shape_at(i);
+        file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+    }
+
+    const std::string padding(header.data_offset - header_size, '\0');
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    file.write(reinterpret_cast<const char*>(t.data()), static_cast<std::streamsize>(t.num_elem() * sizeof(T)));
+
+    if (!file)
+        throw std::runtime_error{"Cannot write " + path};
+}
+
+// A tensor on a read-only mapping, which gives only const access to it. Copies of the tensor are ordinary
+// tensors:
+//     const auto weights = map_tensor<float, 2>(path);
+//     auto y = matmul(x, weights.tensor());
+//     Tensor<float, 2> writable = weights.tensor();
+template<typename T, std::size_t Dims>
+class ReadOnlyTensor {
+public:
+    explicit ReadOnlyTensor(Tensor<T, Dims>&& t) : tensor_{std::move(t)} {}
+
+    ReadOnlyTensor(const ReadOnlyTensor&) = delete;
+    ReadOnlyTensor& operator=(const ReadOnlyTensor&) = delete;
+    ReadOnlyTensor(ReadOnlyTensor&&) noexcept = default;
+    ReadOnlyTensor& operator=(ReadOnlyTensor&&) noexcept = default;
+
+    const Tensor<T, Dims>& tensor() const {
+        return tensor_;
+    }
+
+    operator const Tensor<T, Dims>&() const {
+        return tensor_;
+    }
+
+    const Shape<Dims>& shape() const {
+        return tensor_.shape();
+    }
+
+    std::size_t num_elem() const {
+        return tensor_.num_elem();
+    }
+
+    const T* data() const {
+        return tensor_.data();
+    }
+
+    template<typename... Args>
+    const T& at(Args... args) const {
+        return tensor_.at(args...);
+    }
+
+private:
+    Tensor<T, Dims> tensor_;
+};
+
+namespace impl {
+
+template<typename T, std::size_t Dims>
+Tensor<T, Dims> map_tensor_file(const std::string& path, MapMode mode) {
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::system_error{errno, std::generic_category(), "Cannot open " + path};
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        throw std::system_error{err, std::generic_category(), "Cannot stat " + path};
+    }
+
+    const auto length = static_cast<std::size_t>(st.st_size);
+    if (length < sizeof(impl::FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error{path + " is not a tensor file"};
+    }
+
+    const int prot = mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    const int flags = mode == MapMode::ReadOnly ? MAP_SHARED : MAP_PRIVATE;
+    void* base = ::mmap(nullptr, length, prot, flags, fd, 0);
+    const int err = errno;
+    // The mapping keeps the file referenced
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+        throw std::system_error{err, std::generic_category(), "Cannot map " + path};
+
+    const auto fail = [&](const std::string& reason) {
+        ::munmap(base, length);
+        throw std::runtime_error{path + ": " + reason};
+    };
+
+    impl::FileHeader header{};
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, impl::FileHeader::tensor_magic, sizeof(header.magic)) != 0)
+        fail("not a tensor file");
+    if (header.version != impl::FileHeader::current_version)
+        fail("unsupported version " + std::to_string(header.version));
+    if (header.dtype != static_cast<std::uint32_t>(DTypeOf<T>::value))
+        fail("element type mismatch");
+    if (header.dims != Dims)
+        fail("expected " + std::to_string(Dims) + " dimensions, found " + std::to_string(header.dims));
+    if (sizeof(header) + Dims * sizeof(std::uint64_t) > length)
+        fail("truncated header");
+
+    Shape<Dims> shape;
+    for (std::size_t i = 0; i < Dims; i++) {
+        std::uint64_t dim;
+        std::memcpy(&dim, static_cast<const std::byte*>(base) + sizeof(header) + i * sizeof(dim), sizeof(dim));
+        shape[i] = dim;
+    }
+
+    // The file can claim any shape, so the sizes are checked without overflowing
+    constexpr std::size_t max_elem = std::numeric_limits<std::size_t>::max() / sizeof(T);
+    std::size_t num_elem = 1;
+    for (std::size_t i = 0; i < Dims; i++) {
+        if (shape[i] != 0 && num_elem > max_elem / shape[i])
+            fail("truncated data");
+        num_elem *= shape[i];
+    }
+
+    const std::size_t bytes = num_elem * sizeof(T);
+    if (header.data_offset % alignof(T) != 0 || header.data_offset > length || bytes > length - header.data_offset)
+        fail("truncated data");
+
+    auto* data = reinterpret_cast<T*>(static_cast<std::byte*>(base) + header.data_offset);
+    if (bytes == 0) {
+        ::munmap(base, length);
+        return Tensor<T, Dims>{shape};
+    }
+
+    auto& resource = impl::MappedResource::instance();
+    resource.add(data, base, length);
+    impl::record_allocation(bytes);
+    return Tensor<T, Dims>{shape, data, &resource};
+#else
+    (void) path;
+    (void) mode;
+    throw std::runtime_error{"Memory-mapped tensors are not supported on this platform"};
+#endif
+}
+
+}
+
+// Creates a tensor on a mapping of a file written by save_tensor(). Nothing is read until the elements are
+// accessed, and the processes mapping the same file share the page cache instead of holding private copies.
+// The mapping is released with the tensor. In the read-only mode, the tensor is a ReadOnlyTensor, so that it
+// cannot be written through the pages mapped without write access. In the copy-on-write mode, it is a Tensor.
+template<typename T, std::size_t Dims, MapMode Mode = MapMode::ReadOnly>
+auto map_tensor(const std::string& path) {
+    if constexpr (Mode == MapMode::ReadOnly)
+        return ReadOnlyTensor<T, Dims>{impl::map_tensor_file<T, Dims>(path, Mode)};
+    else
+        return impl::map_tensor_file<T, Dims>(path, Mode);
+}
+
+}
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "broadcast.h"
+#include "cpu.h"
+#include "ops.h"
+#include "ops_simd.h"
+#include "tensor.h"
+#include "thread_pool.h"
+
+
+// Boolean tensors packed 64 elements to a word, for the results of comparisons. A Mask takes an eighth of the
+// memory of a Tensor<bool, Dims>, and it is built from the comparison operators with the compare and movemask
+// instructions:
+//     Mask keep = x > 0.0f;
+//     const auto y = where(keep, x, 0.0f);
+// Element i is the bit i % 64 of word i / 64 in row major order, and the bits after the last element are zero.
+
+namespace ck {
+
+template<std::size_t Dims>
+class Mask;
+
+namespace impl {
+
+template<typename E>
+struct VectorizedMask : std::false_type {};
+
+template<template<typename, typename> typename Op, typename L, typename R>
+struct VectorizedMask<BinaryExpression<Op, L, R>> : VectorizedExpression<BinaryExpression<Op, L, R>, bool> {};
+
+constexpr std::size_t words_for(std::size_t num_elem) {
+    return (num_elem + 63) / 64;
+}
+
+// The bits of the last word which hold elements
+constexpr std::uint64_t tail_bits(std::size_t num_elem) {
+    return num_elem % 64 == 0 ? ~std::uint64_t{0} : (std::uint64_t{1} << num_elem % 64) - 1;
+}
+
+// Calls f(first, last) for ranges of the words of num_elem elements, on several threads from parallel_threshold()
+// elements on. The ranges start on cache lines of out, where each word gives word_bytes bytes.
+template<typename F>
+void parallel_words(std::size_t num_elem, const void* out, std::size_t word_bytes, F&& f) {
+    const std::size_t num_words = words_for(num_elem);
+    if (num_elem < parallel_threshold()) {
+        f(std::size_t{0}, num_words);
+        return;
+    }
+
+    ThreadPool& pool = current_thread_pool();
+    parallel_ranges(pool, num_words, pool.num_threads(), out, word_bytes, std::forward<F>(f));
+}
+
+template<template<typename, typename> typename Op, typename L, typename R>
+void evaluate_mask_rows(const BinaryExpression<Op, L, R>& expr, std::uint64_t* words, std::size_t begin,
+                        std::size_t end) {
+    using T = typename OperandsElement<L, R>::type;
+    for_each_operand_row(expr, [words](auto lhs_single, auto rhs_single, const T* lhs, const T* rhs, std::size_t i,
+                                       std::size_t cols) {
+        constexpr bool l = decltype(lhs_single)::value;
+        constexpr bool r = decltype(rhs_single)::value;
+        compare_bits_kernel<Op, T, l, r>()(lhs, rhs, words, i, cols);
+    }, begin, end);
+}
+
+// Packs the elements of the expression into the words. Each thread has whole words.
+template<typename E>
+void evaluate_mask(const E& expr, std::uint64_t* words) {
+    const std::size_t num_elem = expr.shape().num_elem();
+
+    parallel_words(num_elem, words, sizeof(std::uint64_t), [&](std::size_t first, std::size_t last) {
+        const std::size_t begin = first * 64;
+        const std::size_t end = std::min(num_elem, last * 64);
+
+        if constexpr (VectorizedMask<E>::value) {
+            evaluate_mask_rows(expr, words, begin, end);
+        }
+        else {
+            for_each_element(expr, [words](std::size_t i, const auto& el) {
+                const std::uint64_t bit = std::uint64_t{static_cast<bool>(el)} << i % 64;
+                if (i % 64 == 0)
+                    words[i / 64] = bit;
+                else
+                    words[i / 64] |= bit;
+            }, begin, end);
+        }
+    });
+}
+
+inline std::size_t count_bits_scalar(const std::uint64_t* words, std::size_t n) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; i++)
+        count += std::popcount(words[i]);
+    return count;
+}
+
+inline bool any_bits_scalar(const std::uint64_t* words, std::size_t n) {
+    return std::any_of(words, words + n, [](std::uint64_t word) { return word != 0; });
+}
+
+// Whether the n words are all ones
+inline bool all_bits_scalar(const std::uint64_t* words, std::size_t n) {
+    return std::all_of(words, words + n, [](std::uint64_t word) { return word == ~std::uint64_t{0}; });
+}
+
+#ifdef CKTENSOR_X86
+
+// The bit counts of the bytes from a lookup of their two nibbles, summed into 64-bit lanes with vpsadbw. A byte
+// gains at most 8 per vector, so the byte sums are added to the lanes every 31 vectors before they overflow.
+CKTENSOR_TARGET_AVX2
+inline std::size_t avx2_count_bits(const std::uint64_t* words, std::size_t n) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    const std::size_t vector_end = n / 4 * 4;
+
+    __m256i total = _mm256_setzero_si256();
+    std::size_t i = 0;
+    while (i < vector_end) {
+        const std::size_t block_end = std::min(vector_end, i + 31 * 4);
+        __m256i bytes = _mm256_setzero_si256();
+        for (; i < block_end; i += 4) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+            const __m256i lo = _mm256_and_si256(v, low_nibbles);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+            bytes = _mm256_add_epi8(bytes, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                                           _mm256_shuffle_epi8(lookup, hi)));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+
+    const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    const auto count = static_cast<std::size_t>(_mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1));
+    return count + count_bits_scalar(words + vector_end, n - vector_end);
+}
+
+// 4 vectors between the tests, so that a test is not a branch on every load
+CKTENSOR_TARGET_AVX2
+inline bool avx2_any_bits(const std::uint64_t* words, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const auto* p = reinterpret_cast<const __m256i*>(words + i);
+        const __m256i v = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+                                          _mm256_or_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+        if (!_mm256_testz_si256(v, v))
+            return true;
+    }
+    for (; i + 4 <= n; i += 4) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        if (!_mm256_testz_si256(v, v))
+            return true;
+    }
+    return any_bits_scalar(words + i, n - i);
+}
+
+CKTENSOR_TARGET_AVX2
+inline bool avx2_all_bits(const std::uint64_t* words, std::size_t n) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const auto* p = reinterpret_cast<const __m256i*>(words + i);
+        const __m256i v = _mm256_and_si256(_mm256_and_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+                                           _mm256_and_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+        if (!_mm256_testc_si256(v, ones))
+            return false;
+    }
+    for (; i + 4 <= n; i += 4) {
+        if (!_mm256_testc_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i)), ones))
+            return false;
+    }
+    return all_bits_scalar(words + i, n - i);
+}
+
+// As the AVX2 kernels. vpopcntq would need AVX512_VPOPCNTDQ, which is not among the features of Isa::AVX512.
+CKTENSOR_TARGET_AVX512
+inline std::size_t avx512_count_bits(const std::uint64_t* words, std::size_t n) {
+    const __m512i lookup = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i low_nibbles = _mm512_set1_epi8(0x0f);
+    const std::size_t vector_end = n / 8 * 8;
+
+    __m512i total = _mm512_setzero_si512();
+    std::size_t i = 0;
+    while (i < vector_end) {
+        const std::size_t block_end = std::min(vector_end, i + 31 * 8);
+        __m512i bytes = _mm512_setzero_si512();
+        for (; i < block_end; i += 8) {
+            const __m512i v = _mm512_loadu_si512(words + i);
+            const __m512i lo = _mm512_and_si512(v, low_nibbles);
+            const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_nibbles);
+            bytes = _mm512_add_epi8(bytes, _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                                           _mm512_shuffle_epi8(lookup, hi)));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(bytes, _mm512_setzero_si512()));
+    }
+
+    const auto count = static_cast<std::size_t>(_mm512_reduce_add_epi64(total));
+    return count + count_bits_scalar(words + vector_end, n - vector_end);
+}
+
+CKTENSOR_TARGET_AVX512
+inline bool avx512_any_bits(const std::uint64_t* words, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m512i v = _mm512_or_si512(_mm512_or_si512(_mm512_loadu_si512(words + i),
+                                                          _mm512_loadu_si512(words + i + 8)),
+                                          _mm512_or_si512(_mm512_loadu_si512(words + i + 16),
+                                                          _mm512_loadu_si512(words + i + 24)));
+        if (_mm512_test_epi64_mask(v, v) != 0)
+            return true;
+    }
+    // The lanes after the last word are loaded as zeros
+    for (; i < n; i += 8) {
+        const __mmask8 lanes = n - i >= 8 ? __mmask8{0xff} : static_cast<__mmask8>((1u << (n - i)) - 1);
+        const __m512i v = _mm512_maskz_loadu_epi64(lanes, words + i);
+        if (_mm512_test_epi64_mask(v, v) != 0)
+            return true;
+    }
+    return false;
+}
+
+CKTENSOR_TARGET_AVX512
+inline bool avx512_all_bits(const std::uint64_t* words, std::size_t n) {
+    const __m512i ones = _mm512_set1_epi64(-1);
+
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m512i v = _mm512_and_si512(_mm512_and_si512(_mm512_loadu_si512(words + i),
+                                                            _mm512_loadu_si512(words + i + 8)),
+                                           _mm512_and_si512(_mm512_loadu_si512(words + i + 16),
+                                                            _mm512_loadu_si512(words + i + 24)));
+        if (_mm512_cmpneq_epi64_mask(v, ones) != 0)
+            return false;
+    }
+    // The lanes after the last word are loaded as ones
+    for (; i < n; i += 8) {
+        const __mmask8 lanes = n - i >= 8 ? __mmask8{0xff} : static_cast<__mmask8>((1u << (n - i)) - 1);
+        const __m512i v = _mm512_mask_loadu_epi64(ones, lanes, words + i);
+        if (_mm512_cmpneq_epi64_mask(v, ones) != 0)
+            return false;
+    }
+    return true;
+}
+
+#endif // CKTENSOR_X86
+
+// The reductions over the words of a mask
+struct MaskWordsKernel {
+    std::size_t (*count)(const std::uint64_t* words, std::size_t n);
+    bool (*any)(const std::uint64_t* words, std::size_t n);
+    bool (*all)(const std::uint64_t* words, std::size_t n);
+    const char* name;
+};
+
+struct MaskWordsKernels {
+    static MaskWordsKernel kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if (isa == Isa::AVX512)
+            return {avx512_count_bits, avx512_any_bits, avx512_all_bits, "avx512"};
+        if (isa == Isa::AVX2)
+            return {avx2_count_bits, avx2_any_bits, avx2_all_bits, "avx2"};
+#endif
+        (void) isa;
+        return {count_bits_scalar, any_bits_scalar, all_bits_scalar, "scalar"};
+    }
+};
+
+inline const MaskWordsKernel& mask_words_kernel() {
+    static const auto kernel = MaskWordsKernels::kernel(kernel_isa());
+    return kernel;
+}
+
+}
+
+template<std::size_t Dims>
+class Mask {
+public:
+    Mask() = default;
+
+    // All false
+    explicit Mask(const Shape<Dims>& shape)
+            : shape_{shape}, words_{zeros<std::uint64_t>(Shape<1>{impl::words_for(shape.num_elem())})} {}
+
+    explicit Mask(const Tensor<bool, Dims>& t) : Mask(t.shape()) {
+        for (std::size_t i = 0; i < num_elem(); i++)
+            words_.data()[i / 64] |= std::uint64_t{t.data()[i]} << i % 64;
+    }
+
+    // From an expression, typically a comparison, which is packed without a Tensor<bool, Dims> in between
+    template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+    Mask(const E& expr)
+            : shape_{expr.shape()}, words_{Tensor<std::uint64_t, 1>::empty(Shape<1>{impl::words_for(num_elem())})} {
+        impl::evaluate_mask(expr, words_.data());
+    }
+
+    template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+    Mask& operator=(const E& expr) {
+        if (shape_ != expr.shape()) {
+            shape_ = expr.shape();
+            words_ = Tensor<std::uint64_t, 1>::empty(Shape<1>{impl::words_for(num_elem())});
+        }
+        impl::evaluate_mask(expr, words_.data());
+        return *this;
+    }
+
+    const Shape<Dims>& shape() const {
+        return shape_;
+    }
+
+    std::size_t num_elem() const {
+        return shape_.num_elem();
+    }
+
+    std::size_t num_words() const {
+        return words_.num_elem();
+    }
+
+    const std::uint64_t* words() const {
+        return words_.data();
+    }
+
+    // The bits after the last element have to stay zero
+    std::uint64_t* words() {
+        return words_.data();
+    }
+
+    bool operator[](std::size_t i) const {
+        return (words_.data()[i / 64] >> i % 64 & 1) != 0;
+    }
+
+    void set(std::size_t i, bool value) {
+        const std::uint64_t bit = std::uint64_t{1} << i % 64;
+        std::uint64_t& word = words_.data()[i / 64];
+        word = value ? word | bit : word & ~bit;
+    }
+
+    Tensor<bool, Dims> to_tensor() const {
+        auto ret = Tensor<bool, Dims>::empty(shape_);
+        for (std::size_t i = 0; i < num_elem(); i++)
+            ret.data()[i] = (*this)[i];
+        return ret;
+    }
+
+    bool any() const {
+        return impl::mask_words_kernel().any(words(), num_words());
+    }
+
+    bool all() const {
+        if (num_words() == 0)
+            return true;
+
+        const std::size_t full = num_words() - 1;
+        return impl::mask_words_kernel().all(words(), full) && words()[full] == impl::tail_bits(num_elem());
+    }
+
+    std::size_t count_nonzero() const {
+        return impl::mask_words_kernel().count(words(), num_words());
+    }
+
+    Mask operator~() const {
+        Mask ret{*this};
+        std::uint64_t* w = ret.words();
+        for (std::size_t i = 0; i < num_words(); i++)
+            w[i] = ~w[i];
+        if (num_words() != 0)
+            w[num_words() - 1] &= impl::tail_bits(num_elem());
+        return ret;
+    }
+
+    // The logical operators throw a BroadcastError for masks of different shapes
+    Mask& operator&=(const Mask& other) {
+        return combine(other, [](std::uint64_t l, std::uint64_t r) { return l & r; });
+    }
+
+    Mask& operator|=(const Mask& other) {
+        return combine(other, [](std::uint64_t l, std::uint64_t r) { return l | r; });
+    }
+
+    Mask& operator^=(const Mask& other) {
+        return combine(other, [](std::uint64_t l, std::uint64_t r) { return l ^ r; });
+    }
+
+private:
+    template<typename F>
+    Mask& combine(const Mask& other, F f) {
+        if (shape_ != other.shape_)
+            throw BroadcastError{};
+
+        std::uint64_t* w = words();
+        const std::uint64_t* o = other.words();
+        for (std::size_t i = 0; i < num_words(); i++)
+            w[i] = f(w[i], o[i]);
+        return *this;
+    }
+
+    Shape<Dims> shape_{};
+    Tensor<std::uint64_t, 1> words_{Shape<1>{0}};
+};
+
+template<typename E> requires impl::is_expression<E>
+Mask(const E&) -> Mask<E::dims>;
+
+template<std::size_t Dims>
+Mask<Dims> operator&(Mask<Dims> lhs, const Mask<Dims>& rhs) {
+    return lhs &= rhs;
+}
+
+template<std::size_t Dims>
+Mask<Dims> operator|(Mask<Dims> lhs, const Mask<Dims>& rhs) {
+    return lhs |= rhs;
+}
+
+template<std::size_t Dims>
+Mask<Dims> operator^(Mask<Dims> lhs, const Mask<Dims>& rhs) {
+    return lhs ^= rhs;
+}
+
+template<std::size_t Dims>
+bool is_equal(const Mask<Dims>& lhs, const Mask<Dims>& rhs) {
+    return lhs.shape() == rhs.shape() && std::equal(lhs.words(), lhs.words() + lhs.num_words(), rhs.words());
+}
+
+namespace impl {
+template<typename X>
+struct WhereElement {
+    using type = X;
+};
+
+template<typename T, std::size_t Dims>
+struct WhereElement<Tensor<T, Dims>> {
+    using type = T;
+};
+
+template<typename X>
+const X& where_value(const X& x, std::size_t) {
+    return x;
+}
+
+template<typename T, std::size_t Dims>
+T where_value(const Tensor<T, Dims>& t, std::size_t i) {
+    return t.data()[i];
+}
+
+template<typename X, std::size_t Dims>
+bool where_shape(const X&, const Shape<Dims>&) {
+    return true;
+}
+
+template<typename T, std::size_t Dims>
+bool where_shape(const Tensor<T, Dims>& t, const Shape<Dims>& shape) {
+    return t.shape() == shape;
+}
+}
+
+// The elements of a where the mask is set and of b elsewhere. a and b are tensors of the shape of the mask, or
+// scalars, and a tensor of another shape throws a BroadcastError. The words of the mask which are all set or all
+// clear are copied from one side.
+template<std::size_t Dims, typename A, typename B>
+auto where(const Mask<Dims>& mask, const A& a, const B& b) {
+    using T = typename impl::WhereElement<A>::type;
+    using U = typename impl::WhereElement<B>::type;
+    using R = std::common_type_t<T, U>;
+
+    if (!impl::where_shape(a, mask.shape()) || !impl::where_shape(b, mask.shape()))
+        throw BroadcastError{};
+    const auto value_a = [&](std::size_t i) { return static_cast<R>(impl::where_value(a, i)); };
+    const auto value_b = [&](std::size_t i) { return static_cast<R>(impl::where_value(b, i)); };
+
+    auto ret = Tensor<R, Dims>::empty(mask.shape());
+    R* data = ret.data();
+    const std::uint64_t* words = mask.words();
+    const std::size_t num_elem = mask.num_elem();
+
+    impl::parallel_words(num_elem, data, sizeof(R) * 64, [&](std::size_t first, std::size_t last) {
+        for (std::size_t w = first; w < last; w++) {
+            const std::size_t begin = w * 64;
+            const std::size_t end = std::min(num_elem, begin + 64);
+            const std::uint64_t word = words[w];
+            if (word == 0) {
+                for (std::size_t i = begin; i < end; i++)
+                    data[i] = value_b(i);
+            }
+            else if (word == ~std::uint64_t{0}) {
+                for (std::size_t i = begin; i < end; i++)
+                    data[i] = value_a(i);
+            }
+            else {
+                for (std::size_t i = begin; i < end; i++)
+                    data[i] = (word >> (i - begin) & 1) != 0 ? value_a(i) : value_b(i);
+            }
+        }
+    });
+
+    return ret;
+}
+
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "broadcast.h"
+#include "gemm.h"
+#include "gemm_int8.h"
+#include "tensor.h"
+
+
+namespace ck {
+
+// Operations fused into a matrix product, applied while each tile of the output is still in cache:
+//     out = scale * activation(lhs x rhs + bias) + residual
+template<typename T>
+struct Epilogue {
+    // Added to each row of the product, or with bias_per_row to each column
+    const Tensor<T, 1>* bias{nullptr};
+    bool bias_per_row{false};
+    Activation activation{Activation::None};
+    T scale{1};
+    // Has the shape of the product
+    const Tensor<T, 2>* residual{nullptr};
+};
+
+namespace impl {
+
+// Matrix products over the last two dimensions, the leading ones are batch dimensions broadcast against
+// each other as in NumPy. Each operand holds its matrices back to back, so along a batch dimension they are a
+// fixed number of matrices apart, or zero for a broadcast dimension. Adjacent batch dimensions with matching
+// strides are merged, and each remaining outer index is one strided-batched GEMM.
+template<std::size_t TDims, std::size_t UDims>
+struct MatMulLayout {
+    static_assert(TDims >= 2 && UDims >= 2, "matmul needs matrices or stacks of matrices");
+
+    static constexpr std::size_t RetDims = std::max(TDims, UDims);
+    static constexpr std::size_t BatchDims = RetDims - 2;
+
+    MatMulLayout(const Shape<TDims>& lhs, const Shape<UDims>& rhs)
+            : m{lhs.rat(1)}, n{rhs.rat(0)}, k{lhs.rat(0)} {
+        assert(rhs.rat(1) == k && "Incompatible shapes");
+
+        shape.rat(0) = n;
+        shape.rat(1) = m;
+
+        std::size_t lhs_matrices = 1;
+        std::size_t rhs_matrices = 1;
+        for (std::size_t i = 0; i < BatchDims; i++) {
+            const std::size_t l = i + 2 < TDims ? lhs.rat(i + 2) : 1;
+            const std::size_t r = i + 2 < UDims ? rhs.rat(i + 2) : 1;
+            if (l != r && l != 1 && r != 1)
+                throw BroadcastError{};
+
+            batch_shape[i] = l == 1 ? r : l;
+            shape.rat(i + 2) = batch_shape[i];
+            lhs_strides[i] = l == 1 ? 0 : lhs_matrices;
+            rhs_strides[i] = r == 1 ? 0 : rhs_matrices;
+            lhs_matrices *= l;
+            rhs_matrices *= r;
+        }
+    }
+
+    // C = alpha * lhs x rhs + beta * C, the matrices of C are back to back with the row stride ldc
+    // The epilogue is only supported without batch dimensions.
+    template<typename T>
+    void gemm(const T* lhs, const T* rhs, T alpha, T beta, T* c, std::size_t ldc, const GemmOptions& options,
+              const GemmEpilogue<T>* epilogue = nullptr) const {
+        if (shape.num_elem() == 0)
+            return;
+        assert((epilogue == nullptr || shape.num_elem() == m * n) && "Epilogues need a single product");
+
+        // The innermost batch dimensions that one strided call covers
+        std::size_t inner = 1;
+        std::size_t inner_dims = 0;
+        const std::size_t lhs_stride = BatchDims > 0 ? lhs_strides[0] : 0;
+        const std::size_t rhs_stride = BatchDims > 0 ? rhs_strides[0] : 0;
+        for (; inner_dims < BatchDims; inner_dims++) {
+            if (lhs_strides[inner_dims] != lhs_stride * inner || rhs_strides[inner_dims] != rhs_stride * inner)
+                break;
+            inner *= batch_shape[inner_dims];
+        }
+
+        const std::size_t outer = shape.num_elem() / (inner * m * n);
+        for (std::size_t o = 0; o < outer; o++) {
+            std::size_t lhs_offset = 0;
+            std::size_t rhs_offset = 0;
+            for (std::size_t i = inner_dims, rem = o; i < BatchDims; i++) {
+                const std::size_t idx = rem % batch_shape[i];
+                rem /= batch_shape[i];
+                lhs_offset += idx * lhs_strides[i];
+                rhs_offset += idx * rhs_strides[i];
+            }
+
+            const T* a = lhs + lhs_offset * m * k;
+            const T* b = rhs + rhs_offset * k * n;
+            T* c_batch = c + o * inner * m * ldc;
+
+            if (inner == 1)
+                GEMM<T>{}(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, alpha, a, k, b, n, beta, c_batch, ldc,
+                          options, epilogue);
+            else
+                GEMMBatchStrided<T>{}(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, alpha, a, k,
+                                      lhs_stride * m * k, b, n, rhs_stride * k * n, beta, c_batch, ldc, m * ldc,
+                                      inner, options);
+        }
+    }
+
+    // C = lhs x rhs for 8-bit integer operands, with 32-bit sums. The matrices of C are back to back.
+    template<typename T, typename U>
+    void gemm_int8(const T* lhs, const U* rhs, std::int32_t* c, const GemmOptions& options) const {
+        if (shape.num_elem() == 0)
+            return;
+
+        const std::size_t batch = shape.num_elem() / (m * n);
+        const auto product = [&](std::size_t b, const GemmOptions& product_options) {
+            std::size_t lhs_offset = 0;
+            std::size_t rhs_offset = 0;
+            for (std::size_t i = 0, rem = b; i < BatchDims; i++) {
+                const std::size_t idx = rem % batch_shape[i];
+                rem /= batch_shape[i];
+                lhs_offset += idx * lhs_strides[i];
+                rhs_offset += idx * rhs_strides[i];
+            }
+
+            impl::gemm_int8(m, n, k, lhs + lhs_offset * m * k, k, rhs + rhs_offset * k * n, n, c + b * m * n, n,
+                            Int8Epilogue<std::int32_t>{}, product_options);
+        };
+
+        // A few large products are threaded one by one, many small ones are shared out whole
+        const std::size_t available = gemm_available_threads(options);
+        if (batch == 1 || (batch < available && gemm_num_threads(m, n, k, available) > 1)) {
+            for (std::size_t b = 0; b < batch; b++)
+                product(b, options);
+            return;
+        }
+
+        const std::size_t threads = std::min(batch, gemm_num_threads(batch * m, n, k, available));
+        const GemmOptions single_thread{1, options.pool};
+        gemm_pool(options).parallel_for(batch, [&](std::size_t b) { product(b, single_thread); }, threads);
+    }
+
+    std::size_t m;
+    std::size_t n;
+    std::size_t k;
+    Shape<RetDims> shape;
+    // Indexed from the innermost batch dimension, in matrices
+    std::array<std::size_t, BatchDims> batch_shape{};
+    std::array<std::size_t, BatchDims> lhs_strides{};
+    std::array<std::size_t, BatchDims> rhs_strides{};
+};
+
+template<typename T, std::size_t TDims, typename U, std::size_t UDims>
+struct MatMul {
+    auto operator()(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs, const GemmOptions& options = {}) const {
+        using RetType = decltype(std::declval<T>() * std::declval<U>());
+
+        if constexpr (IsInt8<T>::value && IsInt8<U>::value) {
+            static_assert(std::is_same_v<RetType, std::int32_t>, "8-bit products are accumulated in 32 bits");
+
+            using Layout = MatMulLayout<TDims, UDims>;
+            const Layout layout{lhs.shape(), rhs.shape()};
+
+            auto ret = Tensor<RetType, Layout::RetDims>::empty(layout.shape);
+            layout.gemm_int8(lhs.data(), rhs.data(), ret.data(), options);
+
+            return ret;
+        }
+        else if constexpr (!(std::is_same_v<T, RetType> && std::is_same_v<U, RetType>)) {
+            return MatMul<RetType, TDims, RetType, UDims>{}(lhs, rhs, options);
+        }
+        else {
+            using Layout = MatMulLayout<TDims, UDims>;
+            const Layout layout{lhs.shape(), rhs.shape()};
+
+            auto ret = Tensor<RetType, Layout::RetDims>::empty(layout.shape);
+            layout.gemm(lhs.data(), rhs.data(), RetType{1}, RetType{0}, ret.data(), layout.n, options);
+
+            return ret;
+        }
+    }
+};
+
+// The GEMM form of an epilogue for an m x n product
+template<typename T>
+GemmEpilogue<T> gemm_epilogue(const Epilogue<T>& epilogue, std::size_t m, std::size_t n) {
+    GemmEpilogue<T> ret;
+    ret.activation = epilogue.activation;
+    ret.scale = epilogue.scale;
+
+    if (epilogue.bias != nullptr) {
+        ret.bias = epilogue.bias->data();
+        ret.bias_per_row = epilogue.bias_per_row;
+        assert(epilogue.bias->num_elem() == (epilogue.bias_per_row ? m : n) && "Incompatible bias shape");
+    }
+
+    if (epilogue.residual != nullptr) {
+        ret.residual = epilogue.residual->data();
+        ret.ldr = n;
+        assert(epilogue.residual->shape() == (Shape<2>{m, n}) && "Incompatible residual shape");
+    }
+
+    (void) m;
+    return ret;
+}
+
+// The operands in the element type of the output, converted only if they are not already
+template<typename V, typename T, std::size_t Dims>
+decltype(auto) as_type(const Tensor<T, Dims>& t) {
+    if constexpr (std::is_same_v<T, V>)
+        return t;
+    else
+        return Tensor<V, Dims>{t};
+}
+
+}
+
+template<typename T, std::size_t TDims, typename U, std::size_t UDims>
+auto matmul(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs, const GemmOptions& options = {}) {
+    return impl::MatMul<T, TDims, U, UDims>{}(lhs, rhs, options);
+}
+
+// out = alpha * matmul(lhs, rhs) + beta * out, without allocating the product. out has to have the shape of
+// matmul(lhs, rhs) and must not overlap the operands. As in BLAS, out is not read if beta is zero.
+template<typename V, std::size_t Dims, typename T, std::size_t TDims, typename U, std::size_t UDims>
+void matmul_into(Tensor<V, Dims>& out, const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs, V alpha = V{1},
+                 V beta = V{0}, const GemmOptions& options = {}) {
+    using Layout = impl::MatMulLayout<TDims, UDims>;
+    static_assert(Dims == Layout::RetDims, "The output has to have the dimensions of the product");
+
+    const Layout layout{lhs.shape(), rhs.shape()};
+    assert(out.shape() == layout.shape && "Incompatible output shape");
+
+    const auto& a = impl::as_type<V>(lhs);
+    const auto& b = impl::as_type<V>(rhs);
+    layout.gemm(a.data(), b.data(), alpha, beta, out.data(), layout.n, options);
+}
+
+// The same into a matrix view whose rows are contiguous
+template<typename V, typename T, typename U>
+void matmul_into(TensorView<V, 2> out, const Tensor<T, 2>& lhs, const Tensor<U, 2>& rhs, V alpha = V{1},
+                 V beta = V{0}, const GemmOptions& options = {}) {
+    const impl::MatMulLayout<2, 2> layout{lhs.shape(), rhs.shape()};
+    assert(out.shape() == layout.shape && "Incompatible output shape");
+    assert(out.stride()[1] == 1 && out.stride()[0] >= layout.n && "Rows of the output have to be contiguous");
+
+    const auto& a = impl::as_type<V>(lhs);
+    const auto& b = impl::as_type<V>(rhs);
+    layout.gemm(a.data(), b.data(), alpha, beta, out.data(), out.stride()[0], options);
+}
+
+// matmul(lhs, rhs) with the epilogue fused in
+template<typename V, typename T, typename U>
+Tensor<V, 2> matmul(const Tensor<T, 2>& lhs, const Tensor<U, 2>& rhs, const Epilogue<V>& epilogue,
+                    const GemmOptions& options = {}) {
+    const impl::MatMulLayout<2, 2> layout{lhs.shape(), rhs.shape()};
+    const auto gemm_epilogue = impl::gemm_epilogue(epilogue, layout.m, layout.n);
+
+    auto ret = Tensor<V, 2>::empty(layout.shape);
+    const auto& a = impl::as_type<V>(lhs);
+    const auto& b = impl::as_type<V>(rhs);
+    layout.gemm(a.data(), b.data(), V{1}, V{0}, ret.data(), layout.n, options, &gemm_epilogue);
+
+    return ret;
+}
+
+// out = epilogue(alpha * lhs x rhs + beta * out), the residual must not overlap out
+template<typename V, typename T, typename U>
+void matmul_into(Tensor<V, 2>& out, const Tensor<T, 2>& lhs, const Tensor<U, 2>& rhs, const Epilogue<V>& epilogue,
+                 V alpha = V{1}, V beta = V{0}, const GemmOptions& options = {}) {
+    const impl::MatMulLayout<2, 2> layout{lhs.shape(), rhs.shape()};
+    assert(out.shape() == layout.shape && "Incompatible output shape");
+    const auto gemm_epilogue = impl::gemm_epilogue(epilogue, layout.m, layout.n);
+
+    const auto& a = impl::as_type<V>(lhs);
+    const auto& b = impl::as_type<V>(rhs);
+    layout.gemm(a.data(), b.data(), alpha, beta, out.data(), layout.n, options, &gemm_epilogue);
+}
+
+// matmul and matmul_into with the expressions of ops.h as operands, which are evaluated first
+template<typename L, typename R, typename... Args> requires (impl::is_expression<L> || impl::is_expression<R>)
+auto matmul(const L& lhs, const R& rhs, const Args&... args) {
+    return matmul(impl::evaluated(lhs), impl::evaluated(rhs), args...);
+}
+
+template<typename Out, typename L, typename R, typename... Args>
+requires (impl::is_expression<L> || impl::is_expression<R>)
+void matmul_into(Out&& out, const L& lhs, const R& rhs, const Args&... args) {
+    matmul_into(std::forward<Out>(out), impl::evaluated(lhs), impl::evaluated(rhs), args...);
+}
+
+}
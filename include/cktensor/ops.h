@@ -1,29 +1,27 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <complex>
+#include <ostream>
+#include <type_traits>
+#include <utility>
 
+#include "broadcast.h"
+#include "matmul.h"
+#include "ops_simd.h"
 #include "tensor.h"
-#include "gemm.h"
-
-// TODO: Add inplace operators
+#include "thread_pool.h"
 
 namespace ck {
 
-// Implementation for the broadcasting ops
-class BroadcastError : public std::exception {
-};
-
 namespace impl {
 template<typename Op, typename T, typename U>
 struct RetScalarType {
     using type = decltype(std::declval<Op>()(std::declval<T>(), std::declval<U>()));
 };
 
-template<typename Op, typename T, std::size_t TDims, typename U, std::size_t UDims>
-struct RetTensorType {
-    using type = Tensor<RetScalarType<Op, T, U>, std::max(TDims, UDims)>;
-};
-
 template<typename T, typename U>
 struct Add {
     constexpr auto operator()(const T& lhs, const U& rhs) const {
@@ -108,169 +106,437 @@ struct Pow {
     }
 };
 
-template<std::size_t LHSDim, std::size_t RHSDim>
-auto broadcast_shape(const Shape<LHSDim>& lhs, const Shape<RHSDim>& rhs) {
-    Shape<std::max(LHSDim, RHSDim)> ret;
+template<typename T>
+struct Neg {
+    constexpr auto operator()(const T& val) const {
+        return -val;
+    }
+};
 
-    std::size_t i = 0;
-    for (; i < std::min(LHSDim, RHSDim); i++) {
-        if (lhs.rat(i) == rhs.rat(i)) {
-            ret.rat(i) = lhs.rat(i);
-        }
-        else if (lhs.rat(i) == 1) {
-            ret.rat(i) = rhs.rat(i);
-        }
-        else if (rhs.rat(i) == 1) {
-            ret.rat(i) = lhs.rat(i);
-        }
-        else {
-            throw BroadcastError{};
-        }
+template<typename T>
+struct Not {
+    constexpr auto operator()(const T& val) const {
+        return !val;
     }
+};
 
-    if constexpr (LHSDim > RHSDim) {
-        for (; i < LHSDim; i++) {
-            ret.rat(i) = lhs.rat(i);
-        }
+// A tensor in an expression. Lvalues are referred to, and temporaries are owned so that the expression can outlive
+// the statement that created it.
+template<typename T, std::size_t Dims, bool Owner>
+class TensorOperand {
+public:
+    using ValueType = T;
+    static constexpr std::size_t dims = Dims;
+
+    template<typename X>
+    TensorOperand(X&& tensor) : tensor_(std::forward<X>(tensor)) {}
+
+    const Shape<Dims>& shape() const {
+        return tensor_.shape();
+    }
+
+    // A tensor of a shape the result is broadcast from, with as many elements, has the same layout
+    bool flat(std::size_t num_elem) const {
+        return tensor_.num_elem() == num_elem;
     }
-    else if constexpr (RHSDim > LHSDim) {
-        for (; i < RHSDim; i++) {
-            ret.rat(i) = rhs.rat(i);
+
+    template<std::size_t OutDims>
+    TensorCursor<T, OutDims> cursor(const Shape<OutDims>&) const {
+        TensorCursor<T, OutDims> cursor{tensor_.data(), {}, tensor_.data()};
+        std::size_t stride = 1;
+        for (std::size_t i = 0; i < Dims; i++) {
+            const std::size_t dim = tensor_.shape().rat(i);
+            cursor.strides[OutDims - i - 1] = dim == 1 ? 0 : stride;
+            stride *= dim;
         }
+        return cursor;
     }
 
-    return ret;
-}
+private:
+    std::conditional_t<Owner, Tensor<T, Dims>, const Tensor<T, Dims>&> tensor_;
+};
 
-template<typename Op, std::size_t dims, std::size_t curr_dim>
-void binary_op_broadcasting_impl(const auto*& lhs, const std::size_t* lhs_shape,
-                                 const auto*& rhs, const std::size_t* rhs_shape,
-                                 auto*& out) {
-    Op op;
+template<typename T>
+class ScalarOperand {
+public:
+    using ValueType = T;
+    static constexpr std::size_t dims = 0;
 
-    if constexpr (curr_dim == dims) {
-        *out = op(*lhs, *rhs);
-        lhs++;
-        rhs++;
-        out++;
-        return;
+    ScalarOperand(const T& value) : value_{value} {}
+
+    Shape<0> shape() const {
+        return {};
     }
-    else {
-        if (*lhs_shape == *rhs_shape) {
-            for (std::size_t i = 0; i < *lhs_shape; i++) {
-                binary_op_broadcasting_impl<Op, dims, curr_dim + 1>(lhs, lhs_shape + 1, rhs, rhs_shape + 1, out);
-            }
-        }
-        else if (*lhs_shape == 1) {
-            for (std::size_t i = 0; i < *rhs_shape; i++) {
-                auto lhs_begin = lhs;
-                binary_op_broadcasting_impl<Op, dims, curr_dim + 1>(lhs, lhs_shape + 1, rhs, rhs_shape + 1, out);
-
-                if (i != *rhs_shape - 1)
-                    lhs = lhs_begin;
-            }
-        }
-        else if (*rhs_shape == 1) {
-            for (std::size_t i = 0; i < *lhs_shape; i++) {
-                auto rhs_begin = rhs;
-                binary_op_broadcasting_impl<Op, dims, curr_dim + 1>(lhs, lhs_shape + 1, rhs, rhs_shape + 1, out);
-
-                if (i != *lhs_shape - 1)
-                    rhs = rhs_begin;
-            }
-        }
+
+    bool flat(std::size_t) const {
+        return true;
+    }
+
+    template<std::size_t OutDims>
+    ScalarCursor<T> cursor(const Shape<OutDims>&) const {
+        return {value_};
     }
+
+private:
+    T value_;
+};
+
+// The operand type of an argument of the operators: tensors as above, expressions by reference when they are
+// lvalues and by value otherwise, and anything else as a scalar
+template<typename X, typename V = std::remove_cvref_t<X>>
+struct Operand {
+    using type = std::conditional_t<!is_expression<X>, ScalarOperand<V>,
+                                    std::conditional_t<std::is_lvalue_reference_v<X>, const V&, V>>;
+};
+
+template<typename X, typename T, std::size_t Dims>
+struct Operand<X, Tensor<T, Dims>> {
+    using type = TensorOperand<T, Dims, !std::is_lvalue_reference_v<X>>;
+};
+
+// The operators build expressions when either operand is a tensor or an expression
+template<typename L, typename R>
+constexpr bool expression_operands = expression_operand<L> || expression_operand<R>;
 }
 
-template<typename Op, typename T, std::size_t TDims, typename U, std::size_t UDims>
-struct BinaryOpBroadcasting {
-    using RetType = typename RetScalarType<Op, T, U>::type;
+// The result of the elementwise operators. Nothing is computed until a tensor is constructed from or assigned the
+// expression, or a reduction is called, and then the whole expression is evaluated in a single loop without the
+// temporaries of the intermediate results. The expression refers to the lvalue tensors it is built from, which
+// must outlive it, and owns the temporary ones.
+template<typename E>
+class TensorExpression : public impl::ExpressionBase {
+public:
+    std::size_t num_elem() const {
+        return self().shape().num_elem();
+    }
+
+    auto eval() const {
+        return Tensor<typename E::ValueType, E::dims>{self()};
+    }
+
+    template<typename U>
+    auto as() const {
+        return Tensor<U, E::dims>{self()};
+    }
 
-    constexpr auto operator()(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) const {
-        auto out_shape = broadcast_shape(lhs.shape(), rhs.shape());
-        Tensor<RetType, TDims> out{out_shape};
-        Shape<out_shape.dims()> lhs_shape;
-        for (std::size_t i = 0; i < TDims; i++)
-            lhs_shape.rat(i) = lhs.shape().rat(i);
-        for (std::size_t i = TDims; i < out_shape.dims(); i++)
-            lhs_shape.rat(i) = 1;
+    // Computes a single element
+    template<typename... Indices>
+    auto at(Indices... indices) const {
+        static_assert(sizeof...(Indices) == E::dims, "An index is needed for each dimension");
+        std::array<std::size_t, E::dims> index{static_cast<std::size_t>(indices)...};
+        auto cursor = self().template cursor<E::dims>(self().shape());
+        cursor.seek(index);
+        return cursor[0];
+    }
 
-        Shape<out_shape.dims()> rhs_shape;
-        for (std::size_t i = 0; i < UDims; i++)
-            rhs_shape.rat(i) = rhs.shape().rat(i);
-        for (std::size_t i = UDims; i < out_shape.dims(); i++)
-            rhs_shape.rat(i) = 1;
+    template<typename... Indices>
+    auto operator()(Indices... indices) const {
+        return at(indices...);
+    }
 
-        auto* lhs_data = lhs.data();
-        auto* rhs_data = rhs.data();
-        auto* out_data = out.data();
+    /* Copying transformations of the evaluated expression */
 
-        binary_op_broadcasting_impl<Op, out_shape.dims(), 0>(lhs_data, lhs_shape.data(), rhs_data, rhs_shape.data(),
-                                                             out_data);
+    template<std::size_t TargetDims>
+    auto reshape(Shape<TargetDims> new_shape) const {
+        return eval().reshape(new_shape);
+    }
 
-        return out;
+    auto transpose() const {
+        return eval().transpose();
     }
-};
 
-template<typename Op, typename T, std::size_t TDims, typename U, std::size_t UDims>
-struct BinaryOpSameShape {
-    using RetType = typename RetScalarType<Op, T, U>::type;
+    /* Reductions */
+
+    auto min() const {
+        auto ret = front();
+        impl::for_each_element(self(), [&](std::size_t, const auto& el) { ret = el < ret ? el : ret; });
+        return ret;
+    }
 
-    constexpr auto operator()(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) const {
-        Op op;
+    auto max() const {
+        auto ret = front();
+        impl::for_each_element(self(), [&](std::size_t, const auto& el) { ret = ret < el ? el : ret; });
+        return ret;
+    }
 
-        Tensor<RetType, TDims> res{lhs.shape()};
+    auto sum() const {
+        using T = typename E::ValueType;
+        T ret{};
+        impl::for_each_element(self(), [&](std::size_t, const T& el) { ret = ret + el; });
+        return ret;
+    }
 
-        for (std::size_t i = 0; i < lhs.num_elem(); i++) {
-            res.data()[i] = op(lhs.data()[i], rhs.data()[i]);
-        }
+    auto mean() const {
+        using T = typename E::ValueType;
+        return static_cast<T>(sum() / num_elem());
+    }
+
+    // Evaluates the expression twice rather than keeping it
+    auto var() const {
+        using T = typename E::ValueType;
+        const T m = mean();
+        T ret{};
+        impl::for_each_element(self(), [&](std::size_t, const T& el) {
+            const auto diff = el - m;
+            ret = diff * diff + ret;
+        });
+        return static_cast<T>(ret / num_elem());
+    }
+
+    auto std() const {
+        return std::sqrt(var());
+    }
+
+    std::size_t count_nonzero() const {
+        using T = typename E::ValueType;
+        std::size_t count = 0;
+        impl::for_each_element(self(), [&](std::size_t, const T& el) { count += el != T{0}; });
+        return count;
+    }
+
+private:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
 
-        return res;
+    auto front() const {
+        assert(num_elem() != 0 && "The expression has no elements");
+        auto cursor = self().template cursor<E::dims>(self().shape());
+        cursor.seek(std::array<std::size_t, E::dims>{});
+        return cursor[0];
     }
 };
 
-// TODO: I can optionally construct the return value inside this function and pass a reference to the impl functions
-template<typename Op, typename T, std::size_t TDims, typename U, std::size_t UDims>
-struct BinaryOp {
-    constexpr auto operator()(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) const {
-        if constexpr (TDims == UDims) {
-            if (lhs.shape() == rhs.shape()) {
-                return BinaryOpSameShape<Op, T, TDims, U, UDims>{}(lhs, rhs);
-            }
-        }
+namespace impl {
+template<template<typename, typename> typename Op, typename L, typename R>
+class BinaryExpression : public TensorExpression<BinaryExpression<Op, L, R>> {
+    using LHS = std::remove_cvref_t<L>;
+    using RHS = std::remove_cvref_t<R>;
+    using OpType = Op<typename LHS::ValueType, typename RHS::ValueType>;
+
+public:
+    using ValueType = typename RetScalarType<OpType, typename LHS::ValueType, typename RHS::ValueType>::type;
+    static constexpr std::size_t dims = std::max(LHS::dims, RHS::dims);
+
+    template<typename LArg, typename RArg>
+    BinaryExpression(LArg&& lhs, RArg&& rhs)
+            : lhs_(std::forward<LArg>(lhs)), rhs_(std::forward<RArg>(rhs)),
+              shape_{broadcast_shape(lhs_.shape(), rhs_.shape())} {}
+
+    const Shape<dims>& shape() const {
+        return shape_;
+    }
 
-        return BinaryOpBroadcasting<Op, T, TDims, U, UDims>{}(lhs, rhs);
+    bool flat(std::size_t num_elem) const {
+        return lhs_.flat(num_elem) && rhs_.flat(num_elem);
     }
+
+    template<std::size_t OutDims>
+    auto cursor(const Shape<OutDims>& out_shape) const {
+        auto lhs = lhs_.template cursor<OutDims>(out_shape);
+        auto rhs = rhs_.template cursor<OutDims>(out_shape);
+        return BinaryCursor<OpType, decltype(lhs), decltype(rhs)>{{}, lhs, rhs};
+    }
+
+private:
+    L lhs_;
+    R rhs_;
+    Shape<dims> shape_;
 };
 
-template<typename Op, typename T, std::size_t TDims, typename U>
-struct BinaryOp<Op, T, TDims, U, 0> {
-    using RetType = typename RetScalarType<Op, T, U>::type;
+template<template<typename> typename Op, typename A>
+class UnaryExpression : public TensorExpression<UnaryExpression<Op, A>> {
+    using Arg = std::remove_cvref_t<A>;
+    using OpType = Op<typename Arg::ValueType>;
 
-    constexpr auto operator()(const Tensor<T, TDims>& lhs, const U& rhs) const {
-        Op op;
+public:
+    using ValueType = decltype(std::declval<OpType>()(std::declval<typename Arg::ValueType>()));
+    static constexpr std::size_t dims = Arg::dims;
 
-        Tensor<RetType, TDims> res{lhs.shape()};
+    template<typename X> requires (!std::is_same_v<std::remove_cvref_t<X>, UnaryExpression>)
+    explicit UnaryExpression(X&& arg) : arg_(std::forward<X>(arg)) {}
 
-        for (std::size_t i = 0; i < lhs.num_elem(); i++) {
-            res.data()[i] = op(lhs.data()[i], rhs);
-        }
+    const Shape<dims>& shape() const {
+        return arg_.shape();
+    }
 
-        return res;
+    bool flat(std::size_t num_elem) const {
+        return arg_.flat(num_elem);
     }
 
-    constexpr auto operator()(const U& lhs, const Tensor<T, TDims>& rhs) const {
-        Op op;
+    template<std::size_t OutDims>
+    auto cursor(const Shape<OutDims>& out_shape) const {
+        auto arg = arg_.template cursor<OutDims>(out_shape);
+        return UnaryCursor<OpType, decltype(arg)>{{}, arg};
+    }
 
-        Tensor<RetType, TDims> res{rhs.shape()};
+private:
+    A arg_;
+};
 
-        for (std::size_t i = 0; i < rhs.num_elem(); i++) {
-            res.data()[i] = op(lhs, rhs.data()[i]);
-        }
+template<template<typename, typename> typename Op, typename L, typename R>
+auto make_expression(L&& lhs, R&& rhs) {
+    using Expr = BinaryExpression<Op, typename Operand<L>::type, typename Operand<R>::type>;
+    return Expr{std::forward<L>(lhs), std::forward<R>(rhs)};
+}
 
-        return res;
-    }
+template<template<typename> typename Op, typename X>
+auto make_expression(X&& arg) {
+    return UnaryExpression<Op, typename Operand<X>::type>{std::forward<X>(arg)};
+}
+
+// The element type of the tensor operands of an operation
+template<typename L, typename R>
+struct OperandsElement {
+    using type = typename R::ValueType;
+};
+
+template<typename T, std::size_t Dims, bool Owner, typename R>
+struct OperandsElement<TensorOperand<T, Dims, Owner>, R> {
+    using type = T;
+};
+
+// Scalars are computed in the element type of the tensor if the operator converts them to it anyway
+template<typename X, typename T>
+struct VectorizedOperand : std::false_type {};
+
+template<typename T, std::size_t Dims, bool Owner>
+struct VectorizedOperand<TensorOperand<T, Dims, Owner>, T> : std::true_type {};
+
+template<typename T, typename U>
+struct IsCommonType : std::is_same<std::common_type_t<T, U>, T> {};
+
+template<typename U, typename T>
+struct VectorizedOperand<ScalarOperand<U>, T>
+        : std::conjunction<std::is_arithmetic<U>, std::is_arithmetic<T>, IsCommonType<T, U>> {};
+
+// Single operators on tensors evaluated into a tensor of their result type use the loops of ops_simd.h
+template<typename E, typename Out>
+struct VectorizedExpression : std::false_type {};
+
+template<template<typename, typename> typename Op, typename L, typename R, typename Out>
+struct VectorizedExpression<BinaryExpression<Op, L, R>, Out> {
+    using T = typename OperandsElement<L, R>::type;
+    static constexpr bool value = vectorized_elementwise<Op, T> && VectorizedOperand<L, T>::value &&
+                                  VectorizedOperand<R, T>::value && std::is_same_v<ElementwiseResult<Op, T>, Out>;
 };
+
+template<typename T, typename C>
+T row_operand(const C& cursor) {
+    if constexpr (C::leaves == 0)
+        return static_cast<T>(cursor.value);
+    else
+        return *cursor.row;
+}
+
+template<typename T, typename C>
+const T* row_pointer(const C& cursor) {
+    if constexpr (C::leaves == 0)
+        return nullptr;
+    else
+        return cursor.row;
+}
+
+// Calls g(lhs_single, rhs_single, lhs, rhs, i, cols) for the rows of the elements [begin, end) of an operator on
+// tensors and scalars, where lhs_single and rhs_single are std::bool_constant telling whether the operand is a single
+// value for the row
+template<template<typename, typename> typename Op, typename L, typename R, typename G>
+void for_each_operand_row(const BinaryExpression<Op, L, R>& expr, G g, std::size_t begin, std::size_t end) {
+    using T = typename OperandsElement<L, R>::type;
+    constexpr bool lhs_scalar = L::dims == 0;
+    constexpr bool rhs_scalar = R::dims == 0;
+
+    for_each_row(expr, [&](std::size_t i, const auto& cursor, std::size_t cols, std::size_t mask) {
+        // The tensors broadcast along the row are scalars too
+        const bool lhs_single = lhs_scalar || (mask & 1) != 0;
+        const bool rhs_single = rhs_scalar || (mask >> (lhs_scalar ? 0 : 1) & 1) != 0;
+        const T lhs_value = row_operand<T>(cursor.lhs);
+        const T rhs_value = row_operand<T>(cursor.rhs);
+        const T* lhs = lhs_single ? &lhs_value : row_pointer<T>(cursor.lhs);
+        const T* rhs = rhs_single ? &rhs_value : row_pointer<T>(cursor.rhs);
+
+        if (lhs_single && rhs_single)
+            g(std::true_type{}, std::true_type{}, lhs, rhs, i, cols);
+        else if (lhs_single)
+            g(std::true_type{}, std::false_type{}, lhs, rhs, i, cols);
+        else if (rhs_single)
+            g(std::false_type{}, std::true_type{}, lhs, rhs, i, cols);
+        else
+            g(std::false_type{}, std::false_type{}, lhs, rhs, i, cols);
+    }, begin, end);
+}
+
+template<template<typename, typename> typename Op, typename L, typename R, typename Out, std::size_t Dims>
+void evaluate_vectorized(const BinaryExpression<Op, L, R>& expr, Tensor<Out, Dims>& out, std::size_t begin,
+                         std::size_t end) {
+    using T = typename OperandsElement<L, R>::type;
+    Out* data = out.data();
+
+    for_each_operand_row(expr, [data](auto lhs_single, auto rhs_single, const T* lhs, const T* rhs, std::size_t i,
+                                      std::size_t cols) {
+        constexpr bool l = decltype(lhs_single)::value;
+        constexpr bool r = decltype(rhs_single)::value;
+        if constexpr (l && r)
+            elementwise_scalar<Op, T, true, true>(lhs, rhs, data + i, cols);
+        else
+            elementwise_kernel<Op, T, l, r>()(lhs, rhs, data + i, cols);
+    }, begin, end);
+}
+
+// Large results are split into ranges for the threads of the pool, see parallel_threshold()
+template<typename T, std::size_t Dims, typename E>
+void evaluate(const E& expr, Tensor<T, Dims>& out) {
+    T* data = out.data();
+    parallel_elementwise(out.num_elem(), data, sizeof(T), [&](std::size_t begin, std::size_t end) {
+        if constexpr (VectorizedExpression<E, T>::value)
+            evaluate_vectorized(expr, out, begin, end);
+        else
+            for_each_element(expr, [data](std::size_t i, const auto& el) { data[i] = static_cast<T>(el); }, begin,
+                             end);
+    });
+}
+
+// Evaluates the expression into a tensor of its shape, or throws a BroadcastError for an output of another shape.
+// The elements of out are only read by the expression at the index they are written to, so out may be one of its
+// operands.
+template<typename T, std::size_t Dims, typename E>
+void evaluate_into(const E& expr, Tensor<T, Dims>& out) {
+    static_assert(E::dims == Dims, "The output has to have the dimensions of the result");
+    if (out.shape() != expr.shape())
+        throw BroadcastError{};
+    evaluate(expr, out);
+}
+}
+
+template<typename T, std::size_t Dims>
+template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+Tensor<T, Dims>::Tensor(const E& expr) : Tensor(expr.shape()) {
+    impl::evaluate(expr, *this);
+}
+
+template<typename T, std::size_t Dims>
+template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+Tensor<T, Dims>& Tensor<T, Dims>::operator=(const E& expr) {
+    // When the shapes are the same, the elements of this tensor are only read by the expression at the index they
+    // are written to
+    if (shape() == expr.shape())
+        impl::evaluate(expr, *this);
+    else
+        *this = Tensor(expr);
+    return *this;
+}
+
+template<typename L, typename R> requires (impl::is_expression<L> || impl::is_expression<R>)
+bool is_equal(const L& lhs, const R& rhs) {
+    if constexpr (impl::is_expression<L>)
+        return is_equal(lhs.eval(), rhs);
+    else
+        return is_equal(lhs, rhs.eval());
+}
+
+template<typename E> requires impl::is_expression<E>
+std::ostream& operator<<(std::ostream& os, const E& expr) {
+    return os << expr.eval();
 }
 
 /* Unary operators */
@@ -296,240 +562,188 @@ Tensor<T, Dims> Tensor<T, Dims>::operator-() const {
 /* Inplace operators */
 
 template<typename T, std::size_t Dims>
-Tensor<T, Dims>& Tensor<T, Dims>::operator+=(const Tensor<T, Dims>& other) {
-    assert(shape() == other.shape());
-
-    for (size_t i = 0; i < num_elem(); ++i) {
-        data_[i] += other.data_[i];
-    }
+template<typename X>
+Tensor<T, Dims>& Tensor<T, Dims>::operator+=(const X& other) {
+    impl::evaluate_into(impl::make_expression<impl::Add>(*this, other), *this);
     return *this;
 }
 
 template<typename T, std::size_t Dims>
-Tensor<T, Dims>& Tensor<T, Dims>::operator-=(const Tensor<T, Dims>& other) {
-    assert(shape() == other.shape());
-
-    for (size_t i = 0; i < num_elem(); ++i) {
-        data_[i] -= other.data_[i];
-    }
+template<typename X>
+Tensor<T, Dims>& Tensor<T, Dims>::operator-=(const X& other) {
+    impl::evaluate_into(impl::make_expression<impl::Sub>(*this, other), *this);
     return *this;
 }
 
 template<typename T, std::size_t Dims>
-Tensor<T, Dims>& Tensor<T, Dims>::operator*=(const Tensor<T, Dims>& other) {
-    assert(shape() == other.shape());
-
-    for (size_t i = 0; i < num_elem(); ++i) {
-        data_[i] *= other.data_[i];
-    }
+template<typename X>
+Tensor<T, Dims>& Tensor<T, Dims>::operator*=(const X& other) {
+    impl::evaluate_into(impl::make_expression<impl::Mul>(*this, other), *this);
     return *this;
 }
 
 template<typename T, std::size_t Dims>
-Tensor<T, Dims>& Tensor<T, Dims>::operator/=(const Tensor<T, Dims>& other) {
-    assert(shape() == other.shape());
-
-    for (size_t i = 0; i < num_elem(); ++i) {
-        data_[i] /= other.data_[i];
-    }
+template<typename X>
+Tensor<T, Dims>& Tensor<T, Dims>::operator/=(const X& other) {
+    impl::evaluate_into(impl::make_expression<impl::Div>(*this, other), *this);
     return *this;
 }
 
 template<typename T, std::size_t Dims>
-Tensor<T, Dims>& Tensor<T, Dims>::operator%=(const Tensor<T, Dims>& other) {
-    assert(shape() == other.shape());
-
-    for (size_t i = 0; i < num_elem(); ++i) {
-        data_[i] %= other.data_[i];
-    }
+template<typename X>
+Tensor<T, Dims>& Tensor<T, Dims>::operator%=(const X& other) {
+    impl::evaluate_into(impl::make_expression<impl::Mod>(*this, other), *this);
     return *this;
 }
 
-/* Binary operators */
+/* Unary operators of expressions */
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator+(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Add<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename E> requires impl::is_expression<E>
+auto operator-(E&& expr) {
+    return impl::make_expression<impl::Neg>(std::forward<E>(expr));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator+(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Add<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename E> requires impl::is_expression<E>
+auto operator!(E&& expr) {
+    return impl::make_expression<impl::Not>(std::forward<E>(expr));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator+(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Add<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator-(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Sub<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U>
-auto operator-(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Sub<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U>
-auto operator-(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Sub<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator*(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Mul<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U>
-auto operator*(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Mul<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
-
-template<typename T, std::size_t TDims, typename U>
-auto operator*(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Mul<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
+/* Binary operators */
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator/(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Div<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+// Tensors, expressions and scalars in any combination, with broadcasting
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator+(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Add>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator/(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Div<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator-(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Sub>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator/(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Div<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator*(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Mul>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator%(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Mod<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator/(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Div>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator%(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Mod<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator%(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Mod>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator%(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Mod<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator==(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Eq>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator==(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Eq<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator!=(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Neq>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator==(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Eq<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator<(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Lt>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator==(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Eq<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator<=(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Le>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator!=(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Neq<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator>(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Gt>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator!=(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Neq<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto operator>=(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Ge>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator!=(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Neq<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R> requires impl::expression_operands<L, R>
+auto pow(L&& lhs, R&& rhs) {
+    return impl::make_expression<impl::Pow>(std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator<(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Lt<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
-}
 
-template<typename T, std::size_t TDims, typename U>
-auto operator<(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Lt<T, U>, T, TDims, U, 0>{}(lhs, rhs);
-}
+/* Operators into an existing tensor */
 
-template<typename T, std::size_t TDims, typename U>
-auto operator<(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Lt<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+// out = lhs + rhs and so on without allocating. out has to have the broadcast shape of the operands, and it may be
+// one of them.
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void add(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Add>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator<=(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Le<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void sub(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Sub>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator<=(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Le<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void mul(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Mul>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator<=(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Le<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void div(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Div>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator>(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Gt<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void mod(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Mod>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator>(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Gt<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void eq(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Eq>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator>(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Gt<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void neq(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Neq>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto operator>=(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Ge<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void lt(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Lt>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator>=(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Ge<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void le(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Le>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto operator>=(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Ge<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void gt(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Gt>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto pow(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::BinaryOp<impl::Pow<T, U>, T, TDims, U, UDims>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void ge(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Ge>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto pow(const Tensor<T, TDims>& lhs, const U& rhs) {
-    return impl::BinaryOp<impl::Pow<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename L, typename R, typename T, std::size_t Dims> requires impl::expression_operands<L, R>
+void pow(L&& lhs, R&& rhs, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Pow>(std::forward<L>(lhs), std::forward<R>(rhs)), out);
 }
 
-template<typename T, std::size_t TDims, typename U>
-auto pow(const U& lhs, const Tensor<T, TDims>& rhs) {
-    return impl::BinaryOp<impl::Pow<T, U>, T, TDims, U, 0>{}(lhs, rhs);
+template<typename X, typename T, std::size_t Dims> requires impl::expression_operand<X>
+void neg(X&& arg, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Neg>(std::forward<X>(arg)), out);
 }
 
-template<typename T, std::size_t TDims, typename U, std::size_t UDims>
-auto matmul(const Tensor<T, TDims>& lhs, const Tensor<U, UDims>& rhs) {
-    return impl::MatMul<T, TDims, U, UDims>{}(lhs, rhs);
+template<typename X, typename T, std::size_t Dims> requires impl::expression_operand<X>
+void logical_not(X&& arg, Tensor<T, Dims>& out) {
+    impl::evaluate_into(impl::make_expression<impl::Not>(std::forward<X>(arg)), out);
 }
 
 }
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "cpu.h"
+#include "traits.h"
+
+
+// Vectorized loops of the elementwise operators, out[i] = op(lhs[i], rhs[i]) where either operand may be a single
+// value instead, for float, double, int32 and int64 tensors. They cover the arithmetic operators and the
+// comparisons, whose lanes are narrowed to bools. Integer division has no vector instruction, and a vector pow
+// would not round like std::pow, so these stay scalar.
+// The stores are aligned: a scalar head runs up to the first aligned element of out, and a scalar tail after the
+// last full vector.
+// The comparisons also have loops that pack their results into 64 bit words for the masks of mask.h, using the
+// compare and movemask instructions.
+
+namespace ck::impl {
+
+template<typename T, typename U>
+struct Add;
+
+template<typename T, typename U>
+struct Sub;
+
+template<typename T, typename U>
+struct Mul;
+
+template<typename T, typename U>
+struct Div;
+
+template<typename T, typename U>
+struct Eq;
+
+template<typename T, typename U>
+struct Neq;
+
+template<typename T, typename U>
+struct Lt;
+
+template<typename T, typename U>
+struct Le;
+
+template<typename T, typename U>
+struct Gt;
+
+template<typename T, typename U>
+struct Ge;
+
+enum class ElementwiseOp {
+    None,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Eq,
+    Neq,
+    Lt,
+    Le,
+    Gt,
+    Ge
+};
+
+template<template<typename, typename> typename Op>
+struct ElementwiseOpOf {
+    static constexpr ElementwiseOp value = ElementwiseOp::None;
+};
+
+template<>
+struct ElementwiseOpOf<Add> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Add;
+};
+
+template<>
+struct ElementwiseOpOf<Sub> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Sub;
+};
+
+template<>
+struct ElementwiseOpOf<Mul> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Mul;
+};
+
+template<>
+struct ElementwiseOpOf<Div> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Div;
+};
+
+template<>
+struct ElementwiseOpOf<Eq> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Eq;
+};
+
+template<>
+struct ElementwiseOpOf<Neq> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Neq;
+};
+
+template<>
+struct ElementwiseOpOf<Lt> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Lt;
+};
+
+template<>
+struct ElementwiseOpOf<Le> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Le;
+};
+
+template<>
+struct ElementwiseOpOf<Gt> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Gt;
+};
+
+template<>
+struct ElementwiseOpOf<Ge> {
+    static constexpr ElementwiseOp value = ElementwiseOp::Ge;
+};
+
+// Whether Op on two T has a vectorized loop
+template<template<typename, typename> typename Op, typename T>
+constexpr bool vectorized_elementwise = IsOneOf<T, float, double, std::int32_t, std::int64_t>::value &&
+                                        ElementwiseOpOf<Op>::value != ElementwiseOp::None &&
+                                        (ElementwiseOpOf<Op>::value != ElementwiseOp::Div ||
+                                         std::is_floating_point_v<T>);
+
+template<template<typename, typename> typename Op, typename T>
+using ElementwiseResult = std::remove_cvref_t<decltype(std::declval<Op<T, T>>()(std::declval<T>(), std::declval<T>()))>;
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+void elementwise_scalar(const T* lhs, const T* rhs, ElementwiseResult<Op, T>* out, std::size_t n) {
+    const Op<T, T> op;
+    for (std::size_t i = 0; i < n; i++)
+        out[i] = op(LhsScalar ? *lhs : lhs[i], RhsScalar ? *rhs : rhs[i]);
+}
+
+template<template<typename, typename> typename Op>
+constexpr bool is_comparison = ElementwiseOpOf<Op>::value >= ElementwiseOp::Eq;
+
+// Sets the bits [first, first + n) of words to the results. A word is assigned at its bit 0 and or-ed into after,
+// so the words are written in order without being cleared first.
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+void compare_bits_scalar(const T* lhs, const T* rhs, std::uint64_t* words, std::size_t first, std::size_t n) {
+    const Op<T, T> op;
+    for (std::size_t j = 0; j < n; j++) {
+        const std::size_t bit = first + j;
+        const std::uint64_t value = std::uint64_t{op(LhsScalar ? *lhs : lhs[j], RhsScalar ? *rhs : rhs[j])}
+                << bit % 64;
+        if (bit % 64 == 0)
+            words[bit / 64] = value;
+        else
+            words[bit / 64] |= value;
+    }
+}
+
+#ifdef CKTENSOR_X86
+
+// Lanes of -1 where the comparison holds and 0 elsewhere. The vectors are passed by reference, as they are wider
+// than the registers of the default target.
+template<ElementwiseOp Kind, typename V, typename M>
+CKTENSOR_ALWAYS_INLINE void compare_lanes(const V& l, const V& r, M& lanes) {
+    if constexpr (Kind == ElementwiseOp::Eq)
+        lanes = l == r;
+    else if constexpr (Kind == ElementwiseOp::Neq)
+        lanes = l != r;
+    else if constexpr (Kind == ElementwiseOp::Lt)
+        lanes = l < r;
+    else if constexpr (Kind == ElementwiseOp::Le)
+        lanes = l <= r;
+    else if constexpr (Kind == ElementwiseOp::Gt)
+        lanes = l > r;
+    else
+        lanes = l >= r;
+}
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar, std::size_t Bytes>
+CKTENSOR_ALWAYS_INLINE void elementwise_simd(const T* lhs, const T* rhs, ElementwiseResult<Op, T>* out,
+                                             std::size_t n) {
+    using R = ElementwiseResult<Op, T>;
+    using V = typename SimdVec<T, Bytes>::type;
+    constexpr std::size_t W = SimdVec<T, Bytes>::width;
+    constexpr ElementwiseOp kind = ElementwiseOpOf<Op>::value;
+
+    // Comparisons store a byte per lane
+    using Lane = std::conditional_t<std::is_same_v<R, bool>, std::uint8_t, R>;
+    constexpr std::size_t OutBytes = W * sizeof(Lane);
+    typedef Lane Out __attribute__((vector_size(OutBytes), may_alias));
+
+    const Op<T, T> op;
+    std::size_t i = 0;
+    for (; i < n && reinterpret_cast<std::uintptr_t>(out + i) % OutBytes != 0; i++)
+        out[i] = op(LhsScalar ? *lhs : lhs[i], RhsScalar ? *rhs : rhs[i]);
+
+    const V lhs_value = LhsScalar ? V{} + *lhs : V{};
+    const V rhs_value = RhsScalar ? V{} + *rhs : V{};
+    for (; i + W <= n; i += W) {
+        const V l = LhsScalar ? lhs_value : *reinterpret_cast<const V*>(lhs + i);
+        const V r = RhsScalar ? rhs_value : *reinterpret_cast<const V*>(rhs + i);
+        Out& dst = *reinterpret_cast<Out*>(out + i);
+
+        // The lanes of the comparisons are -1 or 0
+        if constexpr (kind == ElementwiseOp::Add)
+            dst = l + r;
+        else if constexpr (kind == ElementwiseOp::Sub)
+            dst = l - r;
+        else if constexpr (kind == ElementwiseOp::Mul)
+            dst = l * r;
+        else if constexpr (kind == ElementwiseOp::Div)
+            dst = l / r;
+        else {
+            decltype(l < r) lanes;
+            compare_lanes<kind>(l, r, lanes);
+            dst = __builtin_convertvector(-lanes, Out);
+        }
+    }
+
+    for (; i < n; i++)
+        out[i] = op(LhsScalar ? *lhs : lhs[i], RhsScalar ? *rhs : rhs[i]);
+}
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+CKTENSOR_TARGET_AVX2
+void avx2_elementwise(const T* lhs, const T* rhs, ElementwiseResult<Op, T>* out, std::size_t n) {
+    elementwise_simd<Op, T, LhsScalar, RhsScalar, 32>(lhs, rhs, out, n);
+}
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+CKTENSOR_TARGET_AVX512
+void avx512_elementwise(const T* lhs, const T* rhs, ElementwiseResult<Op, T>* out, std::size_t n) {
+    elementwise_simd<Op, T, LhsScalar, RhsScalar, 64>(lhs, rhs, out, n);
+}
+
+// The movemask instructions take the sign bits of the lanes and cannot be inlined into code without the target,
+// hence the words are built here rather than in a common body
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+CKTENSOR_TARGET_AVX2
+void avx2_compare_bits(const T* lhs, const T* rhs, std::uint64_t* words, std::size_t first, std::size_t n) {
+    using V = typename SimdVec<T, 32>::type;
+    constexpr std::size_t W = SimdVec<T, 32>::width;
+
+    const std::size_t head = std::min(n, (64 - first % 64) % 64);
+    compare_bits_scalar<Op, T, LhsScalar, RhsScalar>(lhs, rhs, words, first, head);
+
+    const V lhs_value = LhsScalar ? V{} + *lhs : V{};
+    const V rhs_value = RhsScalar ? V{} + *rhs : V{};
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        std::uint64_t word = 0;
+        for (std::size_t k = 0; k < 64; k += W) {
+            const V l = LhsScalar ? lhs_value : *reinterpret_cast<const V*>(lhs + i + k);
+            const V r = RhsScalar ? rhs_value : *reinterpret_cast<const V*>(rhs + i + k);
+            decltype(l < r) lanes;
+            compare_lanes<ElementwiseOpOf<Op>::value>(l, r, lanes);
+            if constexpr (sizeof(T) == 4)
+                word |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_ps(reinterpret_cast<const __m256&>(
+                        lanes)))) << k;
+            else
+                word |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_pd(reinterpret_cast<const __m256d&>(
+                        lanes)))) << k;
+        }
+        words[(first + i) / 64] = word;
+    }
+
+    compare_bits_scalar<Op, T, LhsScalar, RhsScalar>(LhsScalar ? lhs : lhs + i, RhsScalar ? rhs : rhs + i, words,
+                                                     first + i, n - i);
+}
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+CKTENSOR_TARGET_AVX512
+void avx512_compare_bits(const T* lhs, const T* rhs, std::uint64_t* words, std::size_t first, std::size_t n) {
+    using V = typename SimdVec<T, 64>::type;
+    constexpr std::size_t W = SimdVec<T, 64>::width;
+
+    const std::size_t head = std::min(n, (64 - first % 64) % 64);
+    compare_bits_scalar<Op, T, LhsScalar, RhsScalar>(lhs, rhs, words, first, head);
+
+    const V lhs_value = LhsScalar ? V{} + *lhs : V{};
+    const V rhs_value = RhsScalar ? V{} + *rhs : V{};
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        std::uint64_t word = 0;
+        for (std::size_t k = 0; k < 64; k += W) {
+            const V l = LhsScalar ? lhs_value : *reinterpret_cast<const V*>(lhs + i + k);
+            const V r = RhsScalar ? rhs_value : *reinterpret_cast<const V*>(rhs + i + k);
+            decltype(l < r) lanes;
+            compare_lanes<ElementwiseOpOf<Op>::value>(l, r, lanes);
+            if constexpr (sizeof(T) == 4)
+                word |= std::uint64_t{_mm512_movepi32_mask(reinterpret_cast<const __m512i&>(lanes))} << k;
+            else
+                word |= std::uint64_t{_mm512_movepi64_mask(reinterpret_cast<const __m512i&>(lanes))} << k;
+        }
+        words[(first + i) / 64] = word;
+    }
+
+    compare_bits_scalar<Op, T, LhsScalar, RhsScalar>(LhsScalar ? lhs : lhs + i, RhsScalar ? rhs : rhs + i, words,
+                                                     first + i, n - i);
+}
+
+#endif // CKTENSOR_X86
+
+template<typename T, typename R>
+struct ElementwiseKernel {
+    void (*fn)(const T* lhs, const T* rhs, R* out, std::size_t n);
+    const char* name;
+};
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+struct ElementwiseKernels {
+    static ElementwiseKernel<T, ElementwiseResult<Op, T>> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if constexpr (vectorized_elementwise<Op, T>) {
+            if (isa == Isa::AVX512)
+                return {avx512_elementwise<Op, T, LhsScalar, RhsScalar>, "avx512"};
+            if (isa == Isa::AVX2)
+                return {avx2_elementwise<Op, T, LhsScalar, RhsScalar>, "avx2"};
+        }
+#endif
+        (void) isa;
+        return {elementwise_scalar<Op, T, LhsScalar, RhsScalar>, "scalar"};
+    }
+};
+
+// The loop for kernel_isa()
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+auto elementwise_kernel() {
+    static const auto fn = ElementwiseKernels<Op, T, LhsScalar, RhsScalar>::kernel(kernel_isa()).fn;
+    return fn;
+}
+
+template<typename T>
+struct CompareBitsKernel {
+    void (*fn)(const T* lhs, const T* rhs, std::uint64_t* words, std::size_t first, std::size_t n);
+    const char* name;
+};
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+struct CompareBitsKernels {
+    static CompareBitsKernel<T> kernel(Isa isa) {
+#ifdef CKTENSOR_X86
+        if constexpr (vectorized_elementwise<Op, T> && is_comparison<Op>) {
+            if (isa == Isa::AVX512)
+                return {avx512_compare_bits<Op, T, LhsScalar, RhsScalar>, "avx512"};
+            if (isa == Isa::AVX2)
+                return {avx2_compare_bits<Op, T, LhsScalar, RhsScalar>, "avx2"};
+        }
+#endif
+        (void) isa;
+        return {compare_bits_scalar<Op, T, LhsScalar, RhsScalar>, "scalar"};
+    }
+};
+
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+auto compare_bits_kernel() {
+    static const auto fn = CompareBitsKernels<Op, T, LhsScalar, RhsScalar>::kernel(kernel_isa()).fn;
+    return fn;
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+#include "gemm.h"
+#include "matmul.h"
+#include "tensor.h"
+
+
+namespace ck {
+
+// The right hand side of matrix products, packed once into the layout the GEMM kernels read. Products with a
+// constant matrix, such as the weights of a layer, then skip packing it on every call. Copies share the packed
+// data, which is never modified.
+template<typename T>
+class PackedMatrix {
+public:
+    using ValueType = T;
+
+    explicit PackedMatrix(const Tensor<T, 2>& b)
+            : shape_{b.shape()},
+              gemm_{std::make_shared<const impl::PackedGEMM<T>>(b.data(), b.shape_at(0), b.shape_at(1))} {}
+
+    const Shape<2>& shape() const {
+        return shape_;
+    }
+
+    std::size_t shape_at(std::size_t i) const {
+        return shape_[i];
+    }
+
+    // C = alpha * A * this + beta * C for the row major m x rows() matrix A
+    void gemm(std::size_t m, T alpha, const T* a, std::size_t lda, T beta, T* c, std::size_t ldc,
+              const GemmOptions& options = {}, const impl::GemmEpilogue<T>* epilogue = nullptr) const {
+        (*gemm_)(CblasNoTrans, m, alpha, a, lda, beta, c, ldc, options, epilogue);
+    }
+
+private:
+    Shape<2> shape_;
+    std::shared_ptr<const impl::PackedGEMM<T>> gemm_;
+};
+
+namespace impl {
+// The number of rows of all the matrices of t together
+template<typename T, std::size_t Dims>
+std::size_t stacked_rows(const Tensor<T, Dims>& t) {
+    std::size_t rows = 1;
+    for (std::size_t i = 0; i + 1 < Dims; i++)
+        rows *= t.shape_at(i);
+    return rows;
+}
+}
+
+// matmul(lhs, rhs) with the packed rhs. The leading dimensions of lhs are batch dimensions, and since every
+// matrix of the batch is multiplied with the same rhs, the whole batch is a single product.
+template<typename T, std::size_t Dims, typename U>
+Tensor<U, Dims> matmul(const Tensor<T, Dims>& lhs, const PackedMatrix<U>& rhs, const GemmOptions& options = {}) {
+    static_assert(Dims >= 2, "matmul needs matrices or stacks of matrices");
+    assert(lhs.shape().rat(0) == rhs.shape_at(0) && "Incompatible shapes");
+
+    Shape<Dims> ret_shape = lhs.shape();
+    ret_shape.rat(0) = rhs.shape_at(1);
+    auto ret = Tensor<U, Dims>::empty(ret_shape);
+
+    const auto& a = impl::as_type<U>(lhs);
+    rhs.gemm(impl::stacked_rows(lhs), U{1}, a.data(), rhs.shape_at(0), U{0}, ret.data(), rhs.shape_at(1), options);
+
+    return ret;
+}
+
+// matmul(lhs, rhs, epilogue) with the packed rhs
+template<typename T, typename U>
+Tensor<U, 2> matmul(const Tensor<T, 2>& lhs, const PackedMatrix<U>& rhs, const Epilogue<U>& epilogue,
+                    const GemmOptions& options = {}) {
+    assert(lhs.shape_at(1) == rhs.shape_at(0) && "Incompatible shapes");
+
+    const std::size_t m = lhs.shape_at(0);
+    const std::size_t n = rhs.shape_at(1);
+    const auto gemm_epilogue = impl::gemm_epilogue(epilogue, m, n);
+
+    auto ret = Tensor<U, 2>::empty({m, n});
+    const auto& a = impl::as_type<U>(lhs);
+    rhs.gemm(m, U{1}, a.data(), lhs.shape_at(1), U{0}, ret.data(), n, options, &gemm_epilogue);
+
+    return ret;
+}
+
+// out = alpha * matmul(lhs, rhs) + beta * out with the packed rhs
+template<typename T, std::size_t Dims, typename U>
+void matmul_into(Tensor<U, Dims>& out, const Tensor<T, Dims>& lhs, const PackedMatrix<U>& rhs, U alpha = U{1},
+                 U beta = U{0}, const GemmOptions& options = {}) {
+    static_assert(Dims >= 2, "matmul needs matrices or stacks of matrices");
+    assert(lhs.shape().rat(0) == rhs.shape_at(0) && "Incompatible shapes");
+    assert(out.shape().rat(0) == rhs.shape_at(1) && impl::stacked_rows(out) == impl::stacked_rows(lhs) &&
+           "Incompatible output shape");
+
+    const auto& a = impl::as_type<U>(lhs);
+    rhs.gemm(impl::stacked_rows(lhs), alpha, a.data(), rhs.shape_at(0), beta, out.data(), rhs.shape_at(1), options);
+}
+
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocator.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace ck {
+
+enum class HugePages {
+    None,
+    Transparent,    // madvise(MADV_HUGEPAGE) on a 2 MB aligned mapping
+    Explicit        // MAP_HUGETLB from the reserved pool, falls back to Transparent when the pool is exhausted
+};
+
+enum class NumaPolicy {
+    Default,        // First touch
+    Bind,           // Only the given nodes
+    Interleave      // Round-robin over the given nodes, or all the online nodes if none is given
+};
+
+struct AllocationPolicy {
+    // Allocations smaller than this go to the upstream resource untouched
+    std::size_t threshold = std::size_t{2} << 20;
+    HugePages huge_pages = HugePages::Transparent;
+    NumaPolicy numa = NumaPolicy::Default;
+    std::vector<int> numa_nodes{};
+    // Touches every page right after the allocation, from multiple threads
+    bool prefault = false;
+    // Zero means std::thread::hardware_concurrency()
+    std::size_t prefault_threads = 0;
+};
+
+namespace impl {
+
+constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+inline std::size_t round_up(std::size_t n, std::size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+// Parses the node lists such as "0-3,5" in /sys/devices/system/node/online
+inline std::vector<int> parse_node_list(const std::string& list) {
+    std::vector<int> nodes;
+    std::size_t pos = 0;
+    while (pos < list.size()) {
+        std::size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+
+        const std::string range = list.substr(pos, end - pos);
+        const std::size_t dash = range.find('-');
+        try {
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int node = first; node <= last; node++)
+                nodes.push_back(node);
+        }
+        catch (const std::exception&) {
+            // Skip the malformed entries
+        }
+
+        pos = end + 1;
+    }
+    return nodes;
+}
+
+inline std::vector<int> online_numa_nodes() {
+    std::ifstream file{"/sys/devices/system/node/online"};
+    std::string list;
+    if (!std::getline(file, list))
+        return {0};
+
+    auto nodes = parse_node_list(list);
+    return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+inline void prefault_pages(std::byte* p, std::size_t bytes, std::size_t num_threads) {
+    const std::size_t page = page_size();
+    const std::size_t num_pages = (bytes + page - 1) / page;
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, num_pages);
+
+    // Writing is needed, reading would only map the shared zero page
+    const auto touch = [=](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; i++)
+            reinterpret_cast<volatile std::byte*>(p)[i * page] = std::byte{0};
+    };
+
+    if (num_threads <= 1) {
+        touch(0, num_pages);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    const std::size_t pages_per_thread = (num_pages + num_threads - 1) / num_threads;
+    for (std::size_t first = 0; first < num_pages; first += pages_per_thread)
+        threads.emplace_back(touch, first, std::min(first + pages_per_thread, num_pages));
+
+    for (auto& thread: threads)
+        thread.join();
+}
+
+}
+
+// Maps the large tensors directly from the OS according to an AllocationPolicy. Huge pages cut the TLB misses
+// of the large elementwise passes, and the NUMA policy keeps the pages close to the threads using them.
+// The policy is only applied on Linux, other systems get ordinary aligned memory.
+// Usage:
+//     PageResource resource{{.numa = NumaPolicy::Interleave, .prefault = true}};
+//     Tensor<float, 2> t{shape, &resource};
+class PageResource : public std::pmr::memory_resource {
+public:
+    explicit PageResource(AllocationPolicy policy = {}, std::pmr::memory_resource* upstream = caching_resource())
+            : policy_{std::move(policy)}, upstream_{upstream} {
+        if (policy_.numa == NumaPolicy::Interleave && policy_.numa_nodes.empty())
+            policy_.numa_nodes = impl::online_numa_nodes();
+    }
+
+    const AllocationPolicy& policy() const {
+        return policy_;
+    }
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (bytes < policy_.threshold)
+            return upstream_->allocate(bytes, alignment);
+
+#ifdef __linux__
+        if (alignment <= impl::page_size()) {
+            auto* p = static_cast<std::byte*>(map(bytes));
+            bind(p, mapped_size(bytes));
+
+            if (policy_.prefault)
+                impl::prefault_pages(p, mapped_size(bytes), policy_.prefault_threads);
+            impl::record_reserve(mapped_size(bytes));
+            return p;
+        }
+#endif
+        void* p = impl::aligned_allocate(bytes, alignment);
+        impl::record_reserve(bytes);
+        return p;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        if (bytes < policy_.threshold) {
+            upstream_->deallocate(p, bytes, alignment);
+            return;
+        }
+
+#ifdef __linux__
+        if (alignment <= impl::page_size()) {
+            munmap(p, mapped_size(bytes));
+            impl::record_release(mapped_size(bytes));
+            return;
+        }
+#endif
+        impl::aligned_deallocate(p, alignment);
+        impl::record_release(bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::size_t mapped_size(std::size_t bytes) const {
+        if (policy_.huge_pages == HugePages::None)
+            return impl::round_up(bytes, impl::page_size());
+
+        return impl::round_up(bytes, impl::huge_page_size);
+    }
+
+#ifdef __linux__
+    void* map(std::size_t bytes) const {
+        const std::size_t size = mapped_size(bytes);
+        constexpr int prot = PROT_READ | PROT_WRITE;
+        constexpr int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+        if (policy_.huge_pages == HugePages::None) {
+            void* p = mmap(nullptr, size, prot, flags, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc{};
+            return p;
+        }
+
+#ifdef MAP_HUGETLB
+        if (policy_.huge_pages == HugePages::Explicit) {
+#ifdef MAP_HUGE_SHIFT
+            // log2(2 MB) = 21
+            constexpr int huge_flags = MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+#else
+            constexpr int huge_flags = MAP_HUGETLB;
+#endif
+            void* p = mmap(nullptr, size, prot, flags | huge_flags, -1, 0);
+            if (p != MAP_FAILED)
+                return p;
+        }
+#endif
+
+        // Over-map and trim, so that the region starts at a huge page boundary
+        void* raw = mmap(nullptr, size + impl::huge_page_size, prot, flags, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc{};
+
+        auto* begin = static_cast<std::byte*>(raw);
+        auto* aligned = reinterpret_cast<std::byte*>(
+                impl::round_up(reinterpret_cast<std::uintptr_t>(begin), impl::huge_page_size));
+        auto* end = begin + size + impl::huge_page_size;
+
+        if (aligned != begin)
+            munmap(begin, aligned - begin);
+        if (aligned + size != end)
+            munmap(aligned + size, end - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+        return aligned;
+    }
+
+    void bind(void* p, std::size_t size) const {
+        if (policy_.numa == NumaPolicy::Default || policy_.numa_nodes.empty())
+            return;
+
+        // The constants of <numaif.h>, so that libnuma is not needed
+        constexpr int mpol_bind = 2;
+        constexpr int mpol_interleave = 3;
+        constexpr std::size_t bits = 8 * sizeof(unsigned long);
+
+        const int max_node = *std::max_element(policy_.numa_nodes.begin(), policy_.numa_nodes.end());
+        std::vector<unsigned long> mask(max_node / bits + 1);
+        for (int node: policy_.numa_nodes)
+            mask[node / bits] |= 1ul << (node % bits);
+
+        const int mode = policy_.numa == NumaPolicy::Bind ? mpol_bind : mpol_interleave;
+        // The policy is a hint, so a kernel without NUMA support is not an error
+        syscall(SYS_mbind, p, size, mode, mask.data(), mask.size() * bits + 1, 0);
+    }
+#endif
+
+    AllocationPolicy policy_;
+    std::pmr::memory_resource* upstream_;
+};
+
+}
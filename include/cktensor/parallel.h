@@ -1,8 +1,12 @@
 #pragma once
 
-#include <thread>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+#include <vector>
 
 #include "cktensor/tensor.h"
+#include "cktensor/thread_pool.h"
 
 namespace ck::par {
 
@@ -29,27 +33,17 @@ std::vector<size_t> generate_indices(std::size_t num_elem, std::size_t num_worke
 }
 }
 
+// Runs on num_workers threads of default_thread_pool(), each writing whole cache lines of the result
 template<typename F, typename T, std::size_t Dims>
 auto map(F f, const Tensor<T, Dims>& t, size_t num_workers) {
-    Tensor<std::invoke_result_t<F, T>, Dims> result{t.shape()};
+    using R = std::invoke_result_t<F, T>;
+    auto result = Tensor<R, Dims>::empty(t.shape());
 
-    auto indices = impl::generate_indices(t.num_elem(), num_workers);
-
-    const auto worker_fn = [&](std::size_t id) {
-        for (std::size_t i = indices[id]; i < indices[id + 1]; i++) {
+    ck::impl::parallel_ranges(default_thread_pool(), t.num_elem(), num_workers, result.data(), sizeof(R),
+                              [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++)
             result.data()[i] = f(t.data()[i]);
-        }
-    };
-
-    std::vector<std::thread> threads;
-    threads.reserve(num_workers);
-
-    for (std::size_t i = 0; i < num_workers; i++)
-        threads.emplace_back(worker_fn, i);
-
-
-    for (auto& thread: threads)
-        thread.join();
+    });
 
     return result;
 }
@@ -65,15 +59,7 @@ T reduce_add(const Tensor<T, Dims>& t, size_t num_workers) {
         worker_results[id] = std::accumulate(&t.data()[indices[id]], &t.data()[indices[id+1]], T{}, std::plus<>{});
     };
 
-    std::vector<std::thread> threads;
-    threads.reserve(num_workers);
-
-    for (std::size_t i = 0; i < num_workers; i++)
-        threads.emplace_back(worker_fn, i);
-
-
-    for (auto& thread: threads)
-        thread.join();
+    default_thread_pool().parallel_for(num_workers, worker_fn, num_workers);
 
     T result = std::accumulate(worker_results.begin(), worker_results.end(), T{}, std::plus<>{});
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "gemm_int8.h"
+#include "matmul.h"
+#include "tensor.h"
+
+
+namespace ck {
+
+// Affine quantization of real values to integers: real = scale * (q - zero_point). Weights are often quantized
+// per channel, with a scale, and possibly a zero point, for each column of the matrix, which then replace the
+// per tensor values.
+struct QuantParams {
+    float scale{1};
+    std::int32_t zero_point{0};
+    const Tensor<float, 1>* channel_scales{nullptr};
+    const Tensor<std::int32_t, 1>* channel_zero_points{nullptr};
+
+    bool per_channel() const {
+        return channel_scales != nullptr || channel_zero_points != nullptr;
+    }
+
+    float scale_at(std::size_t channel) const {
+        return channel_scales != nullptr ? channel_scales->data()[channel] : scale;
+    }
+
+    std::int32_t zero_point_at(std::size_t channel) const {
+        return channel_zero_points != nullptr ? channel_zero_points->data()[channel] : zero_point;
+    }
+};
+
+// The parameters that map [min, max], widened to contain zero, onto the whole range of Q
+template<typename Q>
+QuantParams quant_params(float min, float max) {
+    static_assert(impl::IsInt8<Q>::value, "Only 8-bit quantization is supported");
+    constexpr float q_min = std::numeric_limits<Q>::min();
+    constexpr float q_max = std::numeric_limits<Q>::max();
+
+    min = std::min(min, 0.0f);
+    max = std::max(max, 0.0f);
+    if (max == min)
+        return {};
+
+    const float scale = (max - min) / (q_max - q_min);
+    const auto zero_point = static_cast<std::int32_t>(std::clamp(std::nearbyint(q_min - min / scale), q_min, q_max));
+    return {scale, zero_point};
+}
+
+// q = clamp(round(x / scale) + zero_point), with channel parameters per index of the last dimension
+template<typename Q, std::size_t Dims>
+Tensor<Q, Dims> quantize(const Tensor<float, Dims>& t, const QuantParams& params) {
+    static_assert(impl::IsInt8<Q>::value, "Only 8-bit quantization is supported");
+
+    auto ret = Tensor<Q, Dims>::empty(t.shape());
+    const std::size_t channels = t.shape().rat(0);
+    assert((params.channel_scales == nullptr || params.channel_scales->num_elem() == channels) &&
+           "Incompatible channel scales");
+    assert((params.channel_zero_points == nullptr || params.channel_zero_points->num_elem() == channels) &&
+           "Incompatible channel zero points");
+
+    for (std::size_t i = 0; i < t.num_elem(); i++) {
+        const std::size_t channel = params.per_channel() ? i % channels : 0;
+        const long q = std::lrint(t.data()[i] / params.scale_at(channel)) + params.zero_point_at(channel);
+        ret.data()[i] = static_cast<Q>(std::clamp<long>(q, std::numeric_limits<Q>::min(),
+                                                        std::numeric_limits<Q>::max()));
+    }
+
+    return ret;
+}
+
+// x = scale * (q - zero_point)
+template<typename Q, std::size_t Dims>
+Tensor<float, Dims> dequantize(const Tensor<Q, Dims>& t, const QuantParams& params) {
+    auto ret = Tensor<float, Dims>::empty(t.shape());
+    const std::size_t channels = t.shape().rat(0);
+
+    for (std::size_t i = 0; i < t.num_elem(); i++) {
+        const std::size_t channel = params.per_channel() ? i % channels : 0;
+        ret.data()[i] = params.scale_at(channel) * static_cast<float>(t.data()[i] - params.zero_point_at(channel));
+    }
+
+    return ret;
+}
+
+// Operations applied to the product of quantized_matmul() before it is stored:
+//     out = activation(lhs x rhs + bias), real valued, then quantized with output for 8-bit results
+struct QuantEpilogue {
+    // Added to each row
+    const Tensor<float, 1>* bias{nullptr};
+    Activation activation{Activation::None};
+    // Per tensor only
+    QuantParams output{};
+};
+
+// The real valued product of quantized matrices, computed with 32-bit integer sums. Out is float for the
+// product itself, or std::int8_t or std::uint8_t for the product quantized with epilogue.output, as the input of
+// the next quantized layer. lhs is quantized per tensor and rhs per tensor or per column.
+template<typename Out, typename T, typename U>
+Tensor<Out, 2> quantized_matmul(const Tensor<T, 2>& lhs, const QuantParams& lhs_params, const Tensor<U, 2>& rhs,
+                                const QuantParams& rhs_params, const QuantEpilogue& epilogue = {},
+                                const GemmOptions& options = {}) {
+    static_assert(impl::IsInt8<T>::value && impl::IsInt8<U>::value, "Only 8-bit operands are supported");
+    static_assert(IsOneOf<Out, float, std::int8_t, std::uint8_t>::value, "Unsupported output type");
+    assert(!lhs_params.per_channel() && "The left hand side is quantized per tensor");
+    assert(!epilogue.output.per_channel() && "The output is quantized per tensor");
+
+    const std::size_t m = lhs.shape_at(0);
+    const std::size_t n = rhs.shape_at(1);
+    const std::size_t k = lhs.shape_at(1);
+    assert(rhs.shape_at(0) == k && "Incompatible shapes");
+    assert((epilogue.bias == nullptr || epilogue.bias->num_elem() == n) && "Incompatible bias shape");
+    assert((rhs_params.channel_scales == nullptr || rhs_params.channel_scales->num_elem() == n) &&
+           "Incompatible channel scales");
+    assert((rhs_params.channel_zero_points == nullptr || rhs_params.channel_zero_points->num_elem() == n) &&
+           "Incompatible channel zero points");
+
+    impl::AlignedBuffer<float> scales{n};
+    impl::AlignedBuffer<std::int32_t> zero_points{n};
+    for (std::size_t j = 0; j < n; j++) {
+        scales.data()[j] = lhs_params.scale * rhs_params.scale_at(j);
+        zero_points.data()[j] = rhs_params.zero_point_at(j);
+    }
+
+    impl::Int8Epilogue<Out> gemm_epilogue;
+    gemm_epilogue.a_zero_point = lhs_params.zero_point;
+    gemm_epilogue.b_zero_points = zero_points.data();
+    gemm_epilogue.scales = scales.data();
+    gemm_epilogue.bias = epilogue.bias != nullptr ? epilogue.bias->data() : nullptr;
+    gemm_epilogue.activation = epilogue.activation;
+    gemm_epilogue.out_scale = epilogue.output.scale;
+    gemm_epilogue.out_zero_point = epilogue.output.zero_point;
+
+    auto ret = Tensor<Out, 2>::empty({m, n});
+    impl::gemm_int8(m, n, k, lhs.data(), k, rhs.data(), n, ret.data(), n, gemm_epilogue, options);
+
+    return ret;
+}
+
+}
@@ -10,8 +10,10 @@
 #include <algorithm>
 #include <numeric>
 #include <complex>
+#include <utility>
 
 #include "allocator.h"
+#include "half.h"
 #include "util.h"
 #include "traits.h"
 #include "tensor_view.h"
@@ -117,6 +119,14 @@ struct Shape<0> {
     }
 };
 
+namespace impl {
+// The base of the lazy expressions of ops.h
+struct ExpressionBase {};
+
+template<typename E>
+constexpr bool is_expression = std::is_base_of_v<ExpressionBase, std::remove_cvref_t<E>>;
+}
+
 template<typename T, std::size_t Dims>
 class Tensor {
 public:
@@ -135,8 +145,11 @@ public:
 //    Tensor(std::initializer_list<std::size_t> shape)
 //            : shape_{shape}, capacity_{shape_.num_elem()}, data_{allocator_.allocate(capacity_)} {}
 
-    Tensor(Shape<Dims> shape)
-            : shape_{shape}, capacity_{shape.num_elem()}, data_{allocator_.allocate(capacity_)} {
+    Tensor(Shape<Dims> shape) : Tensor(shape, AllocatorType{}) {}
+
+    Tensor(Shape<Dims> shape, const AllocatorType& allocator)
+            : shape_{shape}, capacity_{shape.num_elem()}, allocator_{allocator},
+              data_{allocator_.allocate(capacity_)} {
         // Non-trivial objects cause problems if not initialized
         if constexpr (!std::is_trivial_v<T>) {
             for (auto it = begin(); it != end(); ++it)
@@ -144,6 +157,10 @@ public:
         }
     }
 
+    // Takes over a buffer of shape.num_elem() constructed elements, allocated from the allocator
+    Tensor(Shape<Dims> shape, T* data, const AllocatorType& allocator)
+            : shape_{shape}, capacity_{shape.num_elem()}, allocator_{allocator}, data_{data} {}
+
     Tensor(Shape<Dims> shape, const T& val) : Tensor(shape) {
         std::fill(begin(), end(), val);
     }
@@ -174,6 +191,7 @@ public:
 
     Tensor(Tensor&& other) noexcept: shape_{std::exchange(other.shape_, {})},
                                      capacity_(std::exchange(other.capacity_, {})),
+                                     allocator_(other.allocator_),
                                      data_(std::exchange(other.data_, nullptr)) {}
 
     Tensor& operator=(Tensor other) {
@@ -182,18 +200,36 @@ public:
     }
 
     ~Tensor() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            std::destroy(begin(), end());
+        }
         allocator_.deallocate(data_, capacity_);
     }
 
+    // Creates a tensor without initializing its elements if they are trivial, non-trivial elements are
+    // default constructed. Use it when every element is going to be overwritten anyway.
+    static Tensor empty(Shape<Dims> shape, const AllocatorType& allocator = {}) {
+        return Tensor(shape, allocator);
+    }
+
     template<typename U, typename = std::enable_if_t<std::is_convertible_v<U, T>>>
     Tensor(const Tensor<U, Dims>& other) : Tensor{other.shape()} {
-        std::copy(other.begin(), other.end(), begin());
+        impl::convert_n(other.data(), other.num_elem(), data());
     }
 
+    // Evaluates an expression of the elementwise operators in a single loop
+    template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+    Tensor(const E& expr);
+
+    // The elements are overwritten in place when the expression has the shape of the tensor
+    template<typename E> requires (impl::is_expression<E> && E::dims == Dims)
+    Tensor& operator=(const E& expr);
+
     friend void swap(Tensor& lhs, Tensor& rhs) {
         using std::swap;
         swap(lhs.shape_, rhs.shape_);
         swap(lhs.capacity_, rhs.capacity_);
+        swap(lhs.allocator_, rhs.allocator_);
         swap(lhs.data_, rhs.data_);
     }
 
@@ -316,8 +352,11 @@ public:
     void reserve(size_t n) {
         if (capacity_ < n) {
             T* new_data = allocator_.allocate(n);
-            std::move(begin(), end(), new_data);
+            std::uninitialized_move(begin(), end(), new_data);
 
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                std::destroy(begin(), end());
+            }
             allocator_.deallocate(data_, capacity_);
             data_ = new_data;
             capacity_ = n;
@@ -347,7 +386,7 @@ public:
     // TODO: Generalize transpose function for n-dimensions
     Tensor transpose() {
         static_assert(Dims == 2, "Transpose function is currently implemented only for 2-d tensors");
-        Tensor ret{Shape<2>{{shape_at(1), shape_at(0)}}};
+        auto ret = Tensor::empty(Shape<2>{{shape_at(1), shape_at(0)}});
 
         for (std::size_t i = 0; i < shape_at(0); i++) {
             for (std::size_t j = 0; j < shape_at(1); j++) {
@@ -359,7 +398,7 @@ public:
     }
     template<typename F>
     auto map(F f) const {
-        Tensor<std::invoke_result_t<F, ValueType>, Dims> result{shape()};
+        auto result = Tensor<std::invoke_result_t<F, ValueType>, Dims>::empty(shape());
         for (std::size_t i = 0; i < num_elem(); i++) {
             result.data()[i] = std::forward<F>(f)(data_[i]);
         }
@@ -414,15 +453,22 @@ public:
 
     /* Inplace operators */
 
-    Tensor& operator+=(const Tensor& other);
+    // other is a tensor or an expression that is broadcast to the shape of this tensor, or a scalar. Nothing is
+    // allocated. Throws a BroadcastError if other would change the shape of this tensor.
+    template<typename X>
+    Tensor& operator+=(const X& other);
 
-    Tensor& operator-=(const Tensor& other);
+    template<typename X>
+    Tensor& operator-=(const X& other);
 
-    Tensor& operator*=(const Tensor& other);
+    template<typename X>
+    Tensor& operator*=(const X& other);
 
-    Tensor& operator/=(const Tensor& other);
+    template<typename X>
+    Tensor& operator/=(const X& other);
 
-    Tensor& operator%=(const Tensor& other);
+    template<typename X>
+    Tensor& operator%=(const X& other);
 
     /* Binary operators */
 
@@ -436,6 +482,10 @@ public:
         return data_;
     }
 
+    const AllocatorType& allocator() const {
+        return allocator_;
+    }
+
     std::size_t capacity() const {
         return capacity_;
     }
@@ -504,17 +554,47 @@ private:
 
 };
 
+template<typename E> requires impl::is_expression<E>
+Tensor(const E&) -> Tensor<typename E::ValueType, E::dims>;
+
+namespace impl {
+template<typename T>
+struct IsTensor : std::false_type {};
+
+template<typename T, std::size_t Dims>
+struct IsTensor<Tensor<T, Dims>> : std::true_type {};
+
+template<typename X>
+constexpr bool expression_operand = IsTensor<std::remove_cvref_t<X>>::value || is_expression<X>;
+
+// The tensor itself, or the evaluated expression, for the functions which work on tensors
+template<typename X>
+decltype(auto) evaluated(const X& x) {
+    if constexpr (is_expression<X>)
+        return x.eval();
+    else
+        return x;
+}
+}
+
 
 template<typename T, std::size_t Dims>
 Tensor<T, Dims> zeros(Shape<Dims> shape) {
-    Tensor<T, Dims> t{shape};
+    // Large buffers are taken from the zero pages of the OS, so the memory is not touched twice. A resource
+    // installed with ScopedResource takes precedence, so it sees every allocation of its scope.
+    if constexpr (IsZeroBitsZero<T>::value) {
+        if (impl::current_resource() == nullptr && shape.num_elem() * sizeof(T) >= zero_page_threshold)
+            return Tensor<T, Dims>{shape, zeroed_resource()};
+    }
+
+    auto t = Tensor<T, Dims>::empty(shape);
     t.fill(T{0});
     return t;
 }
 
 template<typename T, std::size_t Dims>
 Tensor<T, Dims> ones(Shape<Dims> shape) {
-    Tensor<T, Dims> t{shape};
+    auto t = Tensor<T, Dims>::empty(shape);
     t.fill(T{1});
     return t;
 }
@@ -524,7 +604,7 @@ Tensor<T, 1> range(T stop) {
     if (stop <= 0)
         return {};
 
-    Tensor<T, 1> t{Shape<1>{static_cast<std::size_t>(stop)}};
+    auto t = Tensor<T, 1>::empty(Shape<1>{static_cast<std::size_t>(stop)});
     std::iota(t.begin(), t.end(), 0);
     return t;
 }
@@ -535,7 +615,7 @@ Tensor<T, 1> range(T start, T stop) {
         return {};
 
     Shape<1> shape{static_cast<std::size_t>(stop - start)};
-    Tensor<T, 1> t{shape};
+    auto t = Tensor<T, 1>::empty(shape);
     std::iota(t.begin(), t.end(), start);
     return t;
 }
@@ -545,7 +625,7 @@ Tensor<T, 1> range(T start, T stop, T step) {
     if (start >= stop)
         return {};
 
-    Tensor<T, 1> t{Shape<1>{static_cast<std::size_t>((stop - start + step - 1) / step)}};
+    auto t = Tensor<T, 1>::empty(Shape<1>{static_cast<std::size_t>((stop - start + step - 1) / step)});
     T* it = t.begin();
     T num = start;
     while (num < stop) {
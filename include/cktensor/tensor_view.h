@@ -180,6 +180,19 @@ public:
         return {data_, shape_, stride_, index};
     }
 
+    T* data() const {
+        return data_;
+    }
+
+    const Shape<Dims>& shape() const {
+        return shape_;
+    }
+
+    // In elements
+    const std::array<std::size_t, Dims>& stride() const {
+        return stride_;
+    }
+
 private:
     T* data_{nullptr};
     Shape<Dims> shape_{};
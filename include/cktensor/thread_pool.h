@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace ck {
+
+// A fixed set of worker threads which run parallel loops. The calling thread takes part in each loop, so a
+// pool of n threads has n - 1 workers.
+// A loop started while another one is running, or from inside a loop, runs serially on the calling thread
+// rather than waiting, so nested parallel code cannot deadlock.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::size_t num_threads = std::max(1u, std::thread::hardware_concurrency())) {
+        const std::size_t num_workers = num_threads > 0 ? num_threads - 1 : 0;
+        workers_.reserve(num_workers);
+        for (std::size_t i = 0; i < num_workers; i++)
+            workers_.emplace_back([this] { worker_loop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        wake_cv_.notify_all();
+
+        for (auto& worker: workers_)
+            worker.join();
+    }
+
+    std::size_t num_threads() const {
+        return workers_.size() + 1;
+    }
+
+    // Calls f(i) for every i in [0, n) on at most max_threads threads, zero means all of them.
+    // Returns when all the calls are done. The first exception thrown by f is rethrown.
+    template<typename F>
+    void parallel_for(std::size_t n, F&& f, std::size_t max_threads = 0) {
+        std::size_t threads = max_threads == 0 ? num_threads() : std::min(max_threads, num_threads());
+        threads = std::min(threads, n);
+
+        if (threads <= 1 || in_parallel_region() || !submit_mutex_.try_lock()) {
+            for (std::size_t i = 0; i < n; i++)
+                f(i);
+            return;
+        }
+
+        std::unique_lock submit_lock{submit_mutex_, std::adopt_lock};
+        using Fn = std::remove_reference_t<F>;
+        run([](void* ctx, std::size_t i) { (*static_cast<Fn*>(ctx))(i); }, const_cast<void*>(
+                static_cast<const void*>(std::addressof(f))), n, threads - 1);
+    }
+
+    // Whether the calling thread is running a loop of any pool
+    static bool in_parallel_region() {
+        return parallel_depth() > 0;
+    }
+
+private:
+    using TaskFn = void (*)(void*, std::size_t);
+
+    static std::size_t& parallel_depth() {
+        thread_local std::size_t depth = 0;
+        return depth;
+    }
+
+    void run(TaskFn fn, void* ctx, std::size_t n, std::size_t helpers) {
+        {
+            std::lock_guard lock{mutex_};
+            fn_ = fn;
+            ctx_ = ctx;
+            n_ = n;
+            next_ = 0;
+            open_slots_ = helpers;
+            pending_ = helpers;
+            error_ = nullptr;
+            generation_++;
+        }
+        wake_cv_.notify_all();
+
+        work();
+
+        std::unique_lock lock{mutex_};
+        // Workers which have not woken up yet are not waited for, the loop is already done
+        pending_ -= open_slots_;
+        open_slots_ = 0;
+        done_cv_.wait(lock, [this] { return pending_ == 0; });
+
+        if (error_)
+            std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+    void work() {
+        parallel_depth()++;
+
+        while (true) {
+            std::size_t i;
+            {
+                std::lock_guard lock{index_mutex_};
+                if (next_ >= n_)
+                    break;
+                i = next_++;
+            }
+
+            try {
+                fn_(ctx_, i);
+            }
+            catch (...) {
+                std::lock_guard lock{mutex_};
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+        }
+
+        parallel_depth()--;
+    }
+
+    void worker_loop() {
+        std::size_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock lock{mutex_};
+                wake_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_)
+                    return;
+
+                seen = generation_;
+                if (open_slots_ == 0)
+                    continue;
+                open_slots_--;
+            }
+
+            work();
+
+            {
+                std::lock_guard lock{mutex_};
+                pending_--;
+            }
+            done_cv_.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+
+    std::mutex submit_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    std::size_t generation_{0};
+    std::size_t open_slots_{0};
+    std::size_t pending_{0};
+    bool stop_{false};
+    std::exception_ptr error_;
+
+    std::mutex index_mutex_;
+    TaskFn fn_{nullptr};
+    void* ctx_{nullptr};
+    std::size_t n_{0};
+    std::size_t next_{0};
+};
+
+namespace impl {
+inline std::size_t default_num_threads() {
+    if (const char* env = std::getenv("CKTENSOR_NUM_THREADS")) {
+        const long n = std::strtol(env, nullptr, 10);
+        if (n > 0)
+            return static_cast<std::size_t>(n);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+}
+
+// The pool shared by the library. Sized by the CKTENSOR_NUM_THREADS environment variable, or the number of
+// hardware threads.
+inline ThreadPool& default_thread_pool() {
+    // Never destroyed, so that it can be used during the destruction of the static objects
+    static auto* pool = new ThreadPool{impl::default_num_threads()};
+    return *pool;
+}
+
+namespace impl {
+inline ThreadPool*& scoped_thread_pool() {
+    thread_local ThreadPool* pool = nullptr;
+    return pool;
+}
+}
+
+// The pool of the elementwise operators and functions of the calling thread
+inline ThreadPool& current_thread_pool() {
+    ThreadPool* pool = impl::scoped_thread_pool();
+    return pool ? *pool : default_thread_pool();
+}
+
+// Runs the elementwise operators and functions of the calling thread on the given pool until the end of the
+// scope, instead of default_thread_pool().
+// Usage:
+//     ThreadPool pool{4};
+//     {
+//         ScopedThreadPool scope{&pool};
+//         auto y = a * b + c;   // Split across the threads of pool from parallel_threshold() elements on
+//     }
+class ScopedThreadPool {
+public:
+    explicit ScopedThreadPool(ThreadPool* pool) : previous_{impl::scoped_thread_pool()} {
+        impl::scoped_thread_pool() = pool;
+    }
+
+    ScopedThreadPool(const ScopedThreadPool&) = delete;
+    ScopedThreadPool& operator=(const ScopedThreadPool&) = delete;
+
+    ~ScopedThreadPool() {
+        impl::scoped_thread_pool() = previous_;
+    }
+
+private:
+    ThreadPool* previous_;
+};
+
+namespace impl {
+constexpr std::size_t cache_line_size = 64;
+
+inline std::atomic<std::size_t>& parallel_threshold_value() {
+    static std::atomic<std::size_t> threshold = [] {
+        if (const char* env = std::getenv("CKTENSOR_PARALLEL_THRESHOLD")) {
+            char* end = nullptr;
+            const unsigned long long n = std::strtoull(env, &end, 10);
+            if (end != env)
+                return static_cast<std::size_t>(n);
+        }
+        return std::size_t{1} << 18;
+    }();
+    return threshold;
+}
+}
+
+// The elementwise operators and functions on at least this many elements split the work across
+// current_thread_pool(). Set by the CKTENSOR_PARALLEL_THRESHOLD environment variable, and 2^18 by default.
+inline std::size_t parallel_threshold() {
+    return impl::parallel_threshold_value().load(std::memory_order_relaxed);
+}
+
+// std::numeric_limits<std::size_t>::max() keeps everything on the calling thread
+inline void set_parallel_threshold(std::size_t num_elem) {
+    impl::parallel_threshold_value().store(num_elem, std::memory_order_relaxed);
+}
+
+namespace impl {
+// Calls f(begin, end) for consecutive ranges that cover [0, n), one per thread of at most max_threads threads of
+// the pool. out is where the elements of element_bytes bytes are written to: the ranges start on cache lines of
+// it, so that no two threads write to the same line.
+template<typename F>
+void parallel_ranges(ThreadPool& pool, std::size_t n, std::size_t max_threads, const void* out,
+                     std::size_t element_bytes, F&& f) {
+    const std::size_t line = std::max<std::size_t>(1, cache_line_size / element_bytes);
+    const std::size_t threads = std::min({max_threads, pool.num_threads(), (n + line - 1) / line});
+    if (threads <= 1 || ThreadPool::in_parallel_region()) {
+        f(std::size_t{0}, n);
+        return;
+    }
+
+    // The first element on a line, and the elements of a range rounded up to whole lines
+    const std::size_t misalignment = reinterpret_cast<std::uintptr_t>(out) % cache_line_size;
+    const std::size_t first = (cache_line_size - misalignment) % cache_line_size / element_bytes % line;
+    const std::size_t chunk = ((n + threads - 1) / threads + line - 1) / line * line;
+    const auto bound = [&](std::size_t t) { return t == 0 ? 0 : std::min(n, first + t * chunk); };
+
+    pool.parallel_for(threads, [&](std::size_t t) {
+        const std::size_t begin = bound(t);
+        const std::size_t end = t + 1 == threads ? n : bound(t + 1);
+        if (begin < end)
+            f(begin, end);
+    }, threads);
+}
+
+// The same on every thread of current_thread_pool() from parallel_threshold() elements on
+template<typename F>
+void parallel_elementwise(std::size_t n, const void* out, std::size_t element_bytes, F&& f) {
+    if (n < parallel_threshold()) {
+        f(std::size_t{0}, n);
+        return;
+    }
+
+    ThreadPool& pool = current_thread_pool();
+    parallel_ranges(pool, n, pool.num_threads(), out, element_bytes, std::forward<F>(f));
+}
+}
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <complex>
 #include <type_traits>
 
 
@@ -23,6 +24,18 @@ struct IsOneOf<T, T, Others...> {
 template <typename T, typename First, typename... Others>
 struct IsOneOf<T, First, Others...>: IsOneOf<T, Others...> {};
 
+template <typename T>
+struct IsComplex : std::false_type {};
+
+template <typename T>
+struct IsComplex<std::complex<T>> : std::is_arithmetic<T> {};
+
+// Types whose zero value is represented by all zero bits, so that they can be placed on zeroed memory
+template <typename T>
+struct IsZeroBitsZero {
+    static constexpr bool value = std::is_arithmetic_v<T> || IsComplex<T>::value;
+};
+
 }
 
 template <template<typename> typename Pred, typename... Ts>
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cktensor/cpu.h"
+#include "cktensor/ops.h"
+#include "cktensor/tensor.h"
+#include "cktensor/thread_pool.h"
+#include "cktensor/traits.h"
+
+
+// Fixtures shared by the tests
+
+namespace ck::test {
+
+// Small integers, so that the products are exact in every element type
+template<typename T, std::size_t Dims>
+Tensor<T, Dims> iota_tensor(Shape<Dims> shape, int start = 0) {
+    Tensor<T, Dims> t{shape};
+    for (std::size_t i = 0; i < t.num_elem(); i++)
+        t.data()[i] = static_cast<T>((static_cast<int>(i) + start) % 7 - 3);
+    return t;
+}
+
+// Random small integers, exact in the products of the GEMM tests
+template<typename T>
+std::vector<T> random_matrix(std::size_t size, std::mt19937& gen) {
+    std::uniform_int_distribution<int> dist{-4, 4};
+    std::vector<T> vals(size);
+    for (auto& val: vals) {
+        if constexpr (IsComplex<T>::value)
+            val = T(dist(gen), dist(gen));
+        else
+            val = static_cast<T>(dist(gen));
+    }
+    return vals;
+}
+
+// Random integers over the whole range of the element type, for the 8-bit kernels
+template<typename T, std::size_t Dims>
+Tensor<T, Dims> random_tensor(Shape<Dims> shape, std::mt19937& gen) {
+    std::uniform_int_distribution<int> dist{std::numeric_limits<T>::min(), std::numeric_limits<T>::max()};
+    Tensor<T, Dims> t{shape};
+    for (std::size_t i = 0; i < t.num_elem(); i++)
+        t.data()[i] = static_cast<T>(dist(gen));
+    return t;
+}
+
+// Sets parallel_threshold() until the end of the scope, so that a failed test does not leave it changed for the
+// next ones
+class ScopedParallelThreshold {
+public:
+    explicit ScopedParallelThreshold(std::size_t num_elem) : previous_{parallel_threshold()} {
+        set_parallel_threshold(num_elem);
+    }
+
+    ScopedParallelThreshold(const ScopedParallelThreshold&) = delete;
+    ScopedParallelThreshold& operator=(const ScopedParallelThreshold&) = delete;
+
+    ~ScopedParallelThreshold() {
+        set_parallel_threshold(previous_);
+    }
+
+private:
+    std::size_t previous_;
+};
+
+// The instruction sets of the kernels which this CPU runs
+inline std::vector<Isa> kernel_isas() {
+    const Isa best = impl::detect_isa(cpu_features());
+    std::vector<Isa> isas;
+    for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        if (isa <= best)
+            isas.push_back(isa);
+    }
+    return isas;
+}
+
+// Operands of the SIMD kernel tests, small integers with a NaN on each side and an infinity in floating point.
+// The right side has no zeros, so that it can be divided by.
+template<typename T>
+std::pair<std::vector<T>, std::vector<T>> kernel_operands(std::size_t size) {
+    std::vector<T> lhs(size);
+    std::vector<T> rhs(size);
+    for (std::size_t i = 0; i < size; i++) {
+        lhs[i] = static_cast<T>(static_cast<int>(i % 11) - 5);
+        rhs[i] = static_cast<T>(static_cast<int>(i % 7) - 3);
+    }
+    if constexpr (std::is_floating_point_v<T>) {
+        lhs[3] = std::numeric_limits<T>::quiet_NaN();
+        rhs[20] = std::numeric_limits<T>::quiet_NaN();
+        lhs[40] = std::numeric_limits<T>::infinity();
+        for (auto& x: rhs)
+            x = x == T{0} ? T{0.5} : x;
+    }
+    return {std::move(lhs), std::move(rhs)};
+}
+
+// Runs Check<Op, T, LhsScalar, RhsScalar>::run(lhs, rhs) with vectors on both sides and with a scalar on either
+template<template<template<typename, typename> typename, typename, bool, bool> typename Check,
+         template<typename, typename> typename Op, typename T>
+void check_operand_kinds(const std::vector<T>& lhs, const std::vector<T>& rhs) {
+    Check<Op, T, false, false>::run(lhs, rhs);
+    Check<Op, T, true, false>::run(lhs, rhs);
+    Check<Op, T, false, true>::run(lhs, rhs);
+}
+
+template<template<template<typename, typename> typename, typename, bool, bool> typename Check, typename T>
+void check_comparisons(const std::vector<T>& lhs, const std::vector<T>& rhs) {
+    check_operand_kinds<Check, impl::Eq, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Neq, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Lt, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Le, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Gt, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Ge, T>(lhs, rhs);
+}
+
+// Division only in floating point, the integer operands have zeros on the right side
+template<template<template<typename, typename> typename, typename, bool, bool> typename Check, typename T>
+void check_arithmetic(const std::vector<T>& lhs, const std::vector<T>& rhs) {
+    check_operand_kinds<Check, impl::Add, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Sub, T>(lhs, rhs);
+    check_operand_kinds<Check, impl::Mul, T>(lhs, rhs);
+    if constexpr (std::is_floating_point_v<T>)
+        check_operand_kinds<Check, impl::Div, T>(lhs, rhs);
+}
+
+}
@@ -0,0 +1,64 @@
+#include "catch.hpp"
+
+#include <sstream>
+
+#include "cktensor/alloc_stats.h"
+#include "cktensor/tensor.h"
+
+
+using namespace ck;
+
+TEST_CASE("Allocation statistics", "[AllocStats]") {
+    const auto before = alloc_stats();
+
+    {
+        Tensor<double, 2> t1{Shape<2>{16, 16}};
+        Tensor<double, 1> t2{Shape<1>{100}};
+
+        const auto during = alloc_stats();
+        REQUIRE(during.live_bytes == before.live_bytes + (256 + 100) * sizeof(double));
+        REQUIRE(during.live_allocations == before.live_allocations + 2);
+        REQUIRE(during.total_allocations == before.total_allocations + 2);
+        REQUIRE(during.peak_bytes >= during.live_bytes);
+        REQUIRE(during.histogram[11] == before.histogram[11] + 1);   // 2048 bytes
+        REQUIRE(during.histogram[9] == before.histogram[9] + 1);     // 800 bytes
+    }
+
+    const auto after = alloc_stats();
+    REQUIRE(after.live_bytes == before.live_bytes);
+    REQUIRE(after.live_allocations == before.live_allocations);
+    REQUIRE(after.peak_bytes >= before.live_bytes + (256 + 100) * sizeof(double));
+
+    reset_peak_bytes();
+    REQUIRE(alloc_stats().peak_bytes == after.live_bytes);
+
+    std::ostringstream os;
+    os << alloc_stats();
+    REQUIRE(os.str().find("peak bytes") != std::string::npos);
+}
+
+TEST_CASE("Reserved and cached bytes", "[AllocStats]") {
+    empty_cache();
+    const auto before = alloc_stats();
+
+    {
+        // 1000 bytes are rounded up to the 1024 bytes size class
+        Tensor<char, 1> t{Shape<1>{1000}};
+
+        const auto during = alloc_stats();
+        REQUIRE(during.live_bytes == before.live_bytes + 1000);
+        REQUIRE(during.reserved_bytes == before.reserved_bytes + 1024);
+        REQUIRE(during.peak_reserved_bytes >= during.reserved_bytes);
+    }
+
+    // The block is kept by the cache
+    const auto cached = alloc_stats();
+    REQUIRE(cached.live_bytes == before.live_bytes);
+    REQUIRE(cached.reserved_bytes == before.reserved_bytes + 1024);
+    REQUIRE(cached.cached_bytes == before.cached_bytes + 1024);
+
+    empty_cache();
+    const auto after = alloc_stats();
+    REQUIRE(after.reserved_bytes == before.reserved_bytes);
+    REQUIRE(after.cached_bytes == before.cached_bytes);
+}
@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include <cstdint>
+
+#include "cktensor/allocator.h"
+#include "cktensor/tensor.h"
+
+
+using namespace ck;
+
+TEST_CASE("Size classes", "[Allocator]") {
+    REQUIRE(impl::class_size(impl::size_class(1)) == 64);
+    REQUIRE(impl::class_size(impl::size_class(64)) == 64);
+    REQUIRE(impl::class_size(impl::size_class(65)) == 80);
+    REQUIRE(impl::class_size(impl::size_class(128)) == 128);
+    REQUIRE(impl::class_size(impl::size_class(129)) == 160);
+    REQUIRE(impl::class_size(impl::size_class(1000)) == 1024);
+
+    for (std::size_t bytes = 1; bytes < 100000; bytes += 7) {
+        const auto size = impl::class_size(impl::size_class(bytes));
+        REQUIRE(size >= bytes);
+        REQUIRE(size <= bytes + bytes / 4 + 64);
+    }
+}
+
+TEST_CASE("Block cache", "[Allocator]") {
+    auto& cache = BlockCache::instance();
+    cache.empty_cache();
+
+    SECTION("Reuses freed blocks") {
+        void* p = cache.allocate(1000);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(p) % BlockCache::alignment == 0);
+        cache.deallocate(p, 1000);
+        REQUIRE(cache.thread_cached_bytes() == 1024);
+
+        void* q = cache.allocate(1020);
+        REQUIRE(q == p);
+        REQUIRE(cache.thread_cached_bytes() == 0);
+        cache.deallocate(q, 1020);
+    }
+
+    SECTION("Overflows to the global cache") {
+        const auto thread_limit = cache.thread_limit();
+        cache.set_thread_limit(0);
+
+        void* p = cache.allocate(256);
+        cache.deallocate(p, 256);
+        REQUIRE(cache.thread_cached_bytes() == 0);
+        REQUIRE(cache.cached_bytes() == 256);
+        REQUIRE(cache.allocate(256) == p);
+        cache.deallocate(p, 256);
+
+        cache.set_thread_limit(thread_limit);
+    }
+
+    SECTION("Tensor temporaries") {
+        const auto* data = Tensor<float, 2>{Shape<2>{16, 16}}.data();
+        Tensor<float, 2> t{Shape<2>{16, 16}};
+        REQUIRE(t.data() == data);
+    }
+
+    cache.empty_cache();
+    REQUIRE(cache.cached_bytes() == 0);
+    REQUIRE(cache.thread_cached_bytes() == 0);
+}
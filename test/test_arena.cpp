@@ -0,0 +1,66 @@
+#include "catch.hpp"
+
+#include <cstdint>
+
+#include "cktensor/arena.h"
+#include "cktensor/ops.h"
+
+
+using namespace ck;
+
+TEST_CASE("Monotonic arena", "[Arena]") {
+    MonotonicArena arena{4096};
+
+    SECTION("Tensors from the arena") {
+        Tensor<float, 2> t1{Shape<2>{4, 4}, &arena};
+        Tensor<float, 2> t2{Shape<2>{4, 4}, &arena};
+
+        REQUIRE(t1.allocator().resource() == &arena);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(t1.data()) % default_alignment == 0);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(t2.data()) % default_alignment == 0);
+        REQUIRE(t2.data() == t1.data() + 16);
+        REQUIRE(arena.bytes_used() == 2 * 16 * sizeof(float));
+    }
+
+    SECTION("Reset reuses the memory") {
+        const float* first = Tensor<float, 1>{Shape<1>{8}, &arena}.data();
+        Tensor<float, 1>{Shape<1>{8}, &arena};
+
+        arena.reset();
+        REQUIRE(arena.bytes_used() == 0);
+        REQUIRE(Tensor<float, 1>{Shape<1>{8}, &arena}.data() == first);
+    }
+
+    SECTION("Grows and merges the chunks on reset") {
+        Tensor<double, 1> t1{Shape<1>{400}, &arena};
+        Tensor<double, 1> t2{Shape<1>{4000}, &arena};
+        REQUIRE(arena.capacity() > 4096);
+
+        const auto capacity = arena.capacity();
+        arena.reset();
+        REQUIRE(arena.capacity() == capacity);
+    }
+
+    SECTION("Scoped resource") {
+        const Tensor<int, 1> lhs{1, 2, 3};
+        const Tensor<int, 1> rhs{4, 5, 6};
+        {
+            ScopedResource scope{&arena};
+            const Tensor sum = lhs + rhs;
+            REQUIRE(sum.allocator().resource() == &arena);
+            REQUIRE(is_equal(sum, Tensor<int, 1>{5, 7, 9}));
+        }
+
+        const Tensor sum = lhs + rhs;
+        REQUIRE(sum.allocator().resource() == caching_resource());
+    }
+
+    SECTION("Move keeps the resource") {
+        Tensor<int, 1> t{Shape<1>{3}, &arena};
+        Tensor<int, 1> moved{std::move(t)};
+        REQUIRE(moved.allocator().resource() == &arena);
+
+        Tensor<int, 1> copied{moved};
+        REQUIRE(copied.allocator().resource() == caching_resource());
+    }
+}
@@ -0,0 +1,245 @@
+#include "catch.hpp"
+
+#include <complex>
+#include <numeric>
+#include <random>
+
+#include "cktensor/gemm.h"
+#include "cktensor/ops.h"
+#include "helpers.h"
+
+
+using namespace ck;
+using ck::test::random_matrix;
+
+namespace {
+template<typename T>
+void reference_gemm(bool trans_a, bool trans_b, std::size_t m, std::size_t n, std::size_t k, T alpha,
+                    const T* a, std::size_t lda, const T* b, std::size_t ldb, T beta, T* c, std::size_t ldc) {
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            T sum{0};
+            for (std::size_t p = 0; p < k; p++)
+                sum += a[impl::op_offset(trans_a, i, p, lda)] * b[impl::op_offset(trans_b, p, j, ldb)];
+            c[i * ldc + j] = alpha * sum + beta * c[i * ldc + j];
+        }
+    }
+}
+
+// Runs gemm against the reference implementation for every transpose combination. Integral values keep
+// the floating point results exact.
+template<typename T, typename Gemm>
+void check_gemm(std::size_t m, std::size_t n, std::size_t k, T alpha, T beta, Gemm gemm) {
+    std::mt19937 gen{42};
+
+    for (bool trans_a: {false, true}) {
+        for (bool trans_b: {false, true}) {
+            const std::size_t lda = (trans_a ? m : k) + 1;
+            const std::size_t ldb = (trans_b ? k : n) + 2;
+            const std::size_t ldc = n + 3;
+            const auto a = random_matrix<T>((trans_a ? k : m) * lda, gen);
+            const auto b = random_matrix<T>((trans_b ? n : k) * ldb, gen);
+            auto c = random_matrix<T>(m * ldc, gen);
+            auto expected = c;
+
+            reference_gemm(trans_a, trans_b, m, n, k, alpha, a.data(), lda, b.data(), ldb, beta, expected.data(),
+                           ldc);
+            gemm(trans_a, trans_b, m, n, k, alpha, a.data(), lda, b.data(), ldb, beta, c.data(), ldc);
+
+            for (std::size_t i = 0; i < m; i++) {
+                for (std::size_t j = 0; j < n; j++) {
+                    INFO("trans_a=" << trans_a << " trans_b=" << trans_b << " i=" << i << " j=" << j);
+                    REQUIRE(c[i * ldc + j] == expected[i * ldc + j]);
+                }
+            }
+        }
+    }
+}
+}
+
+TEST_CASE("Blocked GEMM", "[GEMM]") {
+    const auto blocked = [](auto... args) { impl::gemm_blocked(args...); };
+    // Small blocks so that every loop runs more than once and has an edge
+    const auto small_blocks = [](auto trans_a, auto trans_b, auto m, auto n, auto k, auto alpha, auto a,
+                                 auto lda, auto b, auto ldb, auto beta, auto c, auto ldc) {
+        using T = std::remove_pointer_t<decltype(c)>;
+        impl::gemm_blocked<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                              impl::DefaultGemmConfig<T>::kernel(), {8, 5, 16});
+    };
+
+    SECTION("Double") {
+        check_gemm<double>(37, 29, 41, 1.0, 0.0, blocked);
+        check_gemm<double>(37, 29, 41, 2.0, -1.0, small_blocks);
+        check_gemm<double>(1, 1, 1, 1.0, 1.0, small_blocks);
+    }
+
+    SECTION("Float") {
+        check_gemm<float>(64, 48, 33, 1.0f, 1.0f, blocked);
+        check_gemm<float>(19, 23, 17, -1.0f, 3.0f, small_blocks);
+    }
+
+    SECTION("Int") {
+        check_gemm<int>(13, 17, 9, 2, 1, blocked);
+        check_gemm<int>(13, 17, 9, 1, 0, small_blocks);
+    }
+
+    SECTION("Complex") {
+        using C = std::complex<double>;
+        check_gemm<C>(37, 29, 41, C{1.0, 0.0}, C{0.0, 0.0}, blocked);
+        check_gemm<C>(19, 23, 17, C{2.0, -1.0}, C{0.5, 3.0}, small_blocks);
+        check_gemm<std::complex<float>>(64, 48, 33, {0.0f, 1.0f}, {1.0f, 0.0f}, blocked);
+    }
+
+    SECTION("Empty K scales C") {
+        check_gemm<double>(5, 6, 0, 1.0, 2.0, blocked);
+    }
+}
+
+TEST_CASE("SIMD micro-kernels", "[GEMM]") {
+    const Isa best = impl::detect_isa(cpu_features());
+
+    for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        if (isa > best)
+            continue;
+
+        const auto with_isa = [isa](auto trans_a, auto trans_b, auto m, auto n, auto k, auto alpha, auto a,
+                                    auto lda, auto b, auto ldb, auto beta, auto c, auto ldc) {
+            using T = std::remove_pointer_t<decltype(c)>;
+            impl::gemm_blocked<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                                  impl::GemmKernels<T>::kernel(isa), {24, 7, 64});
+        };
+
+        INFO("isa=" << static_cast<int>(isa));
+        check_gemm<float>(50, 70, 30, 1.0f, 0.0f, with_isa);
+        check_gemm<float>(13, 33, 9, 2.0f, -1.0f, with_isa);
+        check_gemm<double>(50, 70, 30, 1.0, 1.0, with_isa);
+        check_gemm<double>(13, 17, 9, -2.0, 0.0, with_isa);
+        check_gemm<std::complex<float>>(50, 70, 30, {1.0f, 0.0f}, {0.0f, 0.0f}, with_isa);
+        check_gemm<std::complex<float>>(13, 33, 9, {2.0f, -1.0f}, {-1.0f, 0.5f}, with_isa);
+        check_gemm<std::complex<double>>(50, 70, 30, {1.0, 0.0}, {1.0, 0.0}, with_isa);
+        check_gemm<std::complex<double>>(13, 17, 9, {-2.0, 0.5}, {0.0, 0.0}, with_isa);
+    }
+}
+
+TEST_CASE("Multithreaded GEMM", "[GEMM]") {
+    ThreadPool pool{4};
+
+    for (std::size_t num_threads: {0, 1, 3}) {
+        const GemmOptions options{num_threads, &pool};
+        const auto threaded = [&](auto trans_a, auto trans_b, auto m, auto n, auto k, auto alpha, auto a, auto lda,
+                                  auto b, auto ldb, auto beta, auto c, auto ldc) {
+            using T = std::remove_pointer_t<decltype(c)>;
+            impl::gemm_blocked<T>(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc,
+                                  impl::DefaultGemmConfig<T>::kernel(), {48, 64, 256}, options);
+        };
+
+        INFO("num_threads=" << num_threads);
+        // Few row blocks, so the column panels are split too
+        check_gemm<float>(150, 300, 130, 1.0f, 0.0f, threaded);
+        check_gemm<double>(170, 140, 150, 2.0, -1.0, threaded);
+    }
+
+    SECTION("Small products stay on the calling thread") {
+        REQUIRE(impl::gemm_num_threads(64, 64, 64, 64) == 1);
+        REQUIRE(impl::gemm_num_threads(1024, 1024, 1024, 64) == 64);
+        REQUIRE(impl::gemm_num_threads(256, 256, 256, 64) == 64);
+        REQUIRE(impl::gemm_num_threads(128, 128, 256, 64) == 16);
+        REQUIRE(impl::gemm_num_threads(1024, 1024, 1024, 1) == 1);
+    }
+
+    SECTION("Matmul") {
+        Tensor<double, 2> a{Shape<2>{200, 150}};
+        std::iota(a.begin(), a.end(), 0.0);
+        const auto b = ones<double, 2>({150, 120});
+        const auto serial = matmul(a, b, {1});
+        const auto parallel = matmul(a, b, {4, &pool});
+        REQUIRE(is_equal(serial, parallel));
+    }
+}
+
+TEST_CASE("Shape dispatch", "[GEMM]") {
+    const auto dispatch = [](auto... args) { impl::gemm_dispatch(args...); };
+
+    SECTION("Vector times matrix") {
+        check_gemm<float>(1, 70, 45, 1.0f, 0.0f, dispatch);
+        check_gemm<double>(1, 33, 20, 2.0, -1.0, dispatch);
+        check_gemm<int>(1, 9, 13, 1, 1, dispatch);
+    }
+
+    SECTION("Matrix times vector") {
+        check_gemm<float>(70, 1, 45, 1.0f, 0.0f, dispatch);
+        check_gemm<double>(33, 1, 20, -1.0, 2.0, dispatch);
+        check_gemm<double>(1, 1, 50, 1.0, 1.0, dispatch);
+    }
+
+    SECTION("Small square matrices") {
+        for (std::size_t n: {2, 3, 4, 5, 8}) {
+            INFO("n=" << n);
+            check_gemm<float>(n, n, n, 1.0f, 0.0f, dispatch);
+            check_gemm<double>(n, n, n, 2.0, 3.0, dispatch);
+        }
+    }
+
+    SECTION("Tiny products") {
+        check_gemm<double>(3, 5, 7, 1.0, 0.0, dispatch);
+        check_gemm<float>(2, 16, 4, -1.0f, 1.0f, dispatch);
+    }
+
+    SECTION("Threaded GEMV") {
+        ThreadPool pool{4};
+        const auto threaded = [&](auto... args) { impl::gemm_dispatch(args..., GemmOptions{0, &pool}); };
+        check_gemm<float>(1, 700, 600, 1.0f, 0.0f, threaded);
+        check_gemm<double>(700, 1, 600, 1.0, 1.0, threaded);
+    }
+
+    SECTION("Compile time sizes") {
+        const float a[6] = {1, 2, 3, 4, 5, 6};
+        const float b[6] = {1, 0, 2, -1, 1, 1};
+        float c[4];
+        small_matmul<2, 2, 3>(a, b, c);
+        REQUIRE(c[0] == 8);
+        REQUIRE(c[1] == 1);
+        REQUIRE(c[2] == 20);
+        REQUIRE(c[3] == 1);
+    }
+}
+
+TEST_CASE("GEMV kernels", "[GEMM]") {
+    const Isa best = impl::detect_isa(cpu_features());
+    std::mt19937 gen{7};
+
+    for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        if (isa > best)
+            continue;
+
+        INFO("isa=" << static_cast<int>(isa));
+        const auto kernel = impl::GemvKernels<float>::kernel(isa);
+
+        for (std::size_t rows: {1, 3, 4, 37}) {
+            for (std::size_t cols: {1, 7, 16, 67}) {
+                const std::size_t lda = cols + 3;
+                const auto a = random_matrix<float>(rows * lda, gen);
+                const auto x = random_matrix<float>(std::max(rows, cols), gen);
+                const auto y0 = random_matrix<float>(std::max(rows, cols), gen);
+
+                auto y = y0;
+                kernel.n(rows, cols, 2.0f, a.data(), lda, x.data(), -1.0f, y.data());
+                for (std::size_t i = 0; i < rows; i++) {
+                    float sum = 0;
+                    for (std::size_t j = 0; j < cols; j++)
+                        sum += a[i * lda + j] * x[j];
+                    REQUIRE(y[i] == 2.0f * sum - y0[i]);
+                }
+
+                y = y0;
+                kernel.t(rows, cols, 2.0f, a.data(), lda, x.data(), 0.0f, y.data());
+                for (std::size_t j = 0; j < cols; j++) {
+                    float sum = 0;
+                    for (std::size_t i = 0; i < rows; i++)
+                        sum += a[i * lda + j] * x[i];
+                    REQUIRE(y[j] == 2.0f * sum);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <complex>
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+#include "cktensor/gemm.h"
+#include "cktensor/matmul.h"
+#include "helpers.h"
+
+
+using namespace ck;
+using ck::test::random_matrix;
+
+namespace {
+// Small integral values keep both products exact
+template<typename T>
+void check_strassen(std::size_t m, std::size_t n, std::size_t k, T alpha, T beta, std::size_t cutoff,
+                    ThreadPool* pool = nullptr) {
+    std::mt19937 gen{7};
+    const std::size_t lda = k + 1;
+    const std::size_t ldb = n + 2;
+    const std::size_t ldc = n + 3;
+    const auto a = random_matrix<T>(m * lda, gen);
+    const auto b = random_matrix<T>(k * ldb, gen);
+    auto c = random_matrix<T>(m * ldc, gen);
+    auto expected = c;
+
+    impl::gemm_dispatch<T>(false, false, m, n, k, alpha, a.data(), lda, b.data(), ldb, beta, expected.data(), ldc);
+    impl::GEMM<T>{}(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, alpha, a.data(), lda, b.data(), ldb, beta,
+                    c.data(), ldc, GemmOptions{0, pool, cutoff});
+
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            INFO("m=" << m << " n=" << n << " k=" << k << " i=" << i << " j=" << j);
+            REQUIRE(c[i * ldc + j] == expected[i * ldc + j]);
+        }
+    }
+}
+}
+
+TEST_CASE("Strassen-Winograd GEMM", "[GEMM]") {
+    SECTION("Recursion levels") {
+        REQUIRE(!impl::use_strassen(100, 100, 100, 0));
+        REQUIRE(!impl::use_strassen(100, 63, 100, 64));
+        REQUIRE(impl::use_strassen(64, 64, 64, 64));
+        REQUIRE(impl::strassen_temporaries_size(64, 64, 64, 64) == 32 * 32 * 2);
+        REQUIRE(impl::strassen_temporaries_size(128, 128, 128, 64) == 64 * 64 * 2 + 32 * 32 * 2);
+    }
+
+    SECTION("Even and odd sizes") {
+        check_strassen<double>(64, 64, 64, 1.0, 0.0, 16);
+        check_strassen<double>(67, 45, 53, 1.0, 0.0, 8);
+        check_strassen<double>(33, 90, 71, 2.0, -1.0, 10);
+        check_strassen<float>(40, 41, 39, 1.0f, 1.0f, 4);
+        check_strassen<double>(2, 3, 2, 1.0, 0.0, 2);
+    }
+
+    SECTION("Complex") {
+        check_strassen<std::complex<double>>(37, 29, 41, {1.0, 0.0}, {0.0, 0.0}, 8);
+        check_strassen<std::complex<float>>(30, 30, 30, {0.0, 1.0}, {2.0, 1.0}, 8);
+    }
+
+    SECTION("Bounded workspace") {
+        const std::size_t m = 91;
+        const std::size_t n = 77;
+        const std::size_t k = 85;
+        std::mt19937 gen{3};
+        Tensor<double, 2> a{Shape<2>{m, k}};
+        Tensor<double, 2> b{Shape<2>{k, n}};
+        const auto a_vals = random_matrix<double>(m * k, gen);
+        const auto b_vals = random_matrix<double>(k * n, gen);
+        std::copy(a_vals.begin(), a_vals.end(), a.data());
+        std::copy(b_vals.begin(), b_vals.end(), b.data());
+
+        const std::size_t cutoff = 8;
+        std::vector<std::byte> buffer(strassen_workspace_bytes<double>(m, n, k, cutoff));
+        std::pmr::monotonic_buffer_resource workspace{buffer.data(), buffer.size(),
+                                                      std::pmr::null_memory_resource()};
+
+        GemmOptions options;
+        options.strassen_cutoff = cutoff;
+        options.strassen_workspace = &workspace;
+        REQUIRE(is_equal(matmul(a, b, options), matmul(a, b)));
+        workspace.release();
+
+        Epilogue<double> epilogue;
+        epilogue.scale = 0.5;
+        REQUIRE(is_equal(matmul(a, b, epilogue, options), matmul(a, b, epilogue)));
+    }
+
+    SECTION("Workspace that throws") {
+        auto a = Tensor<float, 2>::empty(Shape<2>{64, 64});
+        std::fill_n(a.data(), a.num_elem(), 1.0f);
+
+        GemmOptions options;
+        options.strassen_cutoff = 16;
+        options.strassen_workspace = std::pmr::null_memory_resource();
+        REQUIRE_THROWS_AS(matmul(a, a, options), std::bad_alloc);
+        REQUIRE_THROWS_AS(matmul(a.as<double>(), a.as<double>(), options), std::bad_alloc);
+    }
+
+    SECTION("Threads") {
+        ThreadPool pool{4};
+        check_strassen<double>(300, 260, 280, 1.0, 0.0, 64, &pool);
+
+        auto a = Tensor<float, 2>::empty(Shape<2>{256, 256});
+        std::fill_n(a.data(), a.num_elem(), 1.0f);
+        const auto c = matmul(a, a, GemmOptions{4, &pool, 64});
+        REQUIRE(std::all_of(c.data(), c.data() + c.num_elem(), [](float x) { return x == 256.0f; }));
+    }
+}
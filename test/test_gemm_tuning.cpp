@@ -0,0 +1,156 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "cktensor/gemm.h"
+
+
+using namespace ck;
+
+TEST_CASE("CPU identification", "[GemmTuning]") {
+    REQUIRE(!cpu_model().empty());
+    REQUIRE(cpu_model().front() != ' ');
+
+    for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        Isa parsed = Isa::Scalar;
+        REQUIRE(impl::parse_isa(impl::isa_name(isa), parsed));
+        REQUIRE(parsed == isa);
+    }
+    Isa unchanged = Isa::AVX2;
+    REQUIRE(!impl::parse_isa("sse2", unchanged));
+    REQUIRE(unchanged == Isa::AVX2);
+}
+
+TEST_CASE("GEMM profiles", "[GemmTuning]") {
+    const auto path = (std::filesystem::temp_directory_path() / "cktensor_test_gemm_profile").string();
+    std::remove(path.c_str());
+
+    SECTION("Missing file") {
+        REQUIRE(impl::GemmProfile::load(path).entries().empty());
+    }
+
+    SECTION("Round trip") {
+        impl::GemmProfile profile;
+        profile.set({"float", Isa::AVX2, {96, 256, 2048}, "Some CPU @ 2.00GHz"});
+        profile.set({"double", Isa::AVX512, {48, 128, 4096}, "Some CPU @ 2.00GHz"});
+        profile.set({"float", Isa::AVX512, {144, 384, 4096}, "Other CPU"});
+        profile.set({"float", Isa::AVX2, {72, 192, 1024}, "Some CPU @ 2.00GHz"});
+        REQUIRE(profile.entries().size() == 3);
+        profile.save(path);
+
+        const auto loaded = impl::GemmProfile::load(path);
+        REQUIRE(loaded.entries().size() == 3);
+        const auto* entry = loaded.find("Some CPU @ 2.00GHz", "float");
+        REQUIRE(entry != nullptr);
+        REQUIRE(entry->isa == Isa::AVX2);
+        REQUIRE(entry->blocking.mc == 72);
+        REQUIRE(entry->blocking.kc == 192);
+        REQUIRE(entry->blocking.nc == 1024);
+        REQUIRE(loaded.find("Other CPU", "double") == nullptr);
+    }
+
+    SECTION("Malformed lines") {
+        {
+            std::ofstream file{path};
+            file << "# comment\n"
+                 << "float avx2 96 256\n"
+                 << "float sse 96 256 4096 CPU\n"
+                 << "float avx2 0 256 4096 CPU\n"
+                 << "float avx2 96 256 4096\n"
+                 << "double scalar 96 256 4096  A CPU\n";
+        }
+
+        const auto loaded = impl::GemmProfile::load(path);
+        REQUIRE(loaded.entries().size() == 1);
+        REQUIRE(loaded.find("A CPU", "double") != nullptr);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("GEMM autotuning", "[GemmTuning]") {
+    const auto entry = impl::autotune_gemm<float>(kernel_isa(), {{64, 64, 64}, {32, 300, 40}});
+    REQUIRE(entry.type == "float");
+    REQUIRE(entry.cpu == cpu_model());
+    REQUIRE(entry.isa <= kernel_isa());
+
+    const auto kernel = impl::GemmKernels<float>::kernel(entry.isa);
+    REQUIRE(entry.blocking.mc % kernel.mr == 0);
+    REQUIRE(entry.blocking.nc % kernel.nr == 0);
+
+    // The tuned configuration computes the same product
+    const std::size_t m = 70;
+    const std::size_t n = 50;
+    const std::size_t k = 130;
+    std::vector<float> a(m * k);
+    std::vector<float> b(k * n);
+    for (std::size_t i = 0; i < a.size(); i++)
+        a[i] = static_cast<float>(i % 7) - 3.0f;
+    for (std::size_t i = 0; i < b.size(); i++)
+        b[i] = static_cast<float>(i % 5) - 2.0f;
+
+    std::vector<float> c(m * n);
+    std::vector<float> expected(m * n);
+    impl::gemm_blocked<float>(false, false, m, n, k, 1.0f, a.data(), k, b.data(), n, 0.0f, c.data(), n, kernel,
+                              entry.blocking);
+    impl::gemm_blocked<float>(false, false, m, n, k, 1.0f, a.data(), k, b.data(), n, 0.0f, expected.data(), n,
+                              impl::GemmKernels<float>::kernel(Isa::Scalar), {8, 5, 16});
+    REQUIRE(c == expected);
+}
+
+TEST_CASE("Default GEMM configuration", "[GemmTuning]") {
+    const auto path = (std::filesystem::temp_directory_path() / "cktensor_test_default_gemm_profile").string();
+    std::remove(path.c_str());
+
+    SECTION("Entry of this CPU") {
+        impl::GemmProfile profile;
+        profile.set({"float", Isa::Scalar, {16, 32, 64}, cpu_model()});
+        profile.set({"float", Isa::Scalar, {24, 48, 96}, "Other CPU"});
+        profile.save(path);
+
+        const auto [isa, blocking] = impl::gemm_tuning<float>(kernel_isa(), path);
+        REQUIRE(isa == Isa::Scalar);
+        REQUIRE(blocking.mc == 16);
+        REQUIRE(blocking.kc == 32);
+        REQUIRE(blocking.nc == 64);
+    }
+
+    SECTION("Entry above the instruction set") {
+        impl::GemmProfile profile;
+        profile.set({"float", Isa::AVX2, {16, 32, 64}, cpu_model()});
+        profile.save(path);
+
+        const auto [isa, blocking] = impl::gemm_tuning<float>(Isa::Scalar, path);
+        const auto built_in = impl::GemmKernels<float>::blocking(Isa::Scalar);
+        REQUIRE(isa == Isa::Scalar);
+        REQUIRE(blocking.mc == built_in.mc);
+        REQUIRE(blocking.kc == built_in.kc);
+        REQUIRE(blocking.nc == built_in.nc);
+    }
+
+    SECTION("From the profile path") {
+        impl::GemmProfile profile;
+        profile.set({"double", Isa::Scalar, {8, 40, 80}, cpu_model()});
+        profile.save(path);
+
+        const char* previous = std::getenv("CKTENSOR_GEMM_PROFILE");
+        const std::string saved = previous ? previous : "";
+        setenv("CKTENSOR_GEMM_PROFILE", path.c_str(), 1);
+        const auto [isa, blocking] = impl::default_gemm_tuning<double>();
+        if (previous)
+            setenv("CKTENSOR_GEMM_PROFILE", saved.c_str(), 1);
+        else
+            unsetenv("CKTENSOR_GEMM_PROFILE");
+
+        REQUIRE(isa == Isa::Scalar);
+        REQUIRE(blocking.mc == 8);
+        REQUIRE(blocking.kc == 40);
+        REQUIRE(blocking.nc == 80);
+    }
+
+    std::remove(path.c_str());
+}
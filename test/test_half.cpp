@@ -0,0 +1,213 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "cktensor/functions.h"
+#include "cktensor/half.h"
+#include "cktensor/ops.h"
+#include "cktensor/packed_matrix.h"
+
+
+using namespace ck;
+
+namespace {
+template<typename H, std::size_t Dims>
+Tensor<H, Dims> random_half_tensor(Shape<Dims> shape, std::mt19937& gen) {
+    std::uniform_real_distribution<float> dist{-1.0f, 1.0f};
+    Tensor<H, Dims> t{shape};
+    for (std::size_t i = 0; i < t.num_elem(); i++)
+        t.data()[i] = dist(gen);
+    return t;
+}
+
+std::vector<float> conversion_inputs() {
+    std::mt19937 gen{11};
+    std::uniform_int_distribution<std::uint32_t> bits;
+
+    std::vector<float> ret{0.0f, -0.0f, 1.0f, -2.5f, 65504.0f, 65519.0f, 65520.0f, 1e-8f, 3e-5f, 1e30f,
+                           std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                           std::numeric_limits<float>::quiet_NaN(), std::bit_cast<float>(0x7f800001u)};
+    for (int i = 0; i < 10000; i++)
+        ret.push_back(std::bit_cast<float>(bits(gen)));
+    return ret;
+}
+
+template<typename H>
+bool same(H lhs, H rhs) {
+    const float l = lhs;
+    const float r = rhs;
+    return std::isnan(l) ? std::isnan(r) : lhs.bits == rhs.bits;
+}
+}
+
+TEST_CASE("Half precision conversions", "[Half]") {
+    SECTION("bf16") {
+        REQUIRE(bf16{1.0f}.bits == 0x3f80);
+        REQUIRE(static_cast<float>(bf16{3.140625f}) == 3.140625f);
+        // Ties round to even
+        REQUIRE(bf16{std::bit_cast<float>(0x3f808000u)}.bits == 0x3f80);
+        REQUIRE(bf16{std::bit_cast<float>(0x3f818000u)}.bits == 0x3f82);
+        REQUIRE(std::isnan(static_cast<float>(bf16{std::bit_cast<float>(0x7f800001u)})));
+
+        for (std::uint32_t bits = 0; bits < 0x10000; bits++) {
+            const auto h = bf16::from_bits(static_cast<std::uint16_t>(bits));
+            REQUIRE(same(bf16{static_cast<float>(h)}, h));
+        }
+    }
+
+    SECTION("f16") {
+        REQUIRE(f16{1.0f}.bits == 0x3c00);
+        REQUIRE(f16{-2.0f}.bits == 0xc000);
+        REQUIRE(static_cast<float>(f16{65504.0f}) == 65504.0f);
+        REQUIRE(f16{65520.0f}.bits == 0x7c00);
+        // The smallest subnormal, and half of it rounding to even
+        REQUIRE(static_cast<float>(f16::from_bits(1)) == std::ldexp(1.0f, -24));
+        REQUIRE(f16{std::ldexp(1.0f, -25)}.bits == 0);
+        REQUIRE(f16{std::ldexp(3.0f, -25)}.bits == 2);
+
+        for (std::uint32_t bits = 0; bits < 0x10000; bits++) {
+            const auto h = f16::from_bits(static_cast<std::uint16_t>(bits));
+            REQUIRE(same(f16{static_cast<float>(h)}, h));
+        }
+    }
+
+    SECTION("Bulk conversion kernels") {
+        const Isa best = impl::detect_isa(cpu_features());
+        const auto inputs = conversion_inputs();
+        const std::size_t n = inputs.size();
+
+        for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+            for (bool bf16_native: {false, true}) {
+                if (isa > best || (bf16_native && (isa != Isa::AVX512 || !cpu_features().avx512_bf16)))
+                    continue;
+
+                const auto kernels = impl::HalfConversions::kernels(isa, bf16_native);
+                INFO("kernels=" << kernels.name);
+
+                std::vector<bf16> b(n);
+                std::vector<f16> h(n);
+                kernels.float_to_bf16(inputs.data(), b.data(), n);
+                kernels.float_to_f16(inputs.data(), h.data(), n);
+                for (std::size_t i = 0; i < n; i++) {
+                    INFO("x=" << inputs[i]);
+                    if (bf16_native && std::fpclassify(inputs[i]) == FP_SUBNORMAL)
+                        REQUIRE(b[i].bits == bf16{std::copysign(0.0f, inputs[i])}.bits);
+                    else
+                        REQUIRE(same(b[i], bf16{inputs[i]}));
+                    REQUIRE(same(h[i], f16{inputs[i]}));
+                }
+
+                std::vector<float> back(n);
+                kernels.bf16_to_float(b.data(), back.data(), n);
+                for (std::size_t i = 0; i < n; i++)
+                    REQUIRE(std::bit_cast<std::uint32_t>(back[i]) == std::bit_cast<std::uint32_t>(float{b[i]}));
+                kernels.f16_to_float(h.data(), back.data(), n);
+                for (std::size_t i = 0; i < n; i++)
+                    REQUIRE(std::bit_cast<std::uint32_t>(back[i]) == std::bit_cast<std::uint32_t>(float{h[i]}));
+            }
+        }
+    }
+}
+
+TEST_CASE("Half precision arithmetic", "[Half]") {
+    const bf16 a = 1.5f;
+    const bf16 b = 0.25f;
+
+    STATIC_REQUIRE(std::is_same_v<decltype(a + b), bf16>);
+    STATIC_REQUIRE(std::is_same_v<decltype(a * 2.0f), float>);
+    STATIC_REQUIRE(std::is_same_v<decltype(a * 2.0), double>);
+    STATIC_REQUIRE(std::is_same_v<decltype(a + f16{1.0f}), float>);
+
+    REQUIRE(a + b == 1.75f);
+    REQUIRE(a / b == 6.0f);
+    REQUIRE(-a == -1.5f);
+    REQUIRE(a > b);
+
+    f16 c = 2.0f;
+    c += 1;
+    c *= b;
+    REQUIRE(c == 0.75f);
+}
+
+TEST_CASE("Half precision tensors", "[Half]") {
+    const Tensor<bf16, 2> a{{bf16{1.0f}, bf16{2.0f}}, {bf16{3.0f}, bf16{4.0f}}};
+    const Tensor<bf16, 1> b{bf16{0.5f}, bf16{-1.0f}};
+
+    SECTION("Operators") {
+        const Tensor sum = a + b;
+        STATIC_REQUIRE(std::is_same_v<decltype(sum), const Tensor<bf16, 2>>);
+        REQUIRE(is_equal(sum.as<float>(), Tensor<float, 2>{{1.5f, 1.0f}, {3.5f, 3.0f}}));
+        REQUIRE(is_equal((a * 2.0f), Tensor<float, 2>{{2.0f, 4.0f}, {6.0f, 8.0f}}));
+        REQUIRE(is_equal((a > bf16{2.0f}), Tensor<bool, 2>{{false, false}, {true, true}}));
+    }
+
+    SECTION("Functions") {
+        const auto e = exp(a);
+        STATIC_REQUIRE(std::is_same_v<decltype(e), const Tensor<bf16, 2>>);
+        for (std::size_t i = 0; i < a.num_elem(); i++)
+            REQUIRE(e.data()[i].bits == bf16{std::exp(static_cast<float>(a.data()[i]))}.bits);
+    }
+
+    SECTION("Conversions") {
+        Tensor<float, 1> x{Shape<1>{1000}};
+        for (std::size_t i = 0; i < x.num_elem(); i++)
+            x.data()[i] = static_cast<float>(i) / 7.0f;
+
+        const Tensor<f16, 1> h{x};
+        for (std::size_t i = 0; i < x.num_elem(); i++)
+            REQUIRE(h.data()[i].bits == f16{x.data()[i]}.bits);
+        REQUIRE(is_equal(h.as<float>().as<f16>(), h));
+    }
+}
+
+TEST_CASE("Half precision matmul", "[Half]") {
+    std::mt19937 gen{17};
+
+    SECTION("Same as the float product of the values") {
+        const auto a = random_half_tensor<bf16>(Shape<2>{70, 300}, gen);
+        const auto b = random_half_tensor<bf16>(Shape<2>{300, 45}, gen);
+
+        const auto c = matmul(a, b);
+        STATIC_REQUIRE(std::is_same_v<decltype(c), const Tensor<bf16, 2>>);
+        const auto expected = matmul(a.as<float>(), b.as<float>());
+        for (std::size_t i = 0; i < c.num_elem(); i++)
+            REQUIRE(c.data()[i].bits == bf16{expected.data()[i]}.bits);
+    }
+
+    SECTION("f16 batches and vectors") {
+        const auto a = random_half_tensor<f16>(Shape<3>{3, 1, 40}, gen);
+        const auto b = random_half_tensor<f16>(Shape<2>{40, 33}, gen);
+
+        const auto c = matmul(a, b);
+        const auto expected = matmul(a.as<float>(), b.as<float>());
+        for (std::size_t i = 0; i < c.num_elem(); i++)
+            REQUIRE(static_cast<float>(c.data()[i]) == Catch::Approx(expected.data()[i]).epsilon(1e-3).margin(1e-3));
+    }
+
+    SECTION("Epilogue and packed matrix") {
+        const auto a = random_half_tensor<bf16>(Shape<2>{20, 64}, gen);
+        const auto b = random_half_tensor<bf16>(Shape<2>{64, 24}, gen);
+        const auto bias = random_half_tensor<bf16>(Shape<1>{24}, gen);
+
+        Epilogue<bf16> epilogue;
+        epilogue.bias = &bias;
+        epilogue.activation = Activation::ReLU;
+
+        Epilogue<float> epilogue_float;
+        const auto bias_float = bias.as<float>();
+        epilogue_float.bias = &bias_float;
+        epilogue_float.activation = Activation::ReLU;
+
+        const auto expected = matmul(a.as<float>(), b.as<float>(), epilogue_float).as<bf16>();
+        REQUIRE(is_equal(matmul(a, b, epilogue), expected));
+
+        const PackedMatrix<bf16> packed{b};
+        REQUIRE(is_equal(matmul(a, packed, epilogue), expected));
+        REQUIRE(is_equal(matmul(a, packed), matmul(a, b)));
+    }
+}
@@ -0,0 +1,68 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+#include "cktensor/mapped_tensor.h"
+
+
+using namespace ck;
+
+TEST_CASE("Mapped tensors", "[MappedTensor]") {
+    const auto path = (std::filesystem::temp_directory_path() / "cktensor_test_mapped.ckt").string();
+    const Tensor<float, 2> t{{1.0f, 2.0f, 3.0f},
+                             {4.0f, 5.0f, 6.0f}};
+    save_tensor(t, path);
+
+    SECTION("Read-only") {
+        const auto live_bytes = alloc_stats().live_bytes;
+        {
+            auto mapped = map_tensor<float, 2>(path);
+            static_assert(std::is_same_v<decltype(mapped), ReadOnlyTensor<float, 2>>);
+            REQUIRE(mapped.shape() == t.shape());
+            REQUIRE(is_equal(mapped.tensor(), t));
+            REQUIRE(mapped.at(1, 2) == 6.0f);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(mapped.data()) % default_alignment == 0);
+            REQUIRE(alloc_stats().live_bytes == live_bytes + 6 * sizeof(float));
+
+            Tensor<float, 2> copy = mapped.tensor();
+            copy.at(0, 0) = 7.0f;
+            REQUIRE(mapped.at(0, 0) == 1.0f);
+        }
+        REQUIRE(alloc_stats().live_bytes == live_bytes);
+    }
+
+    SECTION("Copy-on-write") {
+        auto mapped = map_tensor<float, 2, MapMode::CopyOnWrite>(path);
+        mapped.at(1, 2) = 10.0f;
+        REQUIRE(mapped.at(1, 2) == 10.0f);
+        REQUIRE(map_tensor<float, 2>(path).at(1, 2) == 6.0f);
+    }
+
+    SECTION("Errors") {
+        REQUIRE_THROWS_AS((map_tensor<double, 2>(path)), std::runtime_error);
+        REQUIRE_THROWS_AS((map_tensor<float, 3>(path)), std::runtime_error);
+        REQUIRE_THROWS_AS((map_tensor<float, 2>(path + ".missing")), std::system_error);
+    }
+
+    SECTION("Shapes larger than the file") {
+        const auto header = sizeof(impl::FileHeader);
+        const auto write_dims = [&](std::uint64_t rows, std::uint64_t cols) {
+            std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+            file.seekp(static_cast<std::streamoff>(header));
+            file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+            file.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
+        };
+
+        write_dims(3, 3);
+        REQUIRE_THROWS_AS((map_tensor<float, 2>(path)), std::runtime_error);
+
+        // The number of bytes wraps around to zero
+        write_dims(std::uint64_t{1} << 62, 1);
+        REQUIRE_THROWS_AS((map_tensor<float, 2>(path)), std::runtime_error);
+    }
+
+    std::remove(path.c_str());
+}
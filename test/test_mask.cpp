@@ -0,0 +1,215 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "cktensor/mask.h"
+#include "helpers.h"
+
+
+using namespace ck;
+
+namespace {
+// Every start bit and length around the words and vectors, so that the heads and tails are covered
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+struct CheckCompareBits {
+    static void run(const std::vector<T>& lhs, const std::vector<T>& rhs) {
+        for (Isa isa: test::kernel_isas()) {
+            const auto kernel = impl::CompareBitsKernels<Op, T, LhsScalar, RhsScalar>::kernel(isa);
+            INFO("kernel=" << kernel.name);
+
+            for (std::size_t first: {0, 1, 63, 64, 100}) {
+                for (std::size_t n: {0, 1, 40, 64, 129, 300}) {
+                    INFO("first=" << first << " n=" << n);
+                    // The words before first are set and have to be kept
+                    std::vector<std::uint64_t> words(8, ~std::uint64_t{0});
+                    std::vector<std::uint64_t> expected(8, ~std::uint64_t{0});
+                    if (first % 64 != 0) {
+                        words[first / 64] &= impl::tail_bits(first);
+                        expected[first / 64] &= impl::tail_bits(first);
+                    }
+                    kernel.fn(lhs.data(), rhs.data(), words.data(), first, n);
+                    impl::compare_bits_scalar<Op, T, LhsScalar, RhsScalar>(lhs.data(), rhs.data(), expected.data(),
+                                                                           first, n);
+                    REQUIRE(words == expected);
+
+                    const Op<T, T> op;
+                    for (std::size_t j = 0; j < n; j++) {
+                        const std::size_t bit = first + j;
+                        const bool value = op(LhsScalar ? lhs[0] : lhs[j], RhsScalar ? rhs[0] : rhs[j]);
+                        REQUIRE(((words[bit / 64] >> bit % 64 & 1) != 0) == value);
+                    }
+                }
+            }
+        }
+    }
+};
+
+template<typename T>
+void check_compare_bits() {
+    const auto [lhs, rhs] = test::kernel_operands<T>(300);
+    test::check_comparisons<CheckCompareBits>(lhs, rhs);
+}
+}
+
+TEST_CASE("Mask construction", "[Mask]") {
+    Tensor<float, 2> x{Shape<2>{3, 70}};
+    std::iota(x.begin(), x.end(), -100.0f);
+    Tensor<float, 1> row{Shape<1>{70}};
+    std::iota(row.begin(), row.end(), -35.0f);
+
+    SECTION("Same as the bool tensors") {
+        const Mask positive = x > 0.0f;
+        STATIC_REQUIRE(std::is_same_v<decltype(positive), const Mask<2>>);
+        REQUIRE(positive.num_elem() == 210);
+        REQUIRE(positive.num_words() == 4);
+        REQUIRE(is_equal(positive.to_tensor(), Tensor<bool, 2>{x > 0.0f}));
+        REQUIRE(is_equal(positive, Mask<2>{Tensor<bool, 2>{x > 0.0f}}));
+
+        // Broadcasting, a non vectorized type and a fused expression
+        const Mask<2> less = x < row;
+        REQUIRE(is_equal(less.to_tensor(), Tensor<bool, 2>{x < row}));
+        const Tensor<std::int16_t, 2> small = x.as<std::int16_t>();
+        REQUIRE(is_equal(Mask<2>{small >= 3}.to_tensor(), Tensor<bool, 2>{small >= 3}));
+        REQUIRE(is_equal(Mask<2>{x * 2.0f + 1.0f == row}.to_tensor(), Tensor<bool, 2>{x * 2.0f + 1.0f == row}));
+    }
+
+    SECTION("Assignment and elements") {
+        Mask<2> mask{Shape<2>{3, 70}};
+        REQUIRE(!mask.any());
+        mask.set(69, true);
+        mask.set(140, true);
+        REQUIRE(mask[69]);
+        REQUIRE(mask.count_nonzero() == 2);
+        mask.set(69, false);
+        REQUIRE(!mask[69]);
+
+        mask = x == -100.0f;
+        REQUIRE(mask.count_nonzero() == 1);
+        REQUIRE(mask[0]);
+        mask = x.transpose() != 0.0f;
+        REQUIRE(mask.shape() == (Shape<2>{70, 3}));
+        REQUIRE(mask.count_nonzero() == 209);
+    }
+
+    SECTION("Threads") {
+        // Enough words for a cache line on each of the threads
+        Tensor<float, 2> large{Shape<2>{300, 70}};
+        std::iota(large.begin(), large.end(), -10000.0f);
+        const Tensor<bool, 2> expected = large < row;
+        const auto expected_where = where(Mask<2>{expected}, large, 0.0f);
+
+        ThreadPool pool{4};
+        ScopedThreadPool pool_scope{&pool};
+        test::ScopedParallelThreshold threshold{1};
+        const Mask<2> less = large < row;
+        REQUIRE(is_equal(less.to_tensor(), expected));
+        REQUIRE(is_equal(where(less, large, 0.0f), expected_where));
+    }
+
+    SECTION("Kernels") {
+        check_compare_bits<float>();
+        check_compare_bits<double>();
+        check_compare_bits<std::int32_t>();
+        check_compare_bits<std::int64_t>();
+    }
+}
+
+TEST_CASE("Mask operations", "[Mask]") {
+    Tensor<int, 1> x{Shape<1>{130}};
+    std::iota(x.begin(), x.end(), 0);
+    const Mask even = x % 2 == 0;
+    const Mask small = x < 100;
+
+    SECTION("Reductions") {
+        REQUIRE(even.count_nonzero() == 65);
+        REQUIRE(even.any());
+        REQUIRE(!even.all());
+        REQUIRE(Mask<1>{x >= 0}.all());
+        REQUIRE(!Mask<1>{x > 129}.any());
+        REQUIRE(Mask<1>{Shape<1>{0}}.all());
+        REQUIRE(!Mask<1>{Shape<1>{0}}.any());
+    }
+
+    SECTION("Reduction kernels") {
+        // Every length around the vectors and the unrolled blocks, with two bits flipped in each word or in none.
+        // The word after the last one is the opposite of the others and must not be read.
+        for (Isa isa: test::kernel_isas()) {
+            const auto kernel = impl::MaskWordsKernels::kernel(isa);
+            INFO("kernel=" << kernel.name);
+
+            for (std::size_t n = 0; n < 70; n++) {
+                for (std::uint64_t fill: {std::uint64_t{0}, ~std::uint64_t{0}}) {
+                    std::vector<std::uint64_t> words(n + 1, fill);
+                    words[n] = ~fill;
+                    for (std::size_t flipped = 0; flipped <= n; flipped++) {
+                        INFO("n=" << n << " fill=" << fill << " flipped=" << flipped);
+                        if (flipped < n)
+                            words[flipped] ^= 0x8000000000000010;
+                        REQUIRE(kernel.count(words.data(), n) == impl::count_bits_scalar(words.data(), n));
+                        REQUIRE(kernel.any(words.data(), n) == impl::any_bits_scalar(words.data(), n));
+                        REQUIRE(kernel.all(words.data(), n) == impl::all_bits_scalar(words.data(), n));
+                        if (flipped < n)
+                            words[flipped] ^= 0x8000000000000010;
+                    }
+                }
+            }
+        }
+
+        // Counts past the 31 vectors of the byte sums
+        std::vector<std::uint64_t> words(1000, ~std::uint64_t{0});
+        for (Isa isa: test::kernel_isas())
+            REQUIRE(impl::MaskWordsKernels::kernel(isa).count(words.data(), words.size()) == 64000);
+    }
+
+    SECTION("Logical operators") {
+        const Mask both = even & small;
+        for (std::size_t i = 0; i < 130; i++)
+            REQUIRE(both[i] == (i % 2 == 0 && i < 100));
+        REQUIRE(both.count_nonzero() == 50);
+        REQUIRE((even | small).count_nonzero() == 115);
+        REQUIRE((even ^ small).count_nonzero() == 65);
+        REQUIRE((~even).count_nonzero() == 65);
+        REQUIRE((~~small).count_nonzero() == 100);
+        REQUIRE(is_equal(~even, Mask<1>{x % 2 != 0}));
+
+        Mask<1> mask = even;
+        mask |= small;
+        mask ^= even;
+        for (std::size_t i = 0; i < 130; i++)
+            REQUIRE(mask[i] == (i < 100 && i % 2 != 0));
+    }
+
+    SECTION("Where") {
+        Tensor<int, 1> negated{Shape<1>{130}};
+        std::iota(negated.begin(), negated.end(), -129);
+        const auto selected = where(even, x, -1);
+        STATIC_REQUIRE(std::is_same_v<decltype(selected), const Tensor<int, 1>>);
+        for (std::size_t i = 0; i < 130; i++) {
+            REQUIRE(selected(i) == (i % 2 == 0 ? static_cast<int>(i) : -1));
+            REQUIRE(where(small, x, negated)(i) == (i < 100 ? x(i) : negated(i)));
+        }
+
+        const auto scalars = where(small, 1.5, 0);
+        STATIC_REQUIRE(std::is_same_v<decltype(scalars), const Tensor<double, 1>>);
+        REQUIRE(scalars(99) == 1.5);
+        REQUIRE(scalars(100) == 0.0);
+    }
+
+    SECTION("Operands smaller than the mask") {
+        Tensor<int, 1> y{Shape<1>{129}};
+        Tensor<int, 1> z{Shape<1>{64}};
+        std::iota(y.begin(), y.end(), 0);
+        REQUIRE_THROWS_AS(where(even, y, 0), BroadcastError);
+        REQUIRE_THROWS_AS(where(even, 0, z), BroadcastError);
+
+        const Mask<1> shorter = y < 100;
+        Mask<1> mask = even;
+        REQUIRE_THROWS_AS(mask &= shorter, BroadcastError);
+        REQUIRE_THROWS_AS(mask | shorter, BroadcastError);
+        REQUIRE_THROWS_AS(shorter ^ mask, BroadcastError);
+        REQUIRE(is_equal(mask, even));
+    }
+}
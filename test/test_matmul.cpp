@@ -0,0 +1,264 @@
+#include "catch.hpp"
+
+#include <complex>
+#include <numeric>
+
+#include "cktensor/matmul.h"
+#include "helpers.h"
+
+
+using namespace ck;
+using ck::test::iota_tensor;
+
+namespace {
+// The product of the matrix at lhs_index of lhs and the matrix at rhs_index of rhs, compared to the matrix at
+// ret_index of ret
+template<typename T, std::size_t RetDims, std::size_t TDims, std::size_t UDims>
+void check_product(const Tensor<T, RetDims>& ret, std::size_t ret_index, const Tensor<T, TDims>& lhs,
+                   std::size_t lhs_index, const Tensor<T, UDims>& rhs, std::size_t rhs_index) {
+    const std::size_t m = lhs.shape().rat(1);
+    const std::size_t k = lhs.shape().rat(0);
+    const std::size_t n = rhs.shape().rat(0);
+
+    const T* a = lhs.data() + lhs_index * m * k;
+    const T* b = rhs.data() + rhs_index * k * n;
+    const T* c = ret.data() + ret_index * m * n;
+
+    for (std::size_t i = 0; i < m; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            T sum{0};
+            for (std::size_t p = 0; p < k; p++)
+                sum += a[i * k + p] * b[p * n + j];
+            REQUIRE(c[i * n + j] == sum);
+        }
+    }
+}
+}
+
+TEST_CASE("Batched matrix product", "[MatMul]") {
+    SECTION("Same batch") {
+        const auto lhs = iota_tensor<double>(Shape<3>{5, 7, 9});
+        const auto rhs = iota_tensor<double>(Shape<3>{5, 9, 4}, 1);
+        const auto result = matmul(lhs, rhs);
+
+        REQUIRE(result.shape() == Shape<3>{5, 7, 4});
+        for (std::size_t i = 0; i < 5; i++)
+            check_product(result, i, lhs, i, rhs, i);
+    }
+
+    SECTION("Matrix broadcast over the batch") {
+        const auto lhs = iota_tensor<float>(Shape<4>{2, 3, 6, 5});
+        const auto rhs = iota_tensor<float>(Shape<2>{5, 8}, 2);
+        const auto result = matmul(lhs, rhs);
+
+        REQUIRE(result.shape() == Shape<4>{2, 3, 6, 8});
+        for (std::size_t i = 0; i < 6; i++)
+            check_product(result, i, lhs, i, rhs, 0);
+    }
+
+    SECTION("Batch dimensions broadcast against each other") {
+        const auto lhs = iota_tensor<double>(Shape<4>{2, 1, 3, 4});
+        const auto rhs = iota_tensor<double>(Shape<3>{3, 4, 5}, 3);
+        const auto result = matmul(lhs, rhs);
+
+        REQUIRE(result.shape() == Shape<4>{2, 3, 3, 5});
+        for (std::size_t i = 0; i < 2; i++)
+            for (std::size_t j = 0; j < 3; j++)
+                check_product(result, i * 3 + j, lhs, i, rhs, j);
+    }
+
+    SECTION("Many small products") {
+        const auto lhs = iota_tensor<float>(Shape<3>{500, 16, 16});
+        const auto rhs = iota_tensor<float>(Shape<3>{500, 16, 16}, 5);
+        ThreadPool pool{4};
+        const auto result = matmul(lhs, rhs, {0, &pool});
+
+        for (std::size_t i = 0; i < 500; i++)
+            check_product(result, i, lhs, i, rhs, i);
+    }
+
+    SECTION("Mixed types") {
+        const auto lhs = iota_tensor<int>(Shape<3>{3, 2, 4});
+        const auto rhs = iota_tensor<double>(Shape<3>{3, 4, 2});
+        const auto result = matmul(lhs, rhs);
+        STATIC_REQUIRE(std::is_same_v<decltype(result)::ValueType, double>);
+
+        const Tensor<double, 3> lhs_double = lhs;
+        for (std::size_t i = 0; i < 3; i++)
+            check_product(result, i, lhs_double, i, rhs, i);
+    }
+
+    SECTION("Complex") {
+        using C = std::complex<float>;
+        auto lhs = iota_tensor<C>(Shape<3>{3, 40, 30});
+        auto rhs = iota_tensor<C>(Shape<2>{30, 50}, 4);
+        for (std::size_t i = 0; i < lhs.num_elem(); i++)
+            lhs.data()[i] += C{0.0f, static_cast<float>(i % 5) - 2.0f};
+        for (std::size_t i = 0; i < rhs.num_elem(); i++)
+            rhs.data()[i] *= C{1.0f, static_cast<float>(i % 3) - 1.0f};
+
+        const auto result = matmul(lhs, rhs);
+        for (std::size_t i = 0; i < 3; i++)
+            check_product(result, i, lhs, i, rhs, 0);
+    }
+
+    SECTION("Incompatible batches") {
+        const auto lhs = iota_tensor<double>(Shape<3>{2, 3, 4});
+        const auto rhs = iota_tensor<double>(Shape<3>{3, 4, 5});
+        REQUIRE_THROWS_AS(matmul(lhs, rhs), BroadcastError);
+    }
+}
+
+TEST_CASE("Strided batched GEMM", "[MatMul]") {
+    const std::size_t m = 6, n = 5, k = 4, batch = 40;
+    const auto a = iota_tensor<double>(Shape<3>{batch, m, k});
+    const auto b = iota_tensor<double>(Shape<2>{k, n}, 1);
+    auto c = iota_tensor<double>(Shape<3>{batch, m, n}, 2);
+    const auto c_before = c;
+
+    ThreadPool pool{3};
+    impl::gemm_blocked_batch_strided<double>(false, false, m, n, k, 2.0, a.data(), k, m * k, b.data(), n, 0, -1.0,
+                                             c.data(), n, m * n, batch, {0, &pool});
+
+    for (std::size_t i = 0; i < batch; i++) {
+        for (std::size_t r = 0; r < m; r++) {
+            for (std::size_t col = 0; col < n; col++) {
+                double sum = 0;
+                for (std::size_t p = 0; p < k; p++)
+                    sum += a.data()[i * m * k + r * k + p] * b.data()[p * n + col];
+                const std::size_t idx = i * m * n + r * n + col;
+                REQUIRE(c.data()[idx] == 2.0 * sum - c_before.data()[idx]);
+            }
+        }
+    }
+}
+
+TEST_CASE("Matrix product into an output", "[MatMul]") {
+    const auto lhs = iota_tensor<double>(Shape<3>{4, 5, 6});
+    const auto rhs = iota_tensor<double>(Shape<2>{6, 3}, 1);
+    const auto product = matmul(lhs, rhs);
+
+    SECTION("Overwrite") {
+        Tensor<double, 3> out{Shape<3>{4, 5, 3}, 100.0};
+        matmul_into(out, lhs, rhs);
+        REQUIRE(is_equal(out, product));
+    }
+
+    SECTION("Accumulate") {
+        auto out = iota_tensor<double>(Shape<3>{4, 5, 3}, 2);
+        const auto before = out;
+        matmul_into(out, lhs, rhs, 2.0, -1.0);
+
+        for (std::size_t i = 0; i < out.num_elem(); i++)
+            REQUIRE(out.data()[i] == 2.0 * product.data()[i] - before.data()[i]);
+    }
+
+    SECTION("No allocation") {
+        auto out = zeros<double>(Shape<3>{4, 5, 3});
+        const auto allocations = alloc_stats().total_allocations;
+        matmul_into(out, lhs, rhs, 1.0, 1.0);
+        REQUIRE(alloc_stats().total_allocations == allocations);
+    }
+
+    SECTION("Converted operands") {
+        Tensor<float, 3> out{Shape<3>{4, 5, 3}};
+        matmul_into(out, lhs.as<int>(), rhs.as<int>());
+        REQUIRE(is_equal(out, product.as<float>()));
+    }
+
+    SECTION("View with padded rows") {
+        const auto a = iota_tensor<double>(Shape<2>{5, 6});
+        const auto expected = matmul(a, rhs);
+
+        Tensor<double, 2> storage{Shape<2>{5, 8}, -1.0};
+        matmul_into(TensorView<double, 2>{storage.data() + 1, Shape<2>{5, 3}, {8, 1}}, a, rhs);
+
+        for (std::size_t i = 0; i < 5; i++) {
+            REQUIRE(storage.at(i, 0) == -1.0);
+            for (std::size_t j = 0; j < 3; j++)
+                REQUIRE(storage.at(i, j + 1) == expected.at(i, j));
+            for (std::size_t j = 4; j < 8; j++)
+                REQUIRE(storage.at(i, j) == -1.0);
+        }
+    }
+}
+
+TEST_CASE("Fused epilogue", "[MatMul]") {
+    const auto lhs = iota_tensor<double>(Shape<2>{37, 29});
+    const auto rhs = iota_tensor<double>(Shape<2>{29, 41}, 1);
+    const auto product = matmul(lhs, rhs);
+    const auto col_bias = iota_tensor<double>(Shape<1>{41}, 2);
+    const auto row_bias = iota_tensor<double>(Shape<1>{37}, 3);
+    const auto residual = iota_tensor<double>(Shape<2>{37, 41}, 4);
+
+    const auto check = [&](const Tensor<double, 2>& result, auto expected_fn) {
+        for (std::size_t i = 0; i < 37; i++)
+            for (std::size_t j = 0; j < 41; j++)
+                REQUIRE(result.at(i, j) == Catch::Approx(expected_fn(i, j, product.at(i, j))));
+    };
+
+    SECTION("Bias per column and ReLU") {
+        Epilogue<double> epilogue;
+        epilogue.bias = &col_bias;
+        epilogue.activation = Activation::ReLU;
+
+        check(matmul(lhs, rhs, epilogue), [&](std::size_t, std::size_t j, double val) {
+            return std::max(0.0, val + col_bias.at(j));
+        });
+    }
+
+    SECTION("Bias per row, tanh, scale and residual") {
+        Epilogue<double> epilogue;
+        epilogue.bias = &row_bias;
+        epilogue.bias_per_row = true;
+        epilogue.activation = Activation::Tanh;
+        epilogue.scale = 0.5;
+        epilogue.residual = &residual;
+
+        check(matmul(lhs, rhs, epilogue), [&](std::size_t i, std::size_t j, double val) {
+            return 0.5 * std::tanh(val + row_bias.at(i)) + residual.at(i, j);
+        });
+    }
+
+    SECTION("Sigmoid and GELU") {
+        Epilogue<double> epilogue;
+        epilogue.activation = Activation::Sigmoid;
+        check(matmul(lhs, rhs, epilogue), [](std::size_t, std::size_t, double val) {
+            return 1 / (1 + std::exp(-val));
+        });
+
+        epilogue.activation = Activation::GELU;
+        check(matmul(lhs, rhs, epilogue), [](std::size_t, std::size_t, double val) {
+            return 0.5 * val * (1 + std::tanh(std::sqrt(2 / M_PI) * (val + 0.044715 * val * val * val)));
+        });
+    }
+
+    SECTION("Into an output with accumulation") {
+        auto out = iota_tensor<double>(Shape<2>{37, 41}, 5);
+        const auto before = out;
+
+        Epilogue<double> epilogue;
+        epilogue.bias = &col_bias;
+        matmul_into(out, lhs, rhs, epilogue, 2.0, 1.0);
+
+        for (std::size_t i = 0; i < 37; i++)
+            for (std::size_t j = 0; j < 41; j++)
+                REQUIRE(out.at(i, j) == 2.0 * product.at(i, j) + before.at(i, j) + col_bias.at(j));
+    }
+
+    SECTION("Applied once with several k blocks and threads") {
+        const auto a = iota_tensor<float>(Shape<2>{150, 600});
+        const auto b = iota_tensor<float>(Shape<2>{600, 130}, 1);
+        const auto bias = iota_tensor<float>(Shape<1>{130}, 2);
+        const auto expected = matmul(a, b);
+
+        Epilogue<float> epilogue;
+        epilogue.bias = &bias;
+        ThreadPool pool{4};
+        const auto result = matmul(a, b, epilogue, {0, &pool});
+
+        for (std::size_t i = 0; i < 150; i++)
+            for (std::size_t j = 0; j < 130; j++)
+                REQUIRE(result.at(i, j) == expected.at(i, j) + bias.at(j));
+    }
+}
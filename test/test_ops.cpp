@@ -1,10 +1,68 @@
 #include "catch.hpp"
 
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "cktensor/alloc_stats.h"
+#include "cktensor/functions.h"
 #include "cktensor/ops.h"
+#include "helpers.h"
 
 
 using namespace ck;
 
+namespace {
+// Every offset and length around the vector widths, so that the heads and tails are covered
+template<template<typename, typename> typename Op, typename T, bool LhsScalar, bool RhsScalar>
+struct CheckElementwiseKernel {
+    static void run(const std::vector<T>& lhs, const std::vector<T>& rhs) {
+        using R = impl::ElementwiseResult<Op, T>;
+        const std::size_t size = lhs.size();
+
+        for (Isa isa: test::kernel_isas()) {
+            const auto kernel = impl::ElementwiseKernels<Op, T, LhsScalar, RhsScalar>::kernel(isa);
+            INFO("kernel=" << kernel.name);
+
+            for (std::size_t offset = 0; offset < 9; offset++) {
+                for (std::size_t n: {std::size_t{0}, std::size_t{1}, std::size_t{7}, std::size_t{33}, size - 9}) {
+                    // Not vectors, which have no data() for bool
+                    const std::unique_ptr<R[]> out{new R[size]()};
+                    const std::unique_ptr<R[]> expected{new R[size]()};
+                    kernel.fn(lhs.data() + offset, rhs.data() + offset, out.get() + offset, n);
+                    impl::elementwise_scalar<Op, T, LhsScalar, RhsScalar>(lhs.data() + offset, rhs.data() + offset,
+                                                                         expected.get() + offset, n);
+                    for (std::size_t i = 0; i < size; i++) {
+                        INFO("offset=" << offset << " n=" << n << " i=" << i);
+                        if constexpr (std::is_floating_point_v<R>)
+                            REQUIRE((out[i] == expected[i] || (std::isnan(out[i]) && std::isnan(expected[i]))));
+                        else
+                            REQUIRE(out[i] == expected[i]);
+                    }
+                }
+            }
+        }
+    }
+};
+
+template<typename F>
+std::size_t allocations(F f) {
+    const auto before = alloc_stats().total_allocations;
+    f();
+    return alloc_stats().total_allocations - before;
+}
+
+template<typename T>
+void check_elementwise_kernels() {
+    const auto [lhs, rhs] = test::kernel_operands<T>(150);
+    test::check_arithmetic<CheckElementwiseKernel>(lhs, rhs);
+    test::check_comparisons<CheckElementwiseKernel>(lhs, rhs);
+}
+}
+
 TEST_CASE("Addition", "[Ops]") {
     Tensor<int, 1> lhs{1, 2, 3};
     Tensor<int, 1> rhs{6, 5, 4};
@@ -395,4 +453,294 @@ TEST_CASE("Broadcasting ops", "[Ops]") {
         }
     }
 
+    SECTION("Collapsed dimensions") {
+        const Shape<4> shape{2, 3, 4, 5};
+        Tensor<int, 4> x{shape};
+        Tensor<int, 3> bias{Shape<3>{3, 1, 1}};
+        Tensor<int, 2> row{Shape<2>{1, 5}};
+        Tensor<int, 4> column{Shape<4>{2, 1, 4, 1}};
+        std::iota(x.begin(), x.end(), 0);
+        std::iota(bias.begin(), bias.end(), 0);
+        std::iota(row.begin(), row.end(), 0);
+        std::iota(column.begin(), column.end(), 0);
+
+        Tensor<int, 4> expected{shape};
+        for (std::size_t n = 0; n < 2; n++) {
+            for (std::size_t c = 0; c < 3; c++) {
+                for (std::size_t h = 0; h < 4; h++) {
+                    for (std::size_t w = 0; w < 5; w++) {
+                        const auto i = ((n * 3 + c) * 4 + h) * 5 + w;
+                        expected.data()[i] = static_cast<int>(i) * static_cast<int>(c) - static_cast<int>(w) +
+                                             static_cast<int>(n * 4 + h);
+                    }
+                }
+            }
+        }
+
+        REQUIRE(is_equal(x * bias - row + column, expected));
+        // More tensors than the specialized rows
+        REQUIRE(is_equal(x * bias - row + column + 0 * x + 0 * row, expected));
+        REQUIRE(is_equal(bias * x - row + column, expected));
+        REQUIRE((x * bias - row + column).sum() == expected.sum());
+    }
+}
+
+TEST_CASE("Expressions", "[Ops]") {
+    const Tensor<int, 2> a{{1, 2, 3},
+                           {4, 5, 6}};
+    const Tensor<int, 2> b{{6, 5, 4},
+                           {3, 2, 1}};
+    const Tensor<int, 1> c{1, 0, -1};
+
+    SECTION("Fused evaluation") {
+        const auto expr = a * b + c * 2 - a;
+        STATIC_REQUIRE(impl::is_expression<decltype(expr)>);
+        REQUIRE(expr.shape() == a.shape());
+
+        const auto before = alloc_stats().total_allocations;
+        const Tensor result = expr;
+        REQUIRE(alloc_stats().total_allocations == before + 1);
+        STATIC_REQUIRE(std::is_same_v<decltype(result), const Tensor<int, 2>>);
+        REQUIRE(is_equal(result, Tensor<int, 2>{{7, 8, 7},
+                                                {10, 5, -2}}));
+        REQUIRE(expr.at(1, 2) == -2);
+    }
+
+    SECTION("Assignment in place") {
+        Tensor<int, 2> x = a;
+        const int* data = x.data();
+        x = x * 2 + b;
+        REQUIRE(x.data() == data);
+        REQUIRE(is_equal(x, Tensor<int, 2>{{8, 9, 10},
+                                           {11, 12, 13}}));
+
+        x = c + Tensor<int, 2>{{1, 1, 1}};
+        REQUIRE(x.shape() == (Shape<2>{1, 3}));
+        REQUIRE(is_equal(x, Tensor<int, 2>{{2, 1, 0}}));
+    }
+
+    SECTION("Temporaries are kept") {
+        const auto expr = Tensor<double, 1>{0.5, 1.5, 2.5} * c;
+        STATIC_REQUIRE(std::is_same_v<decltype(expr)::ValueType, double>);
+        REQUIRE(is_equal(expr, Tensor<double, 1>{0.5, 0.0, -2.5}));
+    }
+
+    SECTION("Scalar operands keep their order") {
+        REQUIRE(is_equal(10 - c, Tensor<int, 1>{9, 10, 11}));
+        REQUIRE(is_equal(2.5 - c, Tensor<double, 1>{1.5, 2.5, 3.5}));
+        REQUIRE(is_equal(6 / (c + 2), Tensor<int, 1>{2, 3, 6}));
+        REQUIRE(is_equal(0 < c, Tensor<bool, 1>{true, false, false}));
+    }
+
+    SECTION("Unary operators") {
+        REQUIRE(is_equal(-(a - b), Tensor<int, 2>{{5, 3, 1},
+                                                  {-1, -3, -5}}));
+        REQUIRE(is_equal(!(a > b), Tensor<bool, 2>{{true, true, true},
+                                                   {false, false, false}}));
+    }
+
+    SECTION("Reductions") {
+        const auto expr = a + c;
+        REQUIRE(expr.sum() == 21);
+        REQUIRE(expr.min() == 2);
+        REQUIRE(expr.max() == 5);
+        REQUIRE(expr.mean() == 3);
+        REQUIRE((a > c * 3).count_nonzero() == 5);
+        REQUIRE((a.as<double>() - 3.5).var() == Catch::Approx(35.0 / 12.0));
+    }
+
+    SECTION("Incompatible shapes") {
+        const Tensor<int, 1> d{1, 2};
+        REQUIRE_THROWS_AS(a + d, BroadcastError);
+    }
+
+    SECTION("Used as tensors") {
+        const auto expr = a + b;
+        REQUIRE(expr(1, 2) == 7);
+        REQUIRE(is_equal(expr.reshape(Shape<2>{3, 2}), Tensor<int, 2>{{7, 7}, {7, 7}, {7, 7}}));
+        REQUIRE(is_equal((a - b).transpose(), Tensor<int, 2>{{-5, 1}, {-3, 3}, {-1, 5}}));
+    }
+
+    SECTION("Arguments of the math functions and matmul") {
+        const auto x = a.as<double>();
+        const auto y = b.as<double>();
+        REQUIRE(is_equal(exp(x - y), exp(Tensor{x - y})));
+        REQUIRE(is_equal(sqrt(x * y), sqrt(Tensor{x * y})));
+
+        const Tensor<double, 2> w{{1, 0},
+                                  {0, 1},
+                                  {1, 1}};
+        const auto product = matmul(x + y, w);
+        REQUIRE(is_equal(product, Tensor<double, 2>{{14, 14},
+                                                    {14, 14}}));
+        REQUIRE(is_equal(matmul(x + y, w, Epilogue<double>{}), product));
+
+        auto out = zeros<double>(Shape<2>{2, 2});
+        matmul_into(out, x + y, w);
+        REQUIRE(is_equal(out, product));
+    }
+}
+
+TEST_CASE("Vectorized elementwise loops", "[Ops]") {
+    SECTION("Kernels") {
+        check_elementwise_kernels<float>();
+        check_elementwise_kernels<double>();
+        check_elementwise_kernels<std::int32_t>();
+        check_elementwise_kernels<std::int64_t>();
+    }
+
+    SECTION("Operators") {
+        STATIC_REQUIRE(impl::VectorizedExpression<decltype(Tensor<float, 1>{} + Tensor<float, 1>{}), float>::value);
+        STATIC_REQUIRE(impl::VectorizedExpression<decltype(Tensor<int, 1>{} < 2), bool>::value);
+        STATIC_REQUIRE(!impl::VectorizedExpression<decltype(Tensor<int, 1>{} * 2.5), double>::value);
+        STATIC_REQUIRE(!impl::VectorizedExpression<decltype(Tensor<int, 1>{} / Tensor<int, 1>{}), int>::value);
+
+        Tensor<float, 3> a{Shape<3>{3, 4, 37}};
+        Tensor<float, 2> b{Shape<2>{4, 37}};
+        Tensor<float, 3> c{Shape<3>{3, 4, 1}};
+        std::iota(a.data(), a.data() + a.num_elem(), -200.0f);
+        std::iota(b.data(), b.data() + b.num_elem(), -50.0f);
+        std::iota(c.data(), c.data() + c.num_elem(), 1.0f);
+
+        const Tensor<float, 3> sum = a + b;
+        const Tensor<float, 3> product = c * a;
+        const Tensor<bool, 3> less = a < c;
+        const Tensor<float, 3> scaled = 2.0f - a;
+        for (std::size_t i = 0; i < a.num_elem(); i++) {
+            const float x = a.data()[i];
+            REQUIRE(sum.data()[i] == x + b.data()[i % b.num_elem()]);
+            REQUIRE(product.data()[i] == c.data()[i / 37] * x);
+            REQUIRE(less.data()[i] == (x < c.data()[i / 37]));
+            REQUIRE(scaled.data()[i] == 2.0f - x);
+        }
+    }
+}
+
+TEST_CASE("Operators into existing tensors", "[Ops]") {
+    const Tensor<int, 2> a{{1, 2, 3},
+                           {4, 5, 6}};
+    const Tensor<int, 1> bias{10, 20, 30};
+    const Tensor<int, 2> column = Tensor<int, 2>{{1, -1}}.transpose();
+
+    SECTION("Compound assignment with broadcasting") {
+        Tensor<int, 2> x = a;
+        const Tensor<int, 2> twos{{2, 2, 2}};
+        REQUIRE(allocations([&] {
+            x += bias;
+            x -= column;
+            x *= 2;
+            x /= twos * 1;
+            x %= 7;
+            x += a * column;
+        }) == 0);
+        REQUIRE(is_equal(x, Tensor<int, 2>{{4, 2, 7},
+                                           {-3, 0, -4}}));
+
+        Tensor<double, 1> y{Shape<1>{3}};
+        std::iota(y.begin(), y.end(), 1.0);
+        y *= 0.5;
+        y += bias;
+        REQUIRE(y(0) == 10.5);
+        REQUIRE(y(2) == 31.5);
+    }
+
+    SECTION("Out parameters") {
+        Tensor<int, 2> out{Shape<2>{2, 3}};
+        Tensor<bool, 2> mask{Shape<2>{2, 3}};
+        const Tensor<int, 1> row{1, 5, 6};
+
+        REQUIRE(allocations([&] { add(a, bias, out); }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{11, 22, 33},
+                                             {14, 25, 36}}));
+        REQUIRE(allocations([&] { sub(out, column, out); }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{10, 21, 32},
+                                             {15, 26, 37}}));
+        REQUIRE(allocations([&] { mul(2, a * column, out); }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{2, 4, 6},
+                                             {-8, -10, -12}}));
+        REQUIRE(allocations([&] {
+            div(out, 2, out);
+            mod(out, 3, out);
+        }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{1, 2, 0},
+                                             {-1, -2, 0}}));
+        REQUIRE(allocations([&] { neg(out, out); }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{-1, -2, 0},
+                                             {1, 2, 0}}));
+        REQUIRE(allocations([&] { pow(a, 2, out); }) == 0);
+        REQUIRE(is_equal(out, Tensor<int, 2>{{1, 4, 9},
+                                             {16, 25, 36}}));
+
+        REQUIRE(allocations([&] { gt(a, column, mask); }) == 0);
+        REQUIRE(is_equal(mask, Tensor<bool, 2>{{false, true, true},
+                                               {true, true, true}}));
+        REQUIRE(allocations([&] {
+            le(a, 3, mask);
+            logical_not(mask, mask);
+        }) == 0);
+        REQUIRE(is_equal(mask, Tensor<bool, 2>{{false, false, false},
+                                               {true, true, true}}));
+        REQUIRE(allocations([&] { eq(a, row, mask); }) == 0);
+        REQUIRE(is_equal(mask, Tensor<bool, 2>{{true, false, false},
+                                               {false, true, true}}));
+    }
+
+    SECTION("Outputs smaller than the result") {
+        Tensor<int, 2> x = zeros<int>(Shape<2>{1, 3});
+        REQUIRE_THROWS_AS(x += a, BroadcastError);
+        REQUIRE_THROWS_AS(x *= column, BroadcastError);
+        REQUIRE(is_equal(x, Tensor<int, 2>{{0, 0, 0}}));
+
+        Tensor<int, 2> out{Shape<2>{1, 3}};
+        REQUIRE_THROWS_AS(add(a, bias, out), BroadcastError);
+        REQUIRE_THROWS_AS(add(bias, column, out), BroadcastError);
+        Tensor<bool, 2> mask{Shape<2>{2, 2}};
+        REQUIRE_THROWS_AS(gt(a, 1, mask), BroadcastError);
+    }
+}
+
+TEST_CASE("Parallel evaluation", "[Ops]") {
+    Tensor<int, 3> x{Shape<3>{5, 7, 9}};
+    Tensor<int, 2> row{Shape<2>{1, 9}};
+    Tensor<int, 3> column{Shape<3>{5, 7, 1}};
+    std::iota(x.begin(), x.end(), -100);
+    std::iota(row.begin(), row.end(), 3);
+    std::iota(column.begin(), column.end(), 1);
+
+    SECTION("Ranges of the result") {
+        const auto expr = x * row - column;
+        const Tensor<int, 3> expected = expr;
+        for (std::size_t split: {0, 1, 4, 9, 10, 100, 314, 315}) {
+            Tensor<int, 3> result{x.shape()};
+            const auto store = [&](std::size_t i, int el) { result.data()[i] = el; };
+            impl::for_each_element(expr, store, 0, split);
+            impl::for_each_element(expr, store, split, x.num_elem());
+            REQUIRE(is_equal(result, expected));
+
+            Tensor<int, 3> sum{x.shape()};
+            const auto add_rows = [&](std::size_t i, const auto& cursor, std::size_t cols, std::size_t mask) {
+                REQUIRE(mask == 0b10);
+                for (std::size_t j = 0; j < cols; j++)
+                    sum.data()[i + j] = cursor.lhs[j] + cursor.rhs[j];
+            };
+            const auto sum_expr = x + column;
+            impl::for_each_row(sum_expr, add_rows, 0, split);
+            impl::for_each_row(sum_expr, add_rows, split, x.num_elem());
+            REQUIRE(is_equal(sum, Tensor<int, 3>{sum_expr}));
+        }
+    }
+
+    SECTION("Threshold") {
+        const Tensor<int, 3> expected = x * row - column;
+        const Tensor<int, 3> flat_expected = x + x;
+
+        // More threads than the hardware may have, so that the results are split
+        ThreadPool pool{4};
+        ScopedThreadPool pool_scope{&pool};
+        test::ScopedParallelThreshold threshold{1};
+        const Tensor<int, 3> result = x * row - column;
+        const Tensor<int, 3> flat = x + x;
+        REQUIRE(is_equal(result, expected));
+        REQUIRE(is_equal(flat, flat_expected));
+    }
 }
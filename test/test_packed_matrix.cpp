@@ -0,0 +1,91 @@
+#include "catch.hpp"
+
+#include <atomic>
+
+#include "cktensor/packed_matrix.h"
+#include "helpers.h"
+
+
+using namespace ck;
+using ck::test::iota_tensor;
+
+TEST_CASE("Packed matrix", "[PackedMatrix]") {
+    SECTION("Same result as the unpacked product") {
+        const auto weights = iota_tensor<float>(Shape<2>{500, 270});
+        const PackedMatrix<float> packed{weights};
+        REQUIRE(packed.shape() == weights.shape());
+
+        for (std::size_t m: {1, 7, 64, 250}) {
+            const auto input = iota_tensor<float>(Shape<2>{m, 500}, 1);
+            REQUIRE(is_equal(matmul(input, packed), matmul(input, weights)));
+        }
+    }
+
+    SECTION("Reused from several threads") {
+        const auto weights = iota_tensor<double>(Shape<2>{70, 50});
+        const PackedMatrix<double> packed{weights};
+        const auto input = iota_tensor<double>(Shape<2>{200, 70}, 2);
+        const auto expected = matmul(input, weights);
+
+        ThreadPool pool{4};
+        std::atomic<int> equal{0};
+        pool.parallel_for(16, [&](std::size_t) {
+            if (is_equal(matmul(input, packed), expected))
+                equal++;
+        });
+        REQUIRE(equal == 16);
+    }
+
+    SECTION("Copies share the packed data") {
+        const auto weights = iota_tensor<double>(Shape<2>{20, 30});
+        const auto input = iota_tensor<double>(Shape<2>{5, 20}, 3);
+        const auto copy = [&] {
+            const PackedMatrix<double> packed{weights};
+            return packed;
+        }();
+        REQUIRE(is_equal(matmul(input, copy), matmul(input, weights)));
+    }
+
+    SECTION("Batched lhs") {
+        const auto weights = iota_tensor<double>(Shape<2>{9, 13});
+        const PackedMatrix<double> packed{weights};
+        const auto input = iota_tensor<double>(Shape<3>{4, 6, 9}, 4);
+
+        const auto result = matmul(input, packed);
+        REQUIRE(result.shape() == Shape<3>{4, 6, 13});
+        REQUIRE(is_equal(result, matmul(input, weights)));
+    }
+
+    SECTION("Converted lhs") {
+        const auto weights = iota_tensor<double>(Shape<2>{9, 13});
+        const PackedMatrix<double> packed{weights};
+        const auto input = iota_tensor<int>(Shape<2>{6, 9}, 4);
+        REQUIRE(is_equal(matmul(input, packed), matmul(input, weights)));
+    }
+
+    SECTION("Into an output") {
+        const auto weights = iota_tensor<double>(Shape<2>{40, 30});
+        const PackedMatrix<double> packed{weights};
+        const auto input = iota_tensor<double>(Shape<2>{25, 40}, 5);
+        const auto product = matmul(input, weights);
+
+        auto out = iota_tensor<double>(Shape<2>{25, 30}, 6);
+        const auto before = out;
+        matmul_into(out, input, packed, 3.0, 2.0);
+
+        for (std::size_t i = 0; i < out.num_elem(); i++)
+            REQUIRE(out.data()[i] == 3.0 * product.data()[i] + 2.0 * before.data()[i]);
+    }
+
+    SECTION("Epilogue") {
+        const auto weights = iota_tensor<float>(Shape<2>{40, 30});
+        const PackedMatrix<float> packed{weights};
+        const auto input = iota_tensor<float>(Shape<2>{25, 40}, 5);
+        const auto bias = iota_tensor<float>(Shape<1>{30}, 7);
+
+        Epilogue<float> epilogue;
+        epilogue.bias = &bias;
+        epilogue.activation = Activation::ReLU;
+        REQUIRE(is_equal(matmul(input, packed, epilogue), matmul(input, weights, epilogue)));
+    }
+}
@@ -0,0 +1,50 @@
+#include "catch.hpp"
+
+#include <cstdint>
+
+#include "cktensor/page_resource.h"
+#include "cktensor/tensor.h"
+
+
+using namespace ck;
+
+TEST_CASE("Parse node list", "[PageResource]") {
+    REQUIRE(impl::parse_node_list("0") == std::vector<int>{0});
+    REQUIRE(impl::parse_node_list("0-3") == std::vector<int>{0, 1, 2, 3});
+    REQUIRE(impl::parse_node_list("0,2-3") == std::vector<int>{0, 2, 3});
+    REQUIRE(!impl::online_numa_nodes().empty());
+}
+
+TEST_CASE("Page resource", "[PageResource]") {
+    const Shape<2> shape{1024, 1024};
+
+    SECTION("Transparent huge pages") {
+        PageResource resource{{.huge_pages = HugePages::Transparent, .prefault = true, .prefault_threads = 4}};
+        Tensor<float, 2> t{shape, 1.0f};
+        Tensor<float, 2> mapped{shape, &resource};
+        std::copy(t.begin(), t.end(), mapped.begin());
+
+        REQUIRE(reinterpret_cast<std::uintptr_t>(mapped.data()) % impl::huge_page_size == 0);
+        REQUIRE(mapped.sum() == static_cast<float>(shape.num_elem()));
+    }
+
+    SECTION("Interleaved") {
+        PageResource resource{{.huge_pages = HugePages::None, .numa = NumaPolicy::Interleave}};
+        REQUIRE(!resource.policy().numa_nodes.empty());
+
+        Tensor<double, 2> t{shape, &resource};
+        t.fill(2.0);
+        REQUIRE(t.at(1023, 1023) == 2.0);
+    }
+
+    SECTION("Small tensors go upstream") {
+        PageResource resource{{.huge_pages = HugePages::Explicit, .numa = NumaPolicy::Bind, .numa_nodes = {0}}};
+        Tensor<int, 1> t{Shape<1>{16}, &resource};
+        t.fill(1);
+        REQUIRE(t.sum() == 16);
+
+        Tensor<int, 2> large{shape, &resource};
+        large.fill(1);
+        REQUIRE(large.sum() == static_cast<int>(shape.num_elem()));
+    }
+}
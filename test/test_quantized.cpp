@@ -0,0 +1,186 @@
+#include "catch.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "cktensor/quantized.h"
+#include "cktensor/thread_pool.h"
+#include "helpers.h"
+
+
+using namespace ck;
+using ck::test::random_tensor;
+
+namespace {
+// sum_k (a - za)(b - zb[j])
+template<typename T, typename U>
+std::vector<std::int64_t> reference_int8(const Tensor<T, 2>& a, std::int32_t za, const Tensor<U, 2>& b,
+                                         const std::vector<std::int32_t>& zb) {
+    const std::size_t m = a.shape_at(0);
+    const std::size_t n = b.shape_at(1);
+    const std::size_t k = a.shape_at(1);
+
+    std::vector<std::int64_t> ret(m * n);
+    for (std::size_t i = 0; i < m; i++)
+        for (std::size_t j = 0; j < n; j++)
+            for (std::size_t l = 0; l < k; l++)
+                ret[i * n + j] += (std::int64_t{a.at(i, l)} - za) * (std::int64_t{b.at(l, j)} - zb[j]);
+    return ret;
+}
+
+template<typename T, typename U>
+void check_int8_gemm(const impl::Int8MicroKernel& kernel, std::mt19937& gen) {
+    for (std::size_t m: {1, 13, 50}) {
+        for (std::size_t n: {1, 17, 70}) {
+            for (std::size_t k: {1, 3, 300, 1100}) {
+                INFO("m=" << m << " n=" << n << " k=" << k);
+                const auto a = random_tensor<T>(Shape<2>{m, k}, gen);
+                const auto b = random_tensor<U>(Shape<2>{k, n}, gen);
+
+                std::vector<std::int32_t> zb(n);
+                for (std::size_t j = 0; j < n; j++)
+                    zb[j] = static_cast<std::int32_t>(j % 5) - 2;
+                const std::int32_t za = 3;
+
+                impl::Int8Epilogue<std::int32_t> epilogue;
+                epilogue.a_zero_point = za;
+                epilogue.b_zero_points = zb.data();
+
+                Tensor<std::int32_t, 2> c{Shape<2>{m, n}};
+                impl::gemm_int8(m, n, k, a.data(), k, b.data(), n, c.data(), n, epilogue, {}, kernel);
+
+                const auto expected = reference_int8(a, za, b, zb);
+                for (std::size_t i = 0; i < m * n; i++)
+                    REQUIRE(c.data()[i] == expected[i]);
+            }
+        }
+    }
+}
+}
+
+TEST_CASE("Int8 GEMM kernels", "[Quantized]") {
+    const Isa best = impl::detect_isa(cpu_features());
+    std::mt19937 gen{3};
+
+    for (Isa isa: {Isa::Scalar, Isa::AVX2, Isa::AVX512}) {
+        for (bool vnni: {false, true}) {
+            if (isa > best || (vnni && (isa != Isa::AVX512 || !cpu_features().avx512_vnni)))
+                continue;
+
+            const auto kernel = impl::Int8GemmKernels::kernel(isa, vnni);
+            INFO("kernel=" << kernel.name);
+
+            check_int8_gemm<std::int8_t, std::int8_t>(kernel, gen);
+            check_int8_gemm<std::uint8_t, std::int8_t>(kernel, gen);
+            check_int8_gemm<std::int8_t, std::uint8_t>(kernel, gen);
+            check_int8_gemm<std::uint8_t, std::uint8_t>(kernel, gen);
+        }
+    }
+}
+
+TEST_CASE("Integer matmul", "[Quantized]") {
+    std::mt19937 gen{5};
+
+    SECTION("32-bit sums") {
+        const auto a = random_tensor<std::int8_t>(Shape<2>{37, 260}, gen);
+        const auto b = random_tensor<std::int8_t>(Shape<2>{260, 45}, gen);
+
+        const Tensor<int, 2> c = matmul(a, b);
+        REQUIRE(c.shape() == (Shape<2>{37, 45}));
+        REQUIRE(is_equal(c, matmul(a.as<int>(), b.as<int>())));
+    }
+
+    SECTION("Batches") {
+        const auto a = random_tensor<std::uint8_t>(Shape<3>{4, 9, 30}, gen);
+        const auto b = random_tensor<std::int8_t>(Shape<2>{30, 11}, gen);
+        REQUIRE(is_equal(matmul(a, b), matmul(a.as<int>(), b.as<int>())));
+    }
+
+    SECTION("Threads") {
+        ThreadPool pool{4};
+        const auto a = random_tensor<std::int8_t>(Shape<2>{300, 200}, gen);
+        const auto b = random_tensor<std::uint8_t>(Shape<2>{200, 250}, gen);
+        REQUIRE(is_equal(matmul(a, b, GemmOptions{4, &pool}), matmul(a.as<int>(), b.as<int>())));
+    }
+}
+
+TEST_CASE("Quantization", "[Quantized]") {
+    SECTION("Parameters") {
+        const auto params = quant_params<std::uint8_t>(-1.0f, 3.0f);
+        REQUIRE(params.scale == Catch::Approx(4.0f / 255));
+        REQUIRE(params.zero_point == 64);
+
+        const auto positive = quant_params<std::int8_t>(0.5f, 2.0f);
+        REQUIRE(positive.zero_point == -128);
+    }
+
+    SECTION("Round trip") {
+        Tensor<float, 2> t{Shape<2>{20, 30}};
+        for (std::size_t i = 0; i < t.num_elem(); i++)
+            t.data()[i] = static_cast<float>(i % 97) / 24.0f - 2.0f;
+
+        const auto params = quant_params<std::int8_t>(-2.0f, 2.0f);
+        const auto q = quantize<std::int8_t>(t, params);
+        const auto x = dequantize(q, params);
+        for (std::size_t i = 0; i < t.num_elem(); i++)
+            REQUIRE(std::abs(x.data()[i] - t.data()[i]) <= params.scale / 2 + 1e-6f);
+    }
+
+    SECTION("Per channel") {
+        const Tensor<float, 1> scales{0.5f, 0.25f, 2.0f};
+        const Tensor<std::int32_t, 1> zero_points{0, 10, -3};
+        QuantParams params;
+        params.channel_scales = &scales;
+        params.channel_zero_points = &zero_points;
+
+        const Tensor<float, 2> t{{1.0f, 1.0f, 1000.0f}, {-1.0f, 0.5f, 4.0f}};
+        const auto q = quantize<std::int8_t>(t, params);
+        REQUIRE(is_equal(q, Tensor<std::int8_t, 2>{{2, 14, 127}, {-2, 12, -1}}));
+    }
+}
+
+TEST_CASE("Quantized matmul", "[Quantized]") {
+    std::mt19937 gen{9};
+    const std::size_t m = 23;
+    const std::size_t n = 19;
+    const std::size_t k = 150;
+
+    const auto a = random_tensor<std::uint8_t>(Shape<2>{m, k}, gen);
+    const auto b = random_tensor<std::int8_t>(Shape<2>{k, n}, gen);
+    const QuantParams a_params{0.02f, 120};
+
+    Tensor<float, 1> scales{Shape<1>{n}};
+    for (std::size_t j = 0; j < n; j++)
+        scales.data()[j] = 0.001f * static_cast<float>(j + 1);
+    QuantParams b_params;
+    b_params.channel_scales = &scales;
+
+    Tensor<float, 1> bias{Shape<1>{n}};
+    for (std::size_t j = 0; j < n; j++)
+        bias.data()[j] = static_cast<float>(j) * 0.1f - 1.0f;
+
+    const auto expected = matmul(dequantize(a, a_params), dequantize(b, b_params));
+
+    SECTION("Real valued output") {
+        const auto c = quantized_matmul<float>(a, a_params, b, b_params);
+        for (std::size_t i = 0; i < c.num_elem(); i++)
+            REQUIRE(c.data()[i] == Catch::Approx(expected.data()[i]).margin(1e-4));
+    }
+
+    SECTION("Requantized output") {
+        QuantEpilogue epilogue;
+        epilogue.bias = &bias;
+        epilogue.activation = Activation::ReLU;
+        epilogue.output = quant_params<std::uint8_t>(0.0f, 4.0f);
+
+        const auto c = quantized_matmul<std::uint8_t>(a, a_params, b, b_params, epilogue);
+        for (std::size_t i = 0; i < m; i++) {
+            for (std::size_t j = 0; j < n; j++) {
+                const float real = std::max(0.0f, expected.at(i, j) + bias.at(j));
+                const float q = std::min(255.0f, std::nearbyint(real / epilogue.output.scale));
+                REQUIRE(std::abs(static_cast<float>(c.at(i, j)) - q) <= 1.0f);
+            }
+        }
+    }
+}
@@ -269,6 +269,40 @@ TEST_CASE("Zeros", "[Tensor]") {
     REQUIRE(t.at(1, 1) == 0);
 }
 
+TEST_CASE("Zeros on zero pages", "[Tensor]") {
+    const Shape<2> shape{1024, 1024};
+    auto t = zeros<double>(shape);
+    REQUIRE(t.allocator().resource() == zeroed_resource());
+    REQUIRE(t.at(0, 0) == 0.0);
+    REQUIRE(t.at(512, 17) == 0.0);
+    REQUIRE(t.at(1023, 1023) == 0.0);
+    REQUIRE(t.sum() == 0.0);
+
+    t.at(3, 4) = 2.0;
+    REQUIRE(t.sum() == 2.0);
+}
+
+TEST_CASE("Zeros in a scoped resource", "[Tensor]") {
+    std::pmr::monotonic_buffer_resource resource;
+    ScopedResource scope{&resource};
+
+    auto t = zeros<double>(Shape<2>{1024, 1024});
+    REQUIRE(t.allocator().resource() == &resource);
+    REQUIRE(t.at(0, 0) == 0.0);
+    REQUIRE(t.at(1023, 1023) == 0.0);
+    REQUIRE(t.sum() == 0.0);
+}
+
+TEST_CASE("Empty", "[Tensor]") {
+    auto t = Tensor<float, 2>::empty({3, 4});
+    REQUIRE(t.shape() == Shape<2>{3, 4});
+    REQUIRE(t.capacity() == 12);
+
+    auto s = Tensor<std::string, 1>::empty({2});
+    REQUIRE(s.at(0).empty());
+    REQUIRE(s.at(1).empty());
+}
+
 TEST_CASE("Ones", "[Tensor]") {
     constexpr Shape<2> shape{2, 2};
     auto t = ones<int>(shape);
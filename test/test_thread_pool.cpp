@@ -0,0 +1,132 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "cktensor/thread_pool.h"
+#include "helpers.h"
+
+
+using namespace ck;
+
+TEST_CASE("Thread pool", "[ThreadPool]") {
+    ThreadPool pool{4};
+    REQUIRE(pool.num_threads() == 4);
+
+    SECTION("Runs every index once") {
+        for (std::size_t n: {0, 1, 3, 4, 1000}) {
+            std::vector<std::atomic<int>> counts(n);
+            pool.parallel_for(n, [&](std::size_t i) { counts[i]++; });
+
+            for (std::size_t i = 0; i < n; i++)
+                REQUIRE(counts[i] == 1);
+        }
+    }
+
+    SECTION("Reused across loops") {
+        std::atomic<std::size_t> sum{0};
+        for (int rep = 0; rep < 100; rep++)
+            pool.parallel_for(10, [&](std::size_t i) { sum += i; });
+        REQUIRE(sum == 100 * 45);
+    }
+
+    SECTION("Thread limit") {
+        std::atomic<int> active{0};
+        std::atomic<int> max_active{0};
+        pool.parallel_for(64, [&](std::size_t) {
+            const int now = ++active;
+            int prev = max_active;
+            while (prev < now && !max_active.compare_exchange_weak(prev, now)) {}
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            active--;
+        }, 2);
+        REQUIRE(max_active <= 2);
+    }
+
+    SECTION("Nested loops run serially") {
+        std::atomic<int> count{0};
+        std::atomic<int> in_region{0};
+        pool.parallel_for(8, [&](std::size_t) {
+            if (ThreadPool::in_parallel_region())
+                in_region++;
+            pool.parallel_for(8, [&](std::size_t) { count++; });
+        });
+        REQUIRE(in_region == 8);
+        REQUIRE(count == 64);
+        REQUIRE_FALSE(ThreadPool::in_parallel_region());
+    }
+
+    SECTION("Exceptions reach the caller") {
+        REQUIRE_THROWS_AS(pool.parallel_for(100, [](std::size_t i) {
+            if (i == 57)
+                throw std::runtime_error{"failed"};
+        }), std::runtime_error);
+
+        std::atomic<int> count{0};
+        pool.parallel_for(100, [&](std::size_t) { count++; });
+        REQUIRE(count == 100);
+    }
+}
+
+TEST_CASE("Parallel ranges", "[ThreadPool]") {
+    ThreadPool pool{4};
+    alignas(64) static char buffer[64 * 1024];
+
+    for (std::size_t element_bytes: {1, 4, 8, 16}) {
+        // Arrays start on their elements
+        for (std::size_t offset: {std::size_t{0}, element_bytes, 3 * element_bytes}) {
+            for (std::size_t n: {0, 1, 15, 100, 1000, 3001}) {
+                INFO("element_bytes=" << element_bytes << " offset=" << offset << " n=" << n);
+                const char* out = buffer + offset;
+                std::mutex mutex;
+                std::vector<std::pair<std::size_t, std::size_t>> ranges;
+                impl::parallel_ranges(pool, n, 3, out, element_bytes, [&](std::size_t begin, std::size_t end) {
+                    std::lock_guard lock{mutex};
+                    ranges.emplace_back(begin, end);
+                });
+
+                REQUIRE(ranges.size() <= 3);
+                std::sort(ranges.begin(), ranges.end());
+                std::size_t next = 0;
+                for (const auto& [begin, end]: ranges) {
+                    REQUIRE(begin == next);
+                    REQUIRE(begin <= end);
+                    if (begin != 0)
+                        REQUIRE(reinterpret_cast<std::uintptr_t>(out + begin * element_bytes) % 64 == 0);
+                    next = end;
+                }
+                REQUIRE(next == n);
+            }
+        }
+    }
+
+    SECTION("Threshold") {
+        const std::size_t threshold = parallel_threshold();
+        {
+            test::ScopedParallelThreshold scope{100};
+            REQUIRE(parallel_threshold() == 100);
+        }
+        REQUIRE(parallel_threshold() == threshold);
+    }
+
+    SECTION("Scoped pool") {
+        ThreadPool outer{2};
+        ThreadPool inner{3};
+        REQUIRE(&current_thread_pool() == &default_thread_pool());
+        {
+            ScopedThreadPool outer_scope{&outer};
+            REQUIRE(&current_thread_pool() == &outer);
+            {
+                ScopedThreadPool inner_scope{&inner};
+                REQUIRE(&current_thread_pool() == &inner);
+            }
+            REQUIRE(&current_thread_pool() == &outer);
+        }
+        REQUIRE(&current_thread_pool() == &default_thread_pool());
+    }
+}